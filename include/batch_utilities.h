@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// === Helpers for processing many inputs in one run
+
+// One input of a batch
+struct BatchInput {
+  std::string filename;
+  std::string outputPrefix; // prefix for this input's output files, unique within the batch
+  size_t fileBytes = 0;     // used as a proxy for the size of the mesh when scheduling
+};
+
+// List the inputs given by `path`, which is either a directory (all mesh files directly inside it, by extension) or a
+// manifest file (one path per line; blank lines and lines starting with '#' are ignored, relative paths are relative to
+// the manifest's directory). Each input gets the output prefix `outputPrefix + <file stem> + "_"`; if an earlier input
+// already has that prefix, the stem gets the smallest numeric suffix (from "_2") which makes it unique. Throws
+// std::runtime_error if `path` cannot be read.
+std::vector<BatchInput> listBatchInputs(const std::string& path, const std::string& outputPrefix);
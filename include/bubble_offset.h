@@ -5,6 +5,9 @@
 #include "geometrycentral/surface/surface_point.h"
 #include "geometrycentral/surface/vertex_position_geometry.h"
 
+#include <array>
+#include <vector>
+
 using namespace geometrycentral;
 using namespace geometrycentral::surface;
 
@@ -22,11 +25,34 @@ public:
   // Methods
   Vector3 queryPoint(const SurfacePoint& p);
 
+  // The same as queryPoint(SurfacePoint(f, bary)). Reads everything from the per-face tables below, rather than walking
+  // the mesh, so it is safe to call concurrently.
+  Vector3 queryFacePoint(Face f, const Vector3& bary) const;
+
+  // Batch version: out[i] = queryFacePoint(faces[i], baryCoords[i]). nThreads = 0 uses all hardware threads.
+  void queryFacePoints(const std::vector<Face>& faces, const std::vector<Vector3>& baryCoords,
+                       std::vector<Vector3>& out, size_t nThreads = 1) const;
+
 
   // Members
   EmbeddedGeometryInterface& geom;
   EdgeData<Vector3> edgeNormals;
+
+private:
+  // Per-face tables, one array per quantity, with entry j belonging to halfedge j of the face (in the order
+  // f.halfedge(), .next(), .next().next()): the position of its tail vertex, and the normal and length of its edge
+  std::array<FaceData<Vector3>, 3> faceCornerPositions;
+  std::array<FaceData<Vector3>, 3> faceEdgeNormals;
+  std::array<FaceData<double>, 3> faceEdgeLengths;
 };
 
+// Subdivide each face subdivLevel times (in to 4^subdivLevel triangles, with its own copies of the vertices), and
+// offset the vertices with BubbleOffset. nThreads = 0 uses all hardware threads.
+std::unique_ptr<SimplePolygonMesh> subdivideRounded(ManifoldSurfaceMesh& mesh, VertexPositionGeometry& geom,
+                                                    int subdivLevel, double scale, double dialate, double normalOffset,
+                                                    size_t nThreads = 1);
+
+// As above, but only for the given faces (in that order), e.g. to show a region of a large mesh in detail
 std::unique_ptr<SimplePolygonMesh> subdivideRounded(ManifoldSurfaceMesh& mesh, VertexPositionGeometry& geom,
-                                                    int subdivLevel, double scale, double dialate, double normalOffset);
+                                                    const std::vector<Face>& faces, int subdivLevel, double scale,
+                                                    double dialate, double normalOffset, size_t nThreads = 1);
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "mesh_io.h"
+
+#include "geometrycentral/numerical/linear_algebra_utilities.h"
+#include "geometrycentral/surface/surface_mesh.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using geometrycentral::SparseMatrix;
+using geometrycentral::surface::EdgeData;
+using geometrycentral::surface::SurfaceMesh;
+
+// === Fused cotan Laplacian and mass matrix assembly
+//
+// Builds the same weak cotan Laplacian and lumped mass matrix as geometry-central's EdgeLengthGeometry
+// (requireCotanLaplacian() and requireVertexLumpedMassMatrix()), but from flat arrays, in two steps:
+//   - one pass over the triangles computes the areas and the cotan weights of every triangle, from edge lengths stored
+//     as structure of arrays, a block of triangles at a time with Eigen array expressions (so it is vectorized across
+//     triangles)
+//   - the matrices are then written straight in to their compressed storage, one column at a time in parallel, from
+//     the list of triangle corners at each vertex
+// Beyond the triangles and the matrices themselves this needs about 16 bytes per corner, rather than the 4 triplets
+// per corner (and the copy setFromTriplets() makes of them) of the general path.
+
+// An intrinsic triangle mesh: connectivity, and the length of each side of each triangle
+struct IntrinsicTriangles {
+  size_t nVertices = 0;
+  std::vector<std::array<uint32_t, 3>> vertices;
+  // edgeLengths[j][iF] is the length of the side of triangle iF from corner j to corner (j + 1) % 3
+  std::array<std::vector<double>, 3> edgeLengths;
+  // If not empty, the area and cotan weights of each triangle are multiplied by its entry
+  std::vector<double> faceScales;
+
+  size_t nTriangles() const { return vertices.size(); }
+};
+
+// The triangles of a geometry-central mesh (whose faces must all be triangles), with the given edge lengths
+IntrinsicTriangles intrinsicTrianglesFromMesh(SurfaceMesh& mesh, const EdgeData<double>& edgeLengths,
+                                              size_t nThreads = 1);
+
+// The triangles of a flat mesh, with their extrinsic edge lengths
+IntrinsicTriangles intrinsicTrianglesFromPositions(const FlatTriangleMesh& mesh, size_t nThreads = 1);
+
+// The weak cotan Laplacian L and the lumped mass matrix M, each multiplied by `scale`. Vertices with no triangles get
+// an empty column in L, and a zero mass. nThreads = 0 uses all hardware threads. Throws std::runtime_error if L has
+// too many entries for 32-bit indices.
+void buildCotanOperators(const IntrinsicTriangles& triangles, double scale, SparseMatrix<double>& L,
+                         SparseMatrix<double>& M, size_t nThreads = 1);
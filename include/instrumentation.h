@@ -0,0 +1,102 @@
+#pragma once
+
+// === Tracing
+//
+// Scoped timers and counters around the main stages of the pipeline, for seeing where the time goes in a real run
+// rather than in tufted-bench. They are only compiled in with TUFTED_ENABLE_TRACING (the TUFTED_WITH_TRACING CMake
+// option); without it the macros compile to nothing, and their arguments are not evaluated.
+//
+//   TUFTED_TRACE_SCOPE("name");     records the wall time of the enclosing scope
+//   TUFTED_TRACE_COUNT("name", n);  adds n to a named counter
+//
+// Nothing is recorded until startTracing(), and stopTracing() writes everything recorded since as Chrome trace JSON
+// (for chrome://tracing or ui.perfetto.dev): one complete event per scope, and a sample of each counter which changed
+// whenever a scope ends. Names must be string literals.
+//
+// Scopes take a lock when they end, so they belong around stages and blocks of work, not single items. Counters are
+// cheap enough for per-item use (a relaxed atomic add, on a slot chosen per thread).
+
+#ifdef TUFTED_ENABLE_TRACING
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class TraceCounter {
+public:
+  explicit TraceCounter(const char* name);
+
+  void add(uint64_t n) { slots[threadSlot()].value.fetch_add(n, std::memory_order_relaxed); }
+  uint64_t total() const;
+  void reset();
+
+  const char* const name;
+
+private:
+  static const size_t nSlots = 16;
+  struct Slot {
+    std::atomic<uint64_t> value{0};
+    char padding[64 - sizeof(std::atomic<uint64_t>)]; // (one cache line each, so threads do not contend)
+  };
+
+  static size_t threadSlot() {
+    static std::atomic<size_t> nextSlot(0);
+    thread_local size_t slot = nextSlot++ % nSlots;
+    return slot;
+  }
+
+  Slot slots[nSlots];
+};
+
+// The counter with this name, created on first use. Counters live until the program exits.
+TraceCounter& registerTraceCounter(const char* name);
+
+// Start recording, discarding anything recorded before and resetting every counter
+void startTracing();
+
+// Stop recording, and write the trace to `filename`. Throws std::runtime_error if it cannot be written.
+void stopTracing(const std::string& filename);
+
+bool tracingActive();
+
+// Record a scope which ran from `start` to `end`
+void recordTraceScope(const char* name, std::chrono::steady_clock::time_point start,
+                      std::chrono::steady_clock::time_point end);
+
+class TraceScope {
+public:
+  explicit TraceScope(const char* name_) : name(name_), active(tracingActive()) {
+    if (active) start = std::chrono::steady_clock::now();
+  }
+  ~TraceScope() {
+    if (active) recordTraceScope(name, start, std::chrono::steady_clock::now());
+  }
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+  const char* name;
+  bool active;
+  std::chrono::steady_clock::time_point start;
+};
+
+#define TUFTED_TRACE_CONCAT_INNER(a, b) a##b
+#define TUFTED_TRACE_CONCAT(a, b) TUFTED_TRACE_CONCAT_INNER(a, b)
+#define TUFTED_TRACE_SCOPE(name) TraceScope TUFTED_TRACE_CONCAT(traceScope_, __LINE__)(name)
+#define TUFTED_TRACE_COUNT(name, n)                                                                                    \
+  do {                                                                                                                 \
+    static TraceCounter& traceCounter_ = registerTraceCounter(name);                                                   \
+    traceCounter_.add(n);                                                                                              \
+  } while (0)
+
+#else
+
+#define TUFTED_TRACE_SCOPE(name)
+#define TUFTED_TRACE_COUNT(name, n)                                                                                    \
+  do {                                                                                                                 \
+    (void)sizeof(n); /* (not evaluated, but no unused variable warnings either) */                                     \
+  } while (0)
+
+#endif
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "point_cloud_utilities.h"
+#include "tufted_cover.h"
+
+#include "geometrycentral/surface/simple_polygon_mesh.h"
+#include "geometrycentral/surface/surface_mesh.h"
+#include "geometrycentral/surface/vertex_position_geometry.h"
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+using geometrycentral::surface::EdgeData;
+using geometrycentral::surface::SimplePolygonMesh;
+using geometrycentral::surface::SurfaceMesh;
+using geometrycentral::surface::VertexPositionGeometry;
+
+// === Building tufted Laplacians from in-memory data
+//
+// The whole tufted-idt pipeline as a library: point clouds are triangulated by the union of local Delaunay
+// triangulations, meshes are sanitized (faces with repeated vertices and unreferenced vertices are removed, polygons
+// are triangulated, see mesh_sanitation.h), and then the steps of geometry-central's buildTuftedLaplacian() give the
+// weak Laplacian L and the lumped mass matrix M (assembled directly in compressed form, see cotan_assembly.h). Invalid
+// input throws std::runtime_error.
+
+struct TuftedLaplacianOptions {
+  double mollifyFactor = 1e-6; // intrinsic mollification, relative to the mean edge length
+
+  // Point clouds only (see point_cloud_utilities.h)
+  size_t nNeigh = 30;
+  NormalEstimator normalEstimator = NormalEstimator::SVD;
+  LocalTriangulator localTriangulator = LocalTriangulator::Voronoi;
+  // Merge repeated triangles, weighting each by its number of copies / 3, rather than keeping all and scaling by 1/3.
+  // The total mass is the same, the other entries close (see flipToDelaunayWithinScales() in tufted_cover.h).
+  bool dedupTriangles = false;
+  bool referencePointCloud = false;    // use the unfused reference pipeline
+  bool checkLocalTriangulator = false; // also run the Voronoi triangulator, and log the differences
+  // If nonzero, clouds of more than this many points are built in spatial tiles of (at most) this size, to bound memory
+  // (see tiled_point_cloud.h). Not compatible with the reference pipeline, the triangulator check or keepTuftedCover.
+  size_t tilePoints = 0;
+  double tileHaloRadii = 3.; // halo around each tile, in multiples of its largest kNN radius
+
+  // How to build the tufted cover. CoverBuilder::Flat is built in parallel from flat arrays (see tufted_cover.h), and
+  // gives the same operators up to roundoff, unless faces around an edge are at exactly the same angle.
+  CoverBuilder coverBuilder = CoverBuilder::GeometryCentral;
+
+  // Check whether the mesh is edge-manifold and already intrinsic Delaunay first, and if so skip the tufted cover and
+  // build the cotan Laplacian directly (see manifold_precheck.h). The result is the same up to roundoff, but the
+  // halfedge mesh is then not built. Not done with keepTuftedCover, or for point clouds unless dedupTriangles is set.
+  bool manifoldFastPath = true;
+
+  size_t nThreads = 1; // for point clouds, sanitizing, the flat cover and assembly; 0 means all hardware threads
+
+  // Index the rows and columns of L and M by input vertex, rather than by sanitized vertex. Vertices which are not used
+  // by any face then get empty rows and columns.
+  bool preserveVertexIndices = false;
+
+  // Also return the intrinsic tufted cover the operators were built on, see TuftedLaplacianResult::tuftedCover
+  bool keepTuftedCover = false;
+
+  // If non-empty, a directory in which to cache the final L and M, keyed by the sanitized mesh and the parameters above
+  // (see operator_cache.h). On a hit the operators are loaded straight from the cache.
+  std::string cacheDirectory;
+
+  std::ostream* log = nullptr; // if non-null, progress is reported here
+};
+
+struct TuftedLaplacianResult {
+  SparseMatrix<double> L; // weak Laplacian
+  SparseMatrix<double> M; // lumped (diagonal) mass matrix
+
+  bool isPointCloud = false;
+  bool tookManifoldFastPath = false; // see TuftedLaplacianOptions::manifoldFastPath
+
+  // For each vertex of triangleMesh (and, unless preserveVertexIndices is set, each row / column of L and M), the
+  // index of the corresponding input vertex. Unreferenced input vertices are removed, so this is only the identity if
+  // every vertex is used by some face.
+  std::vector<size_t> vertexIndices;
+  // The inverse: for each input vertex, its index in triangleMesh, or INVALID_IND if it was removed
+  std::vector<size_t> vertexRows;
+
+  // The mesh the Laplacian was built on (after triangulating point clouds and sanitizing): its vertex positions, and
+  // its triangles as 0-indexed vertex triples. The polygon list of triangleMesh is only built along with the halfedge
+  // mesh and geometry; when the operators are loaded from the cache, or on the manifold fast path, all three are left
+  // empty (see requirePolygons()).
+  SimplePolygonMesh triangleMesh;
+  std::vector<uint32_t> triangles;
+  // Point clouds with dedupTriangles only: the weight of each face of triangleMesh (see IntrinsicTriangles::faceScales)
+  std::vector<double> faceScales;
+  std::unique_ptr<SurfaceMesh> mesh;
+  std::unique_ptr<VertexPositionGeometry> geometry;
+
+  // Only with keepTuftedCover (and not on a cache hit): the intrinsic tufted cover of `mesh`, before it was flipped to
+  // Delaunay, with the input vertex positions and the (mollified) intrinsic edge lengths L and M were built from
+  std::unique_ptr<SurfaceMesh> tuftedCover;
+  std::unique_ptr<VertexPositionGeometry> tuftedCoverGeometry;
+  EdgeData<double> tuftedCoverEdgeLengths;
+};
+
+// Fill in result.triangleMesh.polygons from result.triangles, if it is empty
+void requirePolygons(TuftedLaplacianResult& result);
+
+// From a general polygon mesh (or, if it has no faces, a point cloud)
+TuftedLaplacianResult buildTuftedLaplacianFromPolygonMesh(SimplePolygonMesh inputMesh,
+                                                          const TuftedLaplacianOptions& options = {});
+
+// From caller-owned buffers: `vertexPositions` holds nVertices xyz triples, and `faceIndices` holds nFaces faces of
+// `faceDegree` vertices each (e.g. 3 for a triangle mesh), 0-indexed. The buffers are only read during the call.
+// Instantiated for int32_t, uint32_t, int64_t and uint64_t indices.
+template <typename IndexT>
+TuftedLaplacianResult buildTuftedLaplacianFromMesh(const double* vertexPositions, size_t nVertices,
+                                                   const IndexT* faceIndices, size_t nFaces, size_t faceDegree = 3,
+                                                   const TuftedLaplacianOptions& options = {});
+
+// From a caller-owned buffer of nPoints xyz triples
+TuftedLaplacianResult buildTuftedLaplacianFromPoints(const double* pointPositions, size_t nPoints,
+                                                     const TuftedLaplacianOptions& options = {});
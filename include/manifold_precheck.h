@@ -0,0 +1,38 @@
+#pragma once
+
+#include "cotan_assembly.h"
+#include "mesh_io.h"
+#include "tufted_cover.h"
+
+#include <cstddef>
+#include <vector>
+
+// === Manifold fast path
+//
+// Around an edge with at most two faces the tufted cover looks just like the mesh: it glues the two faces (or, at the
+// boundary, the face and its mirror image) along the edge, so intrinsic Delaunay flips on the cover are flips of the
+// mesh. On an edge-manifold mesh whose edges are all already Delaunay (as flipToDelaunay() judges them, on the
+// mollified lengths), flipping does nothing, and the tufted Laplacian is just the cotan Laplacian of the mesh. The
+// pre-check finds out whether that is the case, from the flat edge incidence alone.
+//
+// Boundary edges count as Delaunay if their opposite angle is at most 90 degrees, since otherwise the cover flips them
+// across the mirrored face. Vertex-manifoldness does not matter for the result, and is only reported.
+
+struct ManifoldPrecheck {
+  size_t nNonmanifoldEdges = 0;    // edges with more than two faces
+  size_t nNonmanifoldVertices = 0; // vertices whose faces do not form a single fan
+  size_t nBoundaryEdges = 0;
+  size_t nNonDelaunayEdges = 0; // among edges with at most two faces
+
+  bool isEdgeManifold() const { return nNonmanifoldEdges == 0; }
+  bool isVertexManifold() const { return nNonmanifoldVertices == 0; }
+  bool coverIsTrivial() const { return isEdgeManifold() && nNonDelaunayEdges == 0; }
+};
+
+// `edgeLengths` are the (mollified) lengths of `edges`, see buildEdgeLengths()
+ManifoldPrecheck precheckTuftedCover(const FlatTriangleMesh& mesh, const EdgeIncidence& edges,
+                                     const std::vector<double>& edgeLengths, size_t nThreads = 1);
+
+// The triangles of `mesh`, with the given edge lengths, for buildCotanOperators()
+IntrinsicTriangles intrinsicTrianglesFromEdgeLengths(const FlatTriangleMesh& mesh, const EdgeIncidence& edges,
+                                                     const std::vector<double>& edgeLengths, size_t nThreads = 1);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// === Read-only file mapping
+//
+// Maps a whole file in to memory with mmap(), or reads it in to a buffer where mmap is not available (Windows). The
+// contents stay valid for the lifetime of the object. Throws std::runtime_error if the file cannot be opened.
+class MappedFile {
+public:
+  explicit MappedFile(const std::string& filename);
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const unsigned char* data() const { return bytes; }
+  size_t size() const { return nBytes; }
+
+  // Hint that the file will be read front to back (a no-op where unsupported)
+  void adviseSequential() const;
+
+private:
+  const unsigned char* bytes = nullptr;
+  size_t nBytes = 0;
+  bool isMapped = false;
+  std::vector<unsigned char> fallbackBuffer; // holds the file contents where mmap is not available
+};
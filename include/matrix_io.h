@@ -0,0 +1,110 @@
+#pragma once
+
+#include "mapped_file.h"
+
+#include "geometrycentral/numerical/linear_algebra_utilities.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using geometrycentral::SparseMatrix;
+
+
+// === Sparse matrix output
+//
+// All writers go through large in-memory buffers (never flushing per entry), and throw std::runtime_error if the file
+// cannot be written. They take a double matrix, and write values of type T, double or float, always with 32-bit
+// indices. Values are converted one at a time as they are written, without a converted copy of the matrix. Text formats
+// write enough digits to round-trip the value type.
+
+enum class MatrixFormat {
+  SPMAT,        // ASCII `row col value` lines, 1-indexed (matlab convention). Load in matlab with spconvert(load(...)).
+  Binary,       // raw little-endian CSC arrays with a small header, see saveMatrixBinary()
+  MatrixMarket, // ASCII Matrix Market coordinate format, 1-indexed
+  NPZ           // numpy .npz archive of COO triplets, loadable with scipy.sparse.load_npz()
+};
+
+// Parse a format name, one of "spmat", "bin", "mtx", "npz" (throws on anything else)
+MatrixFormat parseMatrixFormat(const std::string& name);
+
+// The filename extension used for each format (e.g. "spmat")
+std::string matrixFormatExtension(MatrixFormat format);
+
+// Write a matrix in the given format
+template <typename T = double>
+void saveMatrix(const std::string& filename, const SparseMatrix<double>& matrix,
+                MatrixFormat format = MatrixFormat::SPMAT);
+
+// Individual writers
+
+template <typename T = double>
+void saveMatrixSPMAT(const std::string& filename, const SparseMatrix<double>& matrix);
+
+// Layout of the binary format, all little-endian, with no padding:
+//   char[8]   magic "TUFTCSC\0"
+//   uint32    version (1)
+//   uint32    bytes per value (8 for a double, 4 for a float)
+//   uint64    rows
+//   uint64    cols
+//   uint64    nnz
+//   int64     colStart[cols + 1]
+//   int32     rowIndex[nnz]
+//   float64   value[nnz] (or float32)
+// Entries are 0-indexed, sorted by column and then by row. In numpy, this is
+// scipy.sparse.csc_matrix((value, rowIndex, colStart), shape=(rows, cols)).
+template <typename T = double>
+void saveMatrixBinary(const std::string& filename, const SparseMatrix<double>& matrix);
+
+template <typename T = double>
+void saveMatrixMarket(const std::string& filename, const SparseMatrix<double>& matrix);
+
+// Stores (uncompressed) the arrays row, col, data, shape and format='coo', exactly as scipy.sparse.save_npz() would.
+// Limited to 4GB per array (there is no zip64 support); use the binary format for larger matrices.
+template <typename T = double>
+void saveMatrixNPZ(const std::string& filename, const SparseMatrix<double>& matrix);
+
+
+// === Dense output
+
+// ASCII, one line per row with space-separated values (e.g. eigenvalues, eigenvectors as columns). Load with
+// numpy.loadtxt() or matlab's load().
+void saveDenseMatrix(const std::string& filename, const Eigen::MatrixXd& matrix);
+
+
+// === Memory-mapped operators
+//
+// Writes the Laplacian L (as its compressed CSC arrays) and the diagonal of the lumped mass matrix M (as a dense
+// vector) to a single file. Readers can map it and wrap the arrays directly, see MappedOperators below. Layout, in
+// native (little-endian) byte order, with every array starting at a multiple of 64 bytes from the start of the file:
+//   char[8]   magic "TUFTMAP\0"
+//   uint32    version (1)
+//   uint32    bytes per index (4)
+//   uint32    bytes per value (8)
+//   uint32    (padding)
+//   int64     V, the number of rows and columns
+//   int64     nnz of L
+//   uint64    byte offset of L's outer index array, int32[V + 1]
+//   uint64    byte offset of L's inner index array, int32[nnz]
+//   uint64    byte offset of L's values, float64[nnz]
+//   uint64    byte offset of M's diagonal, float64[V]
+void saveOperatorsMapped(const std::string& filename, const SparseMatrix<double>& L, const SparseMatrix<double>& M);
+
+// Read-only view of a file written by saveOperatorsMapped(). The file stays mapped while this object lives, and the
+// matrices returned below point directly at it (they must not outlive this object).
+class MappedOperators {
+public:
+  explicit MappedOperators(const std::string& filename);
+  MappedOperators(const MappedOperators&) = delete;
+  MappedOperators& operator=(const MappedOperators&) = delete;
+
+  Eigen::Map<const SparseMatrix<double>> laplacian() const;
+  Eigen::Map<const Eigen::VectorXd> massDiagonal() const;
+
+private:
+  MappedFile file;
+
+  int64_t V = 0;
+  int64_t nnz = 0;
+  uint64_t outerOffset = 0, innerOffset = 0, valueOffset = 0, massOffset = 0;
+};
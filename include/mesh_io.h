@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// === Fast mesh and point cloud loading
+//
+// A faster alternative to loading through geometry-central's SimplePolygonMesh, for large inputs. Files are loaded
+// straight in to flat arrays of triangles, with no heap allocation per face: polygons are fan-triangulated (as
+// SimplePolygonMesh::triangulate() would), and polygons which repeat a vertex are dropped (as
+// SimplePolygonMesh::stripFacesWithDuplicateVertices() would). Handles
+//   - binary PLY (little or big endian), read in place from a memory mapping
+//   - ASCII OBJ, parsed in parallel in large chunks
+//   - the raw binary ".tmesh" format, see saveFlatMeshRaw()
+// Other files (ASCII PLY, OFF, STL, ...) are left to geometry-central. Malformed files throw std::runtime_error.
+
+struct FlatTriangleMesh {
+  std::vector<double> vertexPositions; // xyz triples
+  std::vector<uint32_t> triangles;     // vertex index triples, 0-indexed (empty for a point cloud)
+
+  size_t nVertices() const { return vertexPositions.size() / 3; }
+  size_t nTriangles() const { return triangles.size() / 3; }
+};
+
+// Load `filename` in to `mesh`, if it is in one of the formats above. Returns false (leaving `mesh` empty) if it is
+// not, in which case it should be loaded with the general geometry-central loader. nThreads = 0 uses all hardware
+// threads.
+bool loadFlatMesh(const std::string& filename, FlatTriangleMesh& mesh, size_t nThreads = 1);
+
+// Individual loaders, which always load (or throw)
+void loadFlatMeshPLY(const std::string& filename, FlatTriangleMesh& mesh, size_t nThreads = 1); // binary PLY only
+void loadFlatMeshOBJ(const std::string& filename, FlatTriangleMesh& mesh, size_t nThreads = 1);
+void loadFlatMeshRaw(const std::string& filename, FlatTriangleMesh& mesh, size_t nThreads = 1);
+
+// Layout of the raw format, all little-endian, with no padding:
+//   char[8]   magic "TUFTMSH\0"
+//   uint32    version (1)
+//   uint32    reserved (0)
+//   uint64    nVertices
+//   uint64    nTriangles (0 for a point cloud)
+//   float32   position[3 * nVertices]
+//   int32     triangle[3 * nTriangles]
+// Triangles are 0-indexed vertex triples. In numpy, write it with
+//   header = np.array([1, 0], '<u4').tobytes() + np.array([len(V), len(F)], '<u8').tobytes()
+//   f.write(b'TUFTMSH\0' + header + V.astype('<f4').tobytes() + F.astype('<i4').tobytes())
+void saveFlatMeshRaw(const std::string& filename, const FlatTriangleMesh& mesh);
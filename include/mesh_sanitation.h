@@ -0,0 +1,49 @@
+#pragma once
+
+#include "mesh_io.h"
+
+#include "geometrycentral/surface/simple_polygon_mesh.h"
+#include "geometrycentral/utilities/utilities.h"
+#include "geometrycentral/utilities/vector3.h"
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+using geometrycentral::INVALID_IND;
+using geometrycentral::surface::SimplePolygonMesh;
+using geometrycentral::Vector3;
+
+// === Mesh sanitation
+//
+// Does the work of SimplePolygonMesh's stripFacesWithDuplicateVertices(), stripUnusedVertices() and triangulate() (in
+// that order, with the same results) in a single parallel pass, writing flat triangle buffers. Faces which repeat a
+// vertex are dropped, polygons are fan-triangulated, and vertices which are not used by any remaining face are dropped;
+// the remaining vertices keep their relative order. Throws std::runtime_error if a face references a vertex which does
+// not exist.
+
+struct SanitizedMesh {
+  FlatTriangleMesh mesh;
+
+  // For each input vertex, its index in `mesh`, or INVALID_IND if it was dropped
+  std::vector<size_t> oldToNew;
+  // For each vertex of `mesh`, the input vertex it came from
+  std::vector<size_t> newToOld;
+
+  size_t nDroppedFaces = 0; // faces which repeated a vertex (or had fewer than 3)
+};
+
+SanitizedMesh sanitizePolygons(const std::vector<Vector3>& vertexPositions,
+                               const std::vector<std::vector<size_t>>& polygons, size_t nThreads = 1);
+
+SanitizedMesh sanitizeTriangles(const std::vector<Vector3>& vertexPositions,
+                                const std::vector<std::array<size_t, 3>>& triangles, size_t nThreads = 1);
+
+// From caller-owned buffers, laid out as for buildTuftedLaplacianFromMesh(). Instantiated for int32_t, uint32_t,
+// int64_t and uint64_t indices.
+template <typename IndexT>
+SanitizedMesh sanitizeFaces(const double* vertexPositions, size_t nVertices, const IndexT* faceIndices, size_t nFaces,
+                            size_t faceDegree = 3, size_t nThreads = 1);
+
+// Copy flat triangles in to the polygon list form geometry-central's mesh constructors take
+SimplePolygonMesh toSimplePolygonMesh(const FlatTriangleMesh& mesh);
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "geometrycentral/numerical/linear_algebra_utilities.h"
+#include "geometrycentral/utilities/vector3.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using geometrycentral::SparseMatrix;
+using geometrycentral::Vector3;
+
+// === Assembling operators from pieces
+//
+// Shared by the tiled point cloud and partitioned mesh builds, which build the operators piece by piece, each piece on
+// a region of the input with some margin around it. Each piece owns a disjoint set of vertices, and contributes:
+//   - the off-diagonal entries of L whose smaller vertex index it owns (so every pair comes from exactly one piece, and
+//     L stays symmetric)
+//   - the masses of the vertices it owns
+// The diagonal of L is set to the negated sum of each column, which keeps constants in its kernel.
+
+// An entry of L (or, with row == col, a mass)
+struct OperatorEntry {
+  uint32_t row, col;
+  double value;
+};
+
+// A spatial split of a set of points in to parts of equal size (up to one point), by recursive median splits along
+// the longest axis. The parts are ranges of `order`. Deterministic, so separate processes agree on the split.
+struct SpatialPart {
+  Vector3 boxMin, boxMax; // the region the part owns
+  size_t start, end;      // its points, as a range of SpatialSplit::order
+};
+struct SpatialSplit {
+  std::vector<uint32_t> order;
+  std::vector<SpatialPart> parts;
+  std::vector<uint32_t> partOf; // for each point
+};
+SpatialSplit splitSpatially(const std::vector<Vector3>& points, size_t nParts);
+
+// Squared distances between points and part boxes (0 if they overlap)
+double pointBoxDistance2(const Vector3& p, const SpatialPart& part);
+double boxBoxDistance2(const SpatialPart& a, const SpatialPart& b);
+
+// Builds L in compressed form from its off-diagonal entries, in two passes over the same entries (in any order):
+// count() each one, allocate(), place() each one again, then finish(). Diagonal entries are added for every column
+// which has any entry.
+class LaplacianAssembler {
+public:
+  explicit LaplacianAssembler(size_t nRows);
+
+  // The first pass
+  void count(const OperatorEntry& entry) { colCounts[entry.col]++; }
+
+  // Lay out the arrays. Throws std::runtime_error if there are too many entries for 32-bit indices.
+  void allocate();
+
+  // The second pass
+  void place(const OperatorEntry& entry) {
+    size_t iEntry = nextEntry[entry.col]++;
+    L.innerIndexPtr()[iEntry] = static_cast<SparseMatrix<double>::StorageIndex>(entry.row);
+    L.valuePtr()[iEntry] = entry.value;
+  }
+
+  // Sort each column and fill in the diagonal. nThreads = 0 uses all hardware threads.
+  SparseMatrix<double> finish(size_t nThreads = 1);
+
+private:
+  size_t nRows;
+  std::vector<size_t> colCounts;
+  std::vector<size_t> nextEntry;
+  SparseMatrix<double> L;
+};
+
+// Entries in an anonymous temporary file (removed when closed), for pieces whose entries do not all fit in memory
+class OperatorEntryFile {
+public:
+  OperatorEntryFile();
+  ~OperatorEntryFile();
+  OperatorEntryFile(const OperatorEntryFile&) = delete;
+  OperatorEntryFile& operator=(const OperatorEntryFile&) = delete;
+
+  void push(const OperatorEntry& entry) {
+    buffer.push_back(entry);
+    if (buffer.size() == bufferEntries) flush();
+  }
+
+  // Visit every entry, in the order they were pushed, in chunks: func(entries, nEntries)
+  template <typename Func>
+  void forEachChunk(Func&& func) {
+    flush();
+    std::rewind(file);
+    std::vector<OperatorEntry> chunk(bufferEntries);
+    size_t nRead;
+    while ((nRead = std::fread(chunk.data(), sizeof(OperatorEntry), chunk.size(), file)) > 0) func(chunk.data(), nRead);
+    checkReadError();
+  }
+
+private:
+  static const size_t bufferEntries = 1 << 16;
+
+  void flush();
+  void checkReadError();
+
+  std::FILE* file;
+  std::vector<OperatorEntry> buffer;
+};
+
+
+// === Operator block files
+//
+// The contribution of one of several pieces, as written by a partitioned build (see partitioned_laplacian.h) and
+// combined by mergeOperatorBlocks(). Layout, in native (little-endian) byte order:
+//   char[8]   magic "TUFTBLK\0"
+//   uint32    version (1)
+//   uint32    reserved (0)
+//   uint64    nRows, of the full matrices
+//   uint64    nPieces, the total number of pieces
+//   uint64    iPiece, the index of this one
+//   uint64    nEntries, off-diagonal entries of L
+//   uint64    nMasses
+//   {uint32 row, uint32 col, float64 value}   entries[nEntries]
+//   {uint32 row, uint32 row, float64 mass}    masses[nMasses]
+
+void saveOperatorBlock(const std::string& filename, size_t nRows, size_t nPieces, size_t iPiece,
+                       const std::vector<OperatorEntry>& entries, const std::vector<OperatorEntry>& masses);
+
+// Combine the blocks of every piece (each exactly once, in any order) in to L and M. Reads each block twice, one chunk
+// at a time, so memory use is only that of the final matrices. Throws std::runtime_error if a block is missing,
+// repeated, unreadable or from a different build.
+void mergeOperatorBlocks(const std::vector<std::string>& filenames, SparseMatrix<double>& L, SparseMatrix<double>& M,
+                         size_t nThreads = 1);
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "mesh_io.h"
+
+#include "geometrycentral/numerical/linear_algebra_utilities.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using geometrycentral::SparseMatrix;
+
+// === On-disk operator cache
+//
+// Caches the final L and M of a mesh, keyed by a content hash of its sanitized vertex and triangle buffers together
+// with every parameter the operators depend on. Entries are files in the format of saveOperatorsMapped() (see
+// matrix_io.h), named by key, so a hit costs one mapping of the file and a copy of the matrices out of it. Entries are
+// written to a temporary file and renamed in to place, so concurrent runs never see a partial entry.
+
+// A 128-bit key, as 32 hex digits. `scale` is any factor the operators were multiplied by (e.g. 1/3 for point clouds),
+// and `faceScales` any per-triangle weights (see IntrinsicTriangles::faceScales). The hash is computed in parallel, and
+// does not depend on the thread count; nThreads = 0 uses all hardware threads.
+std::string operatorCacheKey(const FlatTriangleMesh& mesh, double mollifyFactor, double scale,
+                             const std::vector<double>& faceScales, size_t nThreads = 1);
+
+// Load the entry for `key` from `directory` in to L and M, if there is a valid one. Returns false on a miss (or an
+// unreadable entry), leaving L and M untouched.
+bool loadCachedOperators(const std::string& directory, const std::string& key, size_t nVertices,
+                         SparseMatrix<double>& L, SparseMatrix<double>& M);
+
+// Store L and M as the entry for `key`, creating `directory` if needed. Throws std::runtime_error on failure.
+void saveCachedOperators(const std::string& directory, const std::string& key, const SparseMatrix<double>& L,
+                         const SparseMatrix<double>& M);
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// === Minimal fork-join helpers for embarrassingly parallel loops
+
+// Resolve a user-facing thread count, where 0 means "use all hardware threads"
+inline size_t resolveThreadCount(size_t nThreads) {
+  if (nThreads == 0) {
+    nThreads = std::thread::hardware_concurrency();
+  }
+  return std::max<size_t>(nThreads, 1);
+}
+
+// Process the range [0, n) in blocks of (at most) `blockSize` indices, as func(iThread, iStart, iEnd).
+//
+// Blocks are handed out dynamically, so which thread processes which block is not predictable. For deterministic
+// results callers should only write output to per-index (or per-block, via iStart / blockSize) slots, and use iThread
+// only to select per-thread scratch buffers. iThread is always less than resolveThreadCount(nThreads).
+//
+// With a single thread, the blocks are processed in order on the calling thread. If any invocation throws, remaining
+// blocks are abandoned and the first exception is rethrown on the calling thread.
+template <typename Func>
+void parallelForBlocks(size_t n, size_t nThreads, size_t blockSize, Func&& func) {
+  if (n == 0) return;
+  blockSize = std::max<size_t>(blockSize, 1);
+  size_t nBlocks = (n + blockSize - 1) / blockSize;
+  nThreads = std::min(resolveThreadCount(nThreads), nBlocks);
+
+  if (nThreads == 1) {
+    for (size_t iStart = 0; iStart < n; iStart += blockSize) {
+      func(static_cast<size_t>(0), iStart, std::min(iStart + blockSize, n));
+    }
+    return;
+  }
+
+  std::atomic<size_t> nextBlock(0);
+  std::atomic<bool> abort(false);
+  std::exception_ptr firstError;
+  std::mutex errorMutex;
+
+  auto worker = [&](size_t iThread) {
+    while (!abort) {
+      size_t iBlock = nextBlock++;
+      if (iBlock >= nBlocks) break;
+      size_t iStart = iBlock * blockSize;
+      try {
+        func(iThread, iStart, std::min(iStart + blockSize, n));
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (!firstError) firstError = std::current_exception();
+        abort = true;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t iThread = 1; iThread < nThreads; iThread++) {
+    threads.emplace_back(worker, iThread);
+  }
+  worker(0);
+  for (std::thread& t : threads) t.join();
+
+  if (firstError) std::rethrow_exception(firstError);
+}
+
+// Convenience wrapper, calls func(iThread, i) for each i in [0, n)
+template <typename Func>
+void parallelFor(size_t n, size_t nThreads, Func&& func) {
+  parallelForBlocks(n, nThreads, 256, [&](size_t iThread, size_t iStart, size_t iEnd) {
+    for (size_t i = iStart; i < iEnd; i++) func(iThread, i);
+  });
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "laplacian_builder.h"
+
+#include <cstddef>
+#include <string>
+
+// === Partitioned mesh Laplacians
+//
+// For meshes whose tufted cover is too large to build on one machine. The vertices of the sanitized mesh are split in
+// to nPartitions equal spatial parts (see splitSpatially() in operator_assembly.h), and each partition owns its
+// vertices. A partition is built from the faces within ghostRings rings of its vertices: the faces touching an owned
+// vertex, then the faces touching any vertex of those, and so on. Its tufted cover and intrinsic Delaunay flips are
+// computed on those faces alone, and it writes only the entries it owns to a block file (see operator_assembly.h).
+//
+// Every partition can be built by a separate process, or on a separate machine, from the same input file, since they
+// all compute the same split. mergeOperatorBlocks() (or the tufted-merge tool) then combines the blocks in to L and M.
+// Rows are indexed as they would be by buildTuftedLaplacianFromMesh() with the same options.
+//
+// The intrinsic Delaunay triangulation is determined locally, so the merged operators match the unpartitioned ones
+// except where a Delaunay edge near an owned vertex leaves the ghost layer (raise ghostRings to make this rarer), and for
+// the mollification. Mollification is computed per partition: its length scale is relative to the partition's mean
+// edge length, and the amount every edge grows by depends on the most degenerate triangle of the partition. So when
+// some triangle is within mollifyFactor of degenerate, every entry of L and M can differ slightly from the
+// unpartitioned result, not just those near partition borders.
+
+// Build partition iPartition (of nPartitions) of a mesh given in caller-owned buffers, as for
+// buildTuftedLaplacianFromMesh(), and write its block to blockFilename. Throws std::runtime_error for point clouds
+// (see TuftedLaplacianOptions::tilePoints), for more partitions than vertices, and for invalid input. Instantiated for
+// int32_t, uint32_t, int64_t and uint64_t indices.
+template <typename IndexT>
+void buildTuftedLaplacianPartition(const double* vertexPositions, size_t nVertices, const IndexT* faceIndices,
+                                   size_t nFaces, size_t faceDegree, size_t nPartitions, size_t iPartition,
+                                   size_t ghostRings, const std::string& blockFilename,
+                                   const TuftedLaplacianOptions& options = {});
+
+// The same, from a general polygon mesh
+void buildTuftedLaplacianPartition(const SimplePolygonMesh& inputMesh, size_t nPartitions, size_t iPartition,
+                                   size_t ghostRings, const std::string& blockFilename,
+                                   const TuftedLaplacianOptions& options = {});
@@ -5,6 +5,11 @@
 
 #include "geometrycentral/numerical/linear_algebra_utilities.h"
 
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
 using geometrycentral::SparseMatrix;
 using geometrycentral::Vector;
 using geometrycentral::Vector2;
@@ -12,22 +17,34 @@ using geometrycentral::Vector3;
 
 
 // === Basic utility methods
+//
+// All of these process each point independently, and accept an `nThreads` argument to spread that work over several
+// threads (0 means all hardware threads). The output does not depend on the number of threads. The triangulation
+// functions report the total Voronoi area of the cloud to `log`, if it is non-null.
 
 using Neighbors_t = std::vector<std::vector<size_t>>;
 
 // Generate the k-nearest-neighbors for the points.
 // The list will always have this center point as the first entry in the neighbor list (which will thus have k+1
 // elements)
-Neighbors_t generate_knn(const std::vector<Vector3>& points, size_t k);
+Neighbors_t generate_knn(const std::vector<Vector3>& points, size_t k, size_t nThreads = 1);
+
+// How to estimate normals from a neighborhood. Both give the same normals (up to sign and roundoff), though the
+// covariance approach is much faster.
+enum class NormalEstimator {
+  SVD,       // smallest singular vector of the 3 x k matrix of offsets to neighbors
+  Covariance // smallest eigenvector of the 3 x 3 scatter matrix of the same offsets, in closed form
+};
 
 // Estimate normals from a neighborhood (arbitrarily oriented)
-std::vector<Vector3> generate_normals(const std::vector<Vector3>& points, const Neighbors_t& neigh);
+std::vector<Vector3> generate_normals(const std::vector<Vector3>& points, const Neighbors_t& neigh,
+                                      size_t nThreads = 1, NormalEstimator estimator = NormalEstimator::SVD);
 
 // Project a neighborhood to 2D tangent plane
 // The output is in correspondence with `neigh`, with the center point implicitly at (0,0)
 std::vector<std::vector<Vector2>> generate_coords_projection(const std::vector<Vector3>& points,
-                                                             const std::vector<Vector3> normals,
-                                                             const Neighbors_t& neigh);
+                                                             const std::vector<Vector3>& normals,
+                                                             const Neighbors_t& neigh, size_t nThreads = 1);
 
 
 struct LocalTriangulationResult {
@@ -42,6 +59,97 @@ struct LocalTriangulationResult {
   std::vector<std::vector<std::array<size_t, 3>>> allTriangles; // all triangles from the local triangulation
 };
 
+// How to build the local Delaunay triangulations
+enum class LocalTriangulator {
+  Voronoi, // the full Voronoi diagram of each neighborhood, via jc_voronoi
+  Star // only the center point's cell, by clipping its bisectors; much cheaper. Used only for neighborhoods of at most
+       // 64 points when generateAllTris is false, otherwise this falls back on Voronoi.
+};
+
 LocalTriangulationResult build_delaunay_triangulations(const std::vector<std::vector<Vector2>>& coords,
-                                                       const Neighbors_t& neigh, bool generateAllTris = false);
+                                                       const Neighbors_t& neigh, bool generateAllTris = false,
+                                                       size_t nThreads = 1,
+                                                       LocalTriangulator method = LocalTriangulator::Voronoi,
+                                                       std::ostream* log = nullptr);
+
+// Differences between two local triangulations of the same neighborhoods, used to validate one triangulator against
+// another. Triangles are compared per point, ignoring their order.
+//
+// Note that the Voronoi path reports every triangle of mutually-adjacent center neighbors, which includes a few
+// triangles enclosing another neighbor near the edge of the neighborhood. Star only reports faces of the local Delaunay
+// triangulation, so when checked against Voronoi it should have no extra (but possibly some missing) triangles, up to
+// the choice of diagonal among cocircular points.
+struct LocalTriangulationComparison {
+  size_t nPointsDiffering = 0;
+  size_t nMissingTriangles = 0; // in the reference, but not the candidate
+  size_t nExtraTriangles = 0;   // in the candidate, but not the reference
+  double maxRelativeAreaDiff = 0.;
+};
+LocalTriangulationComparison compare_local_triangulations(const LocalTriangulationResult& reference,
+                                                          const LocalTriangulationResult& candidate);
+
+
+// === Compact neighbor storage
+// Same contents as Neighbors_t (center point first), but with the same number of entries for every point, stored
+// contiguously with 32-bit indices. The table holds no allocation per point, and uses about half the memory. (Building
+// it still allocates per point: geometry-central's NearestNeighborFinder returns each query as a new std::vector.)
+
+struct NeighborTable {
+  size_t stride = 0;             // entries per point, including the center
+  std::vector<uint32_t> indices; // stride entries for each point, concatenated
+
+  size_t size() const { return stride == 0 ? 0 : indices.size() / stride; }
+  const uint32_t* operator[](size_t iPt) const { return &indices[iPt * stride]; }
+};
+
+// Like generate_knn(). If there are not more than k points, every point uses all the others as neighbors.
+NeighborTable generate_knn_table(const std::vector<Vector3>& points, size_t k, size_t nThreads = 1);
+
+// (with NormalEstimator::Covariance, this processes points in small batches which vectorize well)
+std::vector<Vector3> generate_normals(const std::vector<Vector3>& points, const NeighborTable& neigh,
+                                      size_t nThreads = 1, NormalEstimator estimator = NormalEstimator::SVD);
+
+// The coordinates are laid out like `neigh.indices`, with `neigh.stride` entries for each point
+std::vector<Vector2> generate_coords_projection(const std::vector<Vector3>& points,
+                                                const std::vector<Vector3>& normals, const NeighborTable& neigh,
+                                                size_t nThreads = 1);
+
+LocalTriangulationResult build_delaunay_triangulations(const std::vector<Vector2>& coords, const NeighborTable& neigh,
+                                                       bool generateAllTris = false, size_t nThreads = 1,
+                                                       LocalTriangulator method = LocalTriangulator::Voronoi,
+                                                       std::ostream* log = nullptr);
+
+
+// === Fused pipeline
+
+struct PointCloudTriangulation {
+  std::vector<double> voronoiAreas; // the area of the voronoi cell at each point
+
+  // the triangles touching each center point, in global point indices, with the center vertex first. Ordered by
+  // center point, and then as in LocalTriangulationResult::pointTriangles.
+  std::vector<std::array<size_t, 3>> triangles;
+};
+
+// Equivalent to generate_knn() --> generate_normals() --> generate_coords_projection() -->
+// build_delaunay_triangulations(), keeping the triangles touching each center. Rather than materializing each
+// intermediate step for all points, this processes one point at a time through all the steps, in small reused
+// buffers. The results are identical to the reference functions above.
+PointCloudTriangulation build_point_cloud_triangulation(const std::vector<Vector3>& points, size_t k,
+                                                        size_t nThreads = 1,
+                                                        NormalEstimator estimator = NormalEstimator::SVD,
+                                                        LocalTriangulator method = LocalTriangulator::Voronoi,
+                                                        std::ostream* log = nullptr);
+
+
+// === Face union
+
+// Neighboring points usually find the same triangle, so the union of all local triangulations contains each triangle
+// up to three times.
+struct DeduplicatedTriangles {
+  std::vector<std::array<size_t, 3>> triangles; // each distinct triangle once, as first seen, in order of appearance
+  std::vector<uint8_t> multiplicity;            // how many times each triangle was seen (saturating at 255)
+};
 
+// Merge identical triangles (in any orientation or rotation), using a flat open-addressing hash table keyed on the
+// sorted vertex triple.
+DeduplicatedTriangles deduplicate_triangles(const std::vector<std::array<size_t, 3>>& triangles);
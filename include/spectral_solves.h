@@ -0,0 +1,51 @@
+#pragma once
+
+#include "geometrycentral/numerical/linear_algebra_utilities.h"
+#include "geometrycentral/utilities/vector3.h"
+
+#include <Eigen/SparseCholesky>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using geometrycentral::SparseMatrix;
+
+// === Solves with the operators
+//
+// The standard things to do with L and M right after building them, without writing them out first. Both factor a
+// shift L + s M once, with a sparse Cholesky (LDL^T) factorization, and reuse it for every solve. M is always the
+// diagonal lumped mass matrix, so it is only ever used as a vector of vertex areas. Rows and columns which are empty in
+// both L and M (unused vertices, see TuftedLaplacianOptions::preserveVertexIndices) are decoupled from the rest, and
+// get zeros in every result.
+
+// The K smallest generalized eigenpairs L phi = lambda M phi, by subspace iteration with Rayleigh-Ritz on a slightly
+// shifted inverse of L. Eigenvalues are in increasing order, and the eigenvectors are the columns of `eigenvectors`,
+// orthonormal with respect to M. Iterates until the relative residual of every pair is below `tolerance`; returns
+// false if that takes more than `maxIterations` (the results are then the best estimates found). nThreads = 0 uses all
+// hardware threads.
+bool smallestEigenpairs(const SparseMatrix<double>& L, const SparseMatrix<double>& M, size_t K,
+                        Eigen::VectorXd& eigenvalues, Eigen::MatrixXd& eigenvectors, size_t nThreads = 1,
+                        double tolerance = 1e-8, size_t maxIterations = 1000);
+
+// Backward Euler steps of the heat equation du/dt = -M^{-1} L u, each solving (M + t L) u = M u0. The factorization is
+// done once, at construction.
+class HeatSolver {
+public:
+  // Throws std::runtime_error if the factorization fails
+  HeatSolver(const SparseMatrix<double>& L, const SparseMatrix<double>& M, double t);
+  HeatSolver(const HeatSolver&) = delete;
+  HeatSolver& operator=(const HeatSolver&) = delete;
+
+  // Diffuse u0 (one value per row) for time t
+  Eigen::VectorXd diffuse(const Eigen::VectorXd& u0) const;
+
+private:
+  Eigen::VectorXd massDiagonal;
+  Eigen::SimplicialLDLT<SparseMatrix<double>> solver;
+};
+
+// The mean length of the edges of a triangle mesh, given as 0-indexed vertex triples (over the sides of each triangle,
+// so interior edges count twice). Its square is the usual time step for the heat method.
+double meanEdgeLength(const std::vector<geometrycentral::Vector3>& vertexPositions,
+                      const std::vector<uint32_t>& triangles);
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "laplacian_builder.h"
+
+#include <cstddef>
+#include <iosfwd>
+#include <vector>
+
+// === Tiled point cloud Laplacians
+//
+// For clouds too large to hold all the neighborhoods, normals, tangent coordinates, local triangles and the tufted
+// cover at once. The cloud is split in to equal spatial tiles of (about) TuftedLaplacianOptions::tilePoints points (see
+// splitSpatially() in operator_assembly.h), and each tile is processed on its own, together with a halo of the points
+// around it: the halo extends tileHaloRadii times the largest kNN radius in the tile past its box. Each tile's
+// Laplacian is built exactly as for a whole cloud, and the entries which the tile owns (see operator_assembly.h) are
+// streamed to a temporary file. The tiles are then merged in to one matrix, in two passes over the file.
+//
+// Away from tile boundaries the result matches the untiled Laplacian, unless intrinsic mollification changes any edge
+// lengths. Within a few neighborhoods of a boundary, the local triangulations are still identical as long as the halo
+// covers every neighborhood reaching in to the tile, but the tufted cover and its Delaunay flips only see the halo, so
+// entries there can differ slightly (raise tileHaloRadii to make this rarer). Mollification is computed per tile: its
+// length scale is relative to the tile's mean edge length, and the amount every edge grows by depends on the most
+// degenerate triangle of the tile. So when some triangle is within mollifyFactor of degenerate, every entry of L and M
+// can differ slightly from the untiled result, not just those near boundaries. Memory is bounded by the tile size,
+// plus a few scalars per point and the output matrices.
+
+// Build L and M of a point cloud, tile by tile, filling in the result as buildTuftedLaplacianFromPoints() would, except
+// that only the vertices are kept (`triangles` is empty, since the triangles are never all in memory at once) and
+// there is no halfedge mesh. Throws std::runtime_error for options which need the whole triangulation.
+void buildTiledPointCloudLaplacian(const std::vector<Vector3>& points, const TuftedLaplacianOptions& options,
+                                   std::ostream& log, TuftedLaplacianResult& result);
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "mesh_io.h"
+
+#include "geometrycentral/surface/surface_mesh.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+using geometrycentral::surface::EdgeData;
+using geometrycentral::surface::SurfaceMesh;
+
+// === Flat tufted cover construction
+//
+// Builds the combinatorial tufted cover of a triangle mesh from flat arrays, as an alternative to geometry-central's
+// buildIntrinsicTuftedCover(), which walks and edits a halfedge mesh in place. The cover has two copies of every
+// triangle, one of each orientation, and around each edge the copies are glued to their neighbors in the order the
+// faces appear around the edge (so a manifold edge joins the front of one face to the other, and a boundary edge joins
+// the two sides of its face).
+//
+// The faces around each edge are found by a parallel radix sort of the halfedges by their (sorted) endpoints, and
+// kept in compressed (CSR) arrays, so heavily nonmanifold edges cost no more than others per incident face. The faces
+// around each edge are then sorted by angle, in parallel. For generic positions (no two faces around an edge at
+// exactly the same angle) the connectivity is the same as buildIntrinsicTuftedCover()'s, up to element order.
+
+// Which implementation builds the tufted cover (see TuftedLaplacianOptions)
+enum class CoverBuilder {
+  GeometryCentral, // buildIntrinsicTuftedCover(), as part of geometry-central's buildTuftedLaplacian()
+  Flat,            // buildFlatTuftedCover() below
+};
+
+// The edges of a triangle mesh. Halfedge 3 iF + j runs from corner j to corner (j + 1) % 3 of triangle iF.
+struct EdgeIncidence {
+  std::vector<uint32_t> edgeVertices; // the endpoints of each edge, lower index first, in pairs; edges are in order
+  std::vector<size_t> edgeStart;      // the halfedges of edge iE are edgeHalfedges[edgeStart[iE]..edgeStart[iE + 1])
+  std::vector<size_t> edgeHalfedges;  // in increasing order, for each edge
+  std::vector<size_t> halfedgeEdge;   // for each halfedge, its edge
+
+  size_t nEdges() const { return edgeStart.empty() ? 0 : edgeStart.size() - 1; }
+};
+
+EdgeIncidence buildEdgeIncidence(const FlatTriangleMesh& mesh, size_t nThreads = 1);
+
+// The length of each edge. If mollifyFactor > 0 they are then mollified, as by geometry-central's mollifyIntrinsic()
+// on the input mesh (every length grows by the same amount, the least which leaves every triangle at least
+// mollifyFactor times the mean edge length from degenerate).
+std::vector<double> buildEdgeLengths(const FlatTriangleMesh& mesh, const EdgeIncidence& edges, double mollifyFactor,
+                                     size_t nThreads = 1);
+
+// The tufted cover, as flat arrays. Cover triangle 2 iF is input triangle iF, and 2 iF + 1 is the same triangle with
+// its orientation reversed, as (v0, v2, v1). Halfedges are numbered as in EdgeIncidence.
+struct FlatTuftedCover {
+  std::vector<uint32_t> triangles; // 3 per cover triangle
+  std::vector<size_t> twins;       // for each halfedge, the one it is glued to
+};
+
+FlatTuftedCover buildFlatTuftedCover(const FlatTriangleMesh& mesh, const EdgeIncidence& edges, size_t nThreads = 1);
+
+// The input halfedge a cover halfedge is a copy of
+inline size_t coverHalfedgeToInput(size_t iCoverHalfedge) {
+  size_t iCoverFace = iCoverHalfedge / 3, k = iCoverHalfedge % 3;
+  return 3 * (iCoverFace / 2) + (iCoverFace % 2 == 0 ? k : 2 - k);
+}
+
+// The cover as a geometry-central mesh, with the same vertices as the input. Also returns, for each of its edges, the
+// edge of `edges` it covers.
+std::unique_ptr<SurfaceMesh> makeTuftedCoverMesh(const FlatTuftedCover& cover, const EdgeIncidence& edges,
+                                                 std::vector<size_t>& coverEdgeToInput, size_t nThreads = 1);
+
+// For each face of a tufted cover built by buildIntrinsicTuftedCover() (which duplicates faces, keeping the vertices),
+// the value of `inputFaceValues` at the face of `inputMesh` with the same vertices. Where several input faces have the
+// same vertices, any one of them is used. Both meshes must be compressed triangle meshes.
+std::vector<double> coverFaceValues(SurfaceMesh& inputMesh, SurfaceMesh& coverMesh,
+                                    const std::vector<double>& inputFaceValues);
+
+// === Delaunay flips with face weights
+//
+// With TuftedLaplacianOptions::dedupTriangles, each face of the cover carries a weight (see
+// IntrinsicTriangles::faceScales), which stays with the face index through flips. Flipping an edge between two faces
+// of different weights would hand part of each face's area to the other weight, and change the weighted total area
+// (the mass). So those edges are never flipped: the result is only intrinsic Delaunay within each region of equal
+// weight, but every weight stays on exactly the area it was given for.
+
+// Flip `mesh` to intrinsic Delaunay as geometry-central's flipToDelaunay() does (the same test and tolerance), except
+// across edges whose two faces have different entries in `faceScales` (indexed by face). Returns the number of flips.
+// With empty faceScales, this is just flipToDelaunay().
+size_t flipToDelaunayWithinScales(SurfaceMesh& mesh, EdgeData<double>& edgeLengths,
+                                  const std::vector<double>& faceScales, double delaunayEPS = 1e-6);
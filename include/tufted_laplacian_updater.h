@@ -0,0 +1,81 @@
+#pragma once
+
+#include "laplacian_builder.h"
+
+#include "geometrycentral/surface/surface_mesh.h"
+#include "geometrycentral/utilities/vector3.h"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// === Incremental tufted Laplacians
+//
+// For deformations and animations, where the connectivity stays fixed and only vertex positions change. The tufted
+// cover is built once, from the initial positions; each update then only recomputes edge lengths, mollification,
+// intrinsic Delaunay flips and the matrix values, writing them in to the existing storage of L and M. Where each term
+// of the matrices goes is looked up once per triangulation, and reused for as long as the flips give the same one.
+//
+// The result matches buildTuftedLaplacian() on the new positions (up to roundoff), with one caveat: the gluing of the
+// cover around nonmanifold edges is chosen from the angles between the faces at construction, and kept. If a
+// deformation is large enough to reorder the faces around a nonmanifold edge, construct a new updater. Point clouds
+// likewise keep the triangles of their initial triangulation.
+
+class TuftedLaplacianUpdater {
+public:
+  // Takes the connectivity, initial positions and vertex indexing of `result` (rebuilding its halfedge mesh from
+  // its triangles if it was not kept), and the options it was built with. L() and M() start out equal to result.L and
+  // result.M (up to roundoff).
+  TuftedLaplacianUpdater(const TuftedLaplacianResult& result, const TuftedLaplacianOptions& options = {});
+
+  // Recompute L and M for new positions, given as an array of xyz triples indexed like the original input vertices
+  // (so the same buffer that was passed to buildTuftedLaplacianFromMesh() can be updated and passed again). Returns
+  // true if the values were written in place. If the Delaunay flips connected a pair of vertices which was not
+  // connected before, the sparsity pattern has to grow, and the matrices are reallocated (returning false). Entries
+  // for pairs which are no longer connected are kept, as explicit zeros.
+  bool update(const double* inputVertexPositions);
+
+  const SparseMatrix<double>& L() const { return laplacian; }
+  const SparseMatrix<double>& M() const { return mass; }
+
+private:
+  // Rebuild the matrices from `positions`. If `inPlace`, tries to write the values in to the existing pattern first;
+  // returns true if that worked.
+  bool recompute(bool inPlace);
+
+  // Find the slots of the terms of flippedMesh in L and M. Returns false (and leaves no slots) if some term has no
+  // entry.
+  bool findSlots();
+
+  typedef SparseMatrix<double>::StorageIndex StorageIndex;
+
+  std::unique_ptr<SurfaceMesh> inputMesh; // connectivity of the sanitized mesh
+  std::unique_ptr<SurfaceMesh> coverMesh; // the tufted cover, before any flips
+  std::vector<size_t> inputEdgeVertices;  // endpoints of each edge of inputMesh, in pairs
+  std::vector<size_t> coverEdgeToInput;   // for each edge of coverMesh, the edge of inputMesh it covers
+  std::vector<double> coverFaceScales;    // for each face of coverMesh, if the result had faceScales (kept by flips)
+
+  // The cover flipped to Delaunay at the last update, reused by the next if it needed no flips
+  std::unique_ptr<SurfaceMesh> flippedMesh;
+  EdgeData<double> flippedEdgeLengths;
+  bool flippedMeshHasFlips = false;
+
+  // The value indices in L and M of the terms of each face of the triangulation with these face vertices (3 per face,
+  // in halfedge order), as visited by recompute(): for each halfedge from rA to rB, (rA, rA), (rB, rB), (rA, rB) and
+  // (rB, rA) in L, and (rA, rA) in M
+  std::vector<size_t> slotFaceVertices;
+  std::vector<StorageIndex> laplacianSlots; // 12 per face
+  std::vector<StorageIndex> massSlots;      // 3 per face
+
+  std::vector<size_t> vertexIndices; // for each vertex, the input vertex its position comes from
+  std::vector<size_t> rowIndices;    // for each vertex, its row in L and M
+  size_t nRows;
+  double mollifyFactor;
+  double scale; // of the matrices (1/3 for point clouds, where each triangle appears once per vertex)
+  size_t nThreads;
+
+  std::vector<Vector3> positions; // of each vertex
+
+  SparseMatrix<double> laplacian;
+  SparseMatrix<double> mass;
+};
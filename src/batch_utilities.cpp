@@ -0,0 +1,151 @@
+#include "batch_utilities.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+const char pathSeparators[] = "/\\";
+
+bool isDirectory(const std::string& path) {
+#ifdef _WIN32
+  DWORD attribs = GetFileAttributesA(path.c_str());
+  return attribs != INVALID_FILE_ATTRIBUTES && (attribs & FILE_ATTRIBUTE_DIRECTORY);
+#else
+  struct stat pathStat;
+  return stat(path.c_str(), &pathStat) == 0 && S_ISDIR(pathStat.st_mode);
+#endif
+}
+
+size_t fileBytes(const std::string& path) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) return 0;
+  return static_cast<size_t>(file.tellg());
+}
+
+bool isAbsolutePath(const std::string& path) {
+  if (path.empty()) return false;
+  if (path[0] == '/' || path[0] == '\\') return true;
+  return path.size() > 1 && path[1] == ':'; // windows drive letter
+}
+
+std::string parentDirectory(const std::string& path) {
+  size_t iSep = path.find_last_of(pathSeparators);
+  if (iSep == std::string::npos) return "";
+  return path.substr(0, iSep + 1);
+}
+
+std::string joinPath(const std::string& dir, const std::string& name) {
+  if (dir.empty() || isAbsolutePath(name)) return name;
+  char last = dir[dir.size() - 1];
+  if (last == '/' || last == '\\') return dir + name;
+  return dir + "/" + name;
+}
+
+// "path/to/bunny.obj" --> "bunny"
+std::string fileStem(const std::string& path) {
+  size_t iSep = path.find_last_of(pathSeparators);
+  std::string name = (iSep == std::string::npos) ? path : path.substr(iSep + 1);
+  size_t iDot = name.find_last_of('.');
+  if (iDot != std::string::npos && iDot > 0) name = name.substr(0, iDot);
+  return name;
+}
+
+// The file types geometry-central (or the fast loader in mesh_io.h) can load
+bool hasMeshExtension(const std::string& path) {
+  size_t iDot = path.find_last_of('.');
+  if (iDot == std::string::npos) return false;
+  std::string ext = path.substr(iDot + 1);
+  std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+  return ext == "obj" || ext == "ply" || ext == "off" || ext == "stl" || ext == "tmesh";
+}
+
+std::vector<std::string> listDirectory(const std::string& dir) {
+  std::vector<std::string> names;
+#ifdef _WIN32
+  WIN32_FIND_DATAA findData;
+  HANDLE handle = FindFirstFileA(joinPath(dir, "*").c_str(), &findData);
+  if (handle == INVALID_HANDLE_VALUE) {
+    throw std::runtime_error("failed to list directory " + dir);
+  }
+  do {
+    if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) names.push_back(findData.cFileName);
+  } while (FindNextFileA(handle, &findData));
+  FindClose(handle);
+#else
+  DIR* dirHandle = opendir(dir.c_str());
+  if (!dirHandle) {
+    throw std::runtime_error("failed to list directory " + dir);
+  }
+  while (dirent* entry = readdir(dirHandle)) {
+    std::string name = entry->d_name;
+    if (name == "." || name == ".." || isDirectory(joinPath(dir, name))) continue;
+    names.push_back(name);
+  }
+  closedir(dirHandle);
+#endif
+  std::sort(names.begin(), names.end()); // (directory order is arbitrary)
+  return names;
+}
+
+std::vector<std::string> readManifest(const std::string& manifest) {
+  std::ifstream inFile(manifest);
+  if (!inFile) {
+    throw std::runtime_error("failed to open batch manifest " + manifest);
+  }
+
+  std::string baseDir = parentDirectory(manifest);
+  std::vector<std::string> paths;
+  std::string line;
+  while (std::getline(inFile, line)) {
+    // trim whitespace (including any '\r' from windows line endings)
+    size_t iStart = line.find_first_not_of(" \t\r\n");
+    if (iStart == std::string::npos) continue;
+    size_t iEnd = line.find_last_not_of(" \t\r\n");
+    line = line.substr(iStart, iEnd - iStart + 1);
+    if (line[0] == '#') continue;
+    paths.push_back(joinPath(baseDir, line));
+  }
+  return paths;
+}
+
+} // namespace
+
+
+std::vector<BatchInput> listBatchInputs(const std::string& path, const std::string& outputPrefix) {
+
+  std::vector<std::string> filenames;
+  if (isDirectory(path)) {
+    for (const std::string& name : listDirectory(path)) {
+      if (hasMeshExtension(name)) filenames.push_back(joinPath(path, name));
+    }
+  } else {
+    filenames = readManifest(path);
+  }
+
+  std::vector<BatchInput> inputs;
+  std::set<std::string> usedNames; // (a suffixed stem can also be the stem of another file, e.g. "bunny_2")
+  for (const std::string& filename : filenames) {
+    std::string stem = fileStem(filename);
+    std::string name = stem;
+    for (size_t count = 2; usedNames.count(name); count++) name = stem + "_" + std::to_string(count);
+    usedNames.insert(name);
+
+    BatchInput input;
+    input.filename = filename;
+    input.outputPrefix = outputPrefix + name + "_";
+    input.fileBytes = fileBytes(filename);
+    inputs.push_back(input);
+  }
+  return inputs;
+}
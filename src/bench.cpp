@@ -0,0 +1,456 @@
+// Benchmark driver: runs each stage of the tufted-idt pipeline separately over a set of inputs, and reports wall time,
+// peak RSS and heap allocations per stage as JSON.
+
+#include "cotan_assembly.h"
+#include "manifold_precheck.h"
+#include "matrix_io.h"
+#include "mesh_io.h"
+#include "mesh_sanitation.h"
+#include "point_cloud_utilities.h"
+#include "tufted_cover.h"
+
+#include "geometrycentral/surface/edge_length_geometry.h"
+#include "geometrycentral/surface/halfedge_factories.h"
+#include "geometrycentral/surface/intrinsic_mollification.h"
+#include "geometrycentral/surface/simple_polygon_mesh.h"
+#include "geometrycentral/surface/surface_mesh.h"
+#include "geometrycentral/surface/tufted_laplacian.h"
+#include "geometrycentral/surface/vertex_position_geometry.h"
+
+#include "args/args.hxx"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+using namespace geometrycentral;
+using namespace geometrycentral::surface;
+
+
+// === Allocation counting
+//
+// Replaces the global operator new, so this only sees C++ heap allocations (Eigen, for instance, allocates with
+// malloc directly).
+
+namespace {
+std::atomic<size_t> allocationCount(0);
+std::atomic<size_t> allocationBytes(0);
+
+void* countedAlloc(size_t size) {
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  allocationBytes.fetch_add(size, std::memory_order_relaxed);
+  void* p = std::malloc(size == 0 ? 1 : size);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+} // namespace
+
+void* operator new(size_t size) { return countedAlloc(size); }
+void* operator new[](size_t size) { return countedAlloc(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return countedAlloc(size);
+  } catch (...) {
+    return nullptr;
+  }
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return countedAlloc(size);
+  } catch (...) {
+    return nullptr;
+  }
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+
+namespace {
+
+// === Memory usage
+
+// Try to reset the peak RSS counter, so the next stage's peak can be measured on its own. Only supported on Linux; it
+// is harmless if it fails, the reported peak is then the peak of the whole run so far.
+void resetPeakRSS() {
+#if defined(__linux__)
+  std::ofstream clearRefs("/proc/self/clear_refs");
+  if (clearRefs) clearRefs << "5";
+#endif
+}
+
+// Peak resident set size in bytes (since the last successful reset), or 0 if unknown
+size_t peakRSSBytes() {
+#if defined(__linux__)
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+    }
+  }
+#endif
+#if defined(__linux__) || defined(__APPLE__)
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+    return usage.ru_maxrss; // bytes
+#else
+    return usage.ru_maxrss * 1024; // kilobytes
+#endif
+  }
+#endif
+  return 0;
+}
+
+
+// === Stages
+
+struct StageResult {
+  std::string name;
+  std::vector<double> wallSeconds; // one per repetition
+  size_t peakRSS = 0;              // max over repetitions
+  size_t allocations = 0;          // from the last repetition
+  size_t allocatedBytes = 0;
+};
+
+// Run (and measure) one stage, appending or merging in to `stages` in order
+template <typename Func>
+void runStage(std::vector<StageResult>& stages, size_t& iStage, const std::string& name, Func&& func) {
+  // (a stage is only recorded once it completes)
+  bool isNewStage = iStage == stages.size();
+  StageResult newStage;
+  newStage.name = name;
+  StageResult& stage = isNewStage ? newStage : stages[iStage];
+
+  resetPeakRSS();
+  size_t allocCountBefore = allocationCount.load();
+  size_t allocBytesBefore = allocationBytes.load();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  func();
+
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  stage.wallSeconds.push_back(std::chrono::duration<double>(end - start).count());
+  stage.allocations = allocationCount.load() - allocCountBefore;
+  stage.allocatedBytes = allocationBytes.load() - allocBytesBefore;
+  stage.peakRSS = std::max(stage.peakRSS, peakRSSBytes());
+
+  if (isNewStage) stages.push_back(newStage);
+  iStage++;
+}
+
+struct BenchOptions {
+  double mollifyFactor = 1e-6;
+  size_t nNeigh = 30;
+  size_t nThreads = 1;
+  size_t nRepeat = 1;
+  MatrixFormat matrixFormat = MatrixFormat::SPMAT;
+  std::string scratchPrefix = "tufted_bench_";
+};
+
+struct InputResult {
+  std::string filename;
+  bool isPointCloud = false;
+  size_t nVertices = 0;
+  size_t nFaces = 0; // after sanitizing (and, for point clouds, triangulating)
+  bool coverIsTrivial = false; // per the manifold precheck, so the pipeline would skip the tufted cover
+  std::vector<StageResult> stages;
+  std::string error;
+};
+
+// One full run of the pipeline, mirroring main.cpp
+void runPipeline(const std::string& filename, const BenchOptions& opts, InputResult& result) {
+  size_t iStage = 0;
+  std::vector<StageResult>& stages = result.stages;
+
+  std::unique_ptr<SimplePolygonMesh> inputMesh;
+  runStage(stages, iStage, "load", [&]() { inputMesh.reset(new SimplePolygonMesh(filename)); });
+  runStage(stages, iStage, "load_fast", [&]() {
+    // (only timed, the rest of the pipeline uses the general loader above; does nothing for unsupported formats)
+    FlatTriangleMesh flatMesh;
+    loadFlatMesh(filename, flatMesh, opts.nThreads);
+  });
+
+  result.isPointCloud = inputMesh->polygons.empty();
+  if (result.isPointCloud) {
+    const std::vector<Vector3>& points = inputMesh->vertexCoordinates;
+    NeighborTable neigh;
+    std::vector<Vector3> normals;
+    std::vector<Vector2> coords;
+    LocalTriangulationResult localTri;
+
+    runStage(stages, iStage, "point_cloud_knn",
+             [&]() { neigh = generate_knn_table(points, opts.nNeigh, opts.nThreads); });
+    runStage(stages, iStage, "point_cloud_normals",
+             [&]() { normals = generate_normals(points, neigh, opts.nThreads); });
+    runStage(stages, iStage, "point_cloud_projection",
+             [&]() { coords = generate_coords_projection(points, normals, neigh, opts.nThreads); });
+    runStage(stages, iStage, "point_cloud_delaunay",
+             [&]() { localTri = build_delaunay_triangulations(coords, neigh, false, opts.nThreads); });
+    runStage(stages, iStage, "point_cloud_union", [&]() {
+      for (size_t iPt = 0; iPt < points.size(); iPt++) {
+        const uint32_t* thisNeigh = neigh[iPt];
+        for (const std::array<size_t, 3>& tri : localTri.pointTriangles[iPt]) {
+          inputMesh->polygons.push_back({thisNeigh[tri[0]], thisNeigh[tri[1]], thisNeigh[tri[2]]});
+        }
+      }
+    });
+  }
+
+  FlatTriangleMesh flatMesh; // (for the flat cover stage)
+  runStage(stages, iStage, "sanitize", [&]() {
+    SanitizedMesh sanitized = sanitizePolygons(inputMesh->vertexCoordinates, inputMesh->polygons, opts.nThreads);
+    *inputMesh = toSimplePolygonMesh(sanitized.mesh);
+    flatMesh = std::move(sanitized.mesh);
+  });
+  result.nVertices = inputMesh->vertexCoordinates.size();
+  result.nFaces = inputMesh->polygons.size();
+
+  runStage(stages, iStage, "manifold_precheck", [&]() {
+    EdgeIncidence edges = buildEdgeIncidence(flatMesh, opts.nThreads);
+    std::vector<double> edgeLengths = buildEdgeLengths(flatMesh, edges, opts.mollifyFactor, opts.nThreads);
+    result.coverIsTrivial = precheckTuftedCover(flatMesh, edges, edgeLengths, opts.nThreads).coverIsTrivial();
+  });
+
+  std::unique_ptr<SurfaceMesh> mesh;
+  std::unique_ptr<VertexPositionGeometry> geometry;
+  runStage(stages, iStage, "make_halfedge_mesh", [&]() {
+    std::tie(mesh, geometry) = makeGeneralHalfedgeAndGeometry(inputMesh->polygons, inputMesh->vertexCoordinates);
+  });
+
+  // The cover alone, with each builder: both stages go from mollified edge lengths to the cover as a SurfaceMesh, with
+  // its edge lengths (ready to flip). The copy of the halfedge mesh (which the geometry-central builder edits in place)
+  // and the edge lengths are set up outside the stages. The tufted_laplacian stage below builds the cover again, with
+  // geometry-central's builder.
+  {
+    std::unique_ptr<SurfaceMesh> coverMesh = mesh->copyToSurfaceMesh();
+    std::unique_ptr<VertexPositionGeometry> coverGeom = geometry->reinterpretTo(*coverMesh);
+    coverGeom->requireEdgeLengths();
+    EdgeData<double> edgeLengths = coverGeom->edgeLengths;
+    if (opts.mollifyFactor > 0) {
+      mollifyIntrinsic(*coverMesh, edgeLengths, opts.mollifyFactor);
+    }
+    runStage(stages, iStage, "tufted_cover",
+             [&]() { buildIntrinsicTuftedCover(*coverMesh, edgeLengths, coverGeom.get()); });
+  }
+  {
+    EdgeIncidence edges = buildEdgeIncidence(flatMesh, opts.nThreads);
+    std::vector<double> edgeLengths = buildEdgeLengths(flatMesh, edges, opts.mollifyFactor, opts.nThreads);
+    runStage(stages, iStage, "tufted_cover_flat", [&]() {
+      FlatTuftedCover cover = buildFlatTuftedCover(flatMesh, edges, opts.nThreads);
+      std::vector<size_t> coverEdgeToInput;
+      std::unique_ptr<SurfaceMesh> coverMesh = makeTuftedCoverMesh(cover, edges, coverEdgeToInput, opts.nThreads);
+      EdgeData<double> coverEdgeLengths(*coverMesh);
+      for (size_t iE = 0; iE < coverEdgeToInput.size(); iE++) coverEdgeLengths[iE] = edgeLengths[coverEdgeToInput[iE]];
+    });
+  }
+
+  // Cotan assembly alone (on the input mesh, rather than the flipped cover), through geometry-central and fused
+  runStage(stages, iStage, "cotan_operators", [&]() {
+    geometry->requireEdgeLengths();
+    EdgeLengthGeometry intrinsicGeom(*mesh, geometry->edgeLengths);
+    intrinsicGeom.requireCotanLaplacian();
+    intrinsicGeom.requireVertexLumpedMassMatrix();
+  });
+  runStage(stages, iStage, "cotan_operators_fused", [&]() {
+    SparseMatrix<double> cotanL, cotanM;
+    buildCotanOperators(intrinsicTrianglesFromPositions(flatMesh, opts.nThreads), 1., cotanL, cotanM, opts.nThreads);
+  });
+  flatMesh = FlatTriangleMesh();
+
+  SparseMatrix<double> L, M;
+  runStage(stages, iStage, "tufted_laplacian", [&]() {
+    std::tie(L, M) = buildTuftedLaplacian(*mesh, *geometry, opts.mollifyFactor);
+    if (result.isPointCloud) {
+      L = L / 3.;
+      M = M / 3.;
+    }
+  });
+
+  runStage(stages, iStage, "write_matrices", [&]() {
+    std::string ext = "." + matrixFormatExtension(opts.matrixFormat);
+    saveMatrix(opts.scratchPrefix + "laplacian" + ext, L, opts.matrixFormat);
+    saveMatrix(opts.scratchPrefix + "lumped_mass" + ext, M, opts.matrixFormat);
+  });
+  std::remove((opts.scratchPrefix + "laplacian." + matrixFormatExtension(opts.matrixFormat)).c_str());
+  std::remove((opts.scratchPrefix + "lumped_mass." + matrixFormatExtension(opts.matrixFormat)).c_str());
+}
+
+
+// === JSON output
+
+std::string jsonString(const std::string& str) {
+  std::string out = "\"";
+  for (char c : str) {
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        char buf[8];
+        std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned int>(static_cast<unsigned char>(c)));
+        out += buf;
+      } else {
+        out += c;
+      }
+    }
+  }
+  return out + "\"";
+}
+
+double median(std::vector<double> vals) {
+  if (vals.empty()) return 0.;
+  std::sort(vals.begin(), vals.end());
+  size_t n = vals.size();
+  return (n % 2 == 1) ? vals[n / 2] : 0.5 * (vals[n / 2 - 1] + vals[n / 2]);
+}
+
+void writeJSON(std::ostream& out, const BenchOptions& opts, const std::vector<InputResult>& results) {
+  out << std::setprecision(9);
+  out << "{\n";
+  out << "  \"options\": {\"mollifyFactor\": " << opts.mollifyFactor << ", \"nNeigh\": " << opts.nNeigh
+      << ", \"threads\": " << opts.nThreads << ", \"repeat\": " << opts.nRepeat
+      << ", \"matrixFormat\": " << jsonString(matrixFormatExtension(opts.matrixFormat)) << "},\n";
+  out << "  \"inputs\": [";
+  for (size_t iIn = 0; iIn < results.size(); iIn++) {
+    const InputResult& res = results[iIn];
+    out << (iIn == 0 ? "\n" : ",\n");
+    out << "    {\n";
+    out << "      \"file\": " << jsonString(res.filename) << ",\n";
+    out << "      \"type\": " << jsonString(res.isPointCloud ? "point_cloud" : "mesh") << ",\n";
+    out << "      \"vertices\": " << res.nVertices << ",\n";
+    out << "      \"faces\": " << res.nFaces << ",\n";
+    out << "      \"cover_trivial\": " << (res.coverIsTrivial ? "true" : "false") << ",\n";
+    if (!res.error.empty()) {
+      out << "      \"error\": " << jsonString(res.error) << ",\n";
+    }
+    double totalSeconds = 0.;
+    out << "      \"stages\": [";
+    for (size_t iStage = 0; iStage < res.stages.size(); iStage++) {
+      const StageResult& stage = res.stages[iStage];
+      double medianSeconds = median(stage.wallSeconds);
+      totalSeconds += medianSeconds;
+      out << (iStage == 0 ? "\n" : ",\n");
+      out << "        {\"name\": " << jsonString(stage.name) << ", \"wall_seconds\": " << medianSeconds
+          << ", \"wall_seconds_min\": " << *std::min_element(stage.wallSeconds.begin(), stage.wallSeconds.end())
+          << ", \"peak_rss_bytes\": " << stage.peakRSS << ", \"allocations\": " << stage.allocations
+          << ", \"allocated_bytes\": " << stage.allocatedBytes << "}";
+    }
+    out << "\n      ],\n";
+    out << "      \"total_wall_seconds\": " << totalSeconds << "\n";
+    out << "    }";
+  }
+  out << "\n  ]\n";
+  out << "}\n";
+}
+
+} // namespace
+
+
+int main(int argc, char** argv) {
+
+  // clang-format off
+  args::ArgumentParser parser("Benchmark each stage of building tufted Laplacians, over a set of meshes and point clouds. Writes results as JSON.");
+  args::HelpFlag help(parser, "help", "Display this help message", {'h', "help"});
+  args::PositionalList<std::string> inputFilenames(parser, "inputs", "Surface mesh or point cloud files (see geometry-central for valid formats). Files without faces are treated as point clouds.");
+
+  args::ValueFlag<double> mollifyFactorArg(parser, "mollifyFactor", "Amount of intrinsic mollification to perform. Default: 1e-6", {"mollifyFactor"}, 1e-6);
+  args::ValueFlag<unsigned int> nNeighArg(parser, "nNeigh", "Number of neighbors to use for point clouds. Default: 30", {"nNeigh"}, 30);
+  args::ValueFlag<unsigned int> threadsArg(parser, "threads", "Number of threads to use for point cloud processing, 0 uses all hardware threads. Default: 1", {"threads"}, 1);
+  args::ValueFlag<unsigned int> repeatArg(parser, "repeat", "Number of times to run each input, stage times are reported as the median. Default: 1", {"repeat"}, 1);
+  args::ValueFlag<std::string> matrixFormatArg(parser, "matrixFormat", "Matrix file format for the write stage, one of 'spmat', 'bin', 'mtx' or 'npz'. Default: spmat", {"matrixFormat"}, "spmat");
+  args::ValueFlag<std::string> scratchPrefixArg(parser, "scratchPrefix", "Prefix for the (temporary) matrix files written by the write stage. Default: tufted_bench_", {"scratchPrefix"}, "tufted_bench_");
+  args::ValueFlag<std::string> outputArg(parser, "output", "Write the JSON results to this file, rather than stdout", {"output"});
+  // clang-format on
+
+  try {
+    parser.ParseCLI(argc, argv);
+  } catch (args::Help& e) {
+    std::cout << parser;
+    return 0;
+  } catch (args::ParseError& e) {
+    std::cerr << e.what() << std::endl;
+    std::cerr << parser;
+    return 1;
+  }
+
+  if (!inputFilenames) {
+    std::cout << parser;
+    return EXIT_FAILURE;
+  }
+
+  BenchOptions opts;
+  opts.mollifyFactor = args::get(mollifyFactorArg);
+  opts.nNeigh = args::get(nNeighArg);
+  opts.nThreads = args::get(threadsArg);
+  opts.nRepeat = std::max(1u, args::get(repeatArg));
+  opts.scratchPrefix = args::get(scratchPrefixArg);
+  try {
+    opts.matrixFormat = parseMatrixFormat(args::get(matrixFormatArg));
+  } catch (const std::runtime_error& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Progress goes to stderr, so stdout can be piped as JSON. Quiet the pipeline's own logging while running.
+  std::vector<InputResult> results;
+  for (const std::string& filename : args::get(inputFilenames)) {
+    results.emplace_back();
+    InputResult& result = results.back();
+    result.filename = filename;
+
+    for (size_t iRep = 0; iRep < opts.nRepeat; iRep++) {
+      std::cerr << "[bench] " << filename << " (run " << (iRep + 1) << " / " << opts.nRepeat << ")" << std::endl;
+      std::streambuf* coutBuf = std::cout.rdbuf();
+      std::ostringstream discarded;
+      std::cout.rdbuf(discarded.rdbuf());
+      try {
+        runPipeline(filename, opts, result);
+      } catch (const std::exception& e) {
+        result.error = e.what();
+      }
+      std::cout.rdbuf(coutBuf);
+      if (!result.error.empty()) {
+        std::cerr << "[bench]   failed: " << result.error << std::endl;
+        break;
+      }
+    }
+  }
+
+  if (outputArg) {
+    std::ofstream outFile(args::get(outputArg));
+    if (!outFile) {
+      std::cerr << "failed to open output file " << args::get(outputArg) << std::endl;
+      return EXIT_FAILURE;
+    }
+    writeJSON(outFile, opts, results);
+  } else {
+    writeJSON(std::cout, opts, results);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -1,7 +1,13 @@
 #include "bubble_offset.h"
 
+#include "instrumentation.h"
+#include "parallel_utilities.h"
+
+#include <algorithm>
+
 
 BubbleOffset::BubbleOffset(EmbeddedGeometryInterface& geom_) : geom(geom_) {
+  TUFTED_TRACE_SCOPE("bubble offset");
 
   SurfaceMesh& mesh = geom.mesh;
   geom.requireVertexPositions();
@@ -30,238 +36,140 @@ BubbleOffset::BubbleOffset(EmbeddedGeometryInterface& geom_) : geom(geom_) {
 
     edgeNormals[e] = n;
   }
+
+  // Gather everything queryFacePoint() needs, per face
+  for (int j = 0; j < 3; j++) {
+    faceCornerPositions[j] = FaceData<Vector3>(mesh);
+    faceEdgeNormals[j] = FaceData<Vector3>(mesh);
+    faceEdgeLengths[j] = FaceData<double>(mesh);
+  }
+  for (Face f : mesh.faces()) {
+    Halfedge he = f.halfedge();
+    for (int j = 0; j < 3; j++) {
+      faceCornerPositions[j][f] = geom.vertexPositions[he.vertex()];
+      faceEdgeNormals[j][f] = edgeNormals[he.edge()];
+      faceEdgeLengths[j][f] = geom.edgeLengths[he.edge()];
+      he = he.next();
+    }
+  }
 }
 
 
 Vector3 BubbleOffset::queryPoint(const SurfacePoint& p) {
-
-  // Position on the flat surface
-  Vector3 pOrig = p.interpolate(geom.vertexPositions);
-
   // A point in some face
   SurfacePoint faceP = p.inSomeFace();
-  Face origF = faceP.face;
-  Vector3 bary = faceP.faceCoords;
+  return queryFacePoint(faceP.face, faceP.faceCoords);
+}
+
+Vector3 BubbleOffset::queryFacePoint(Face f, const Vector3& bary) const {
+
+  const Vector3& pI = faceCornerPositions[0][f];
+  const Vector3& pJ = faceCornerPositions[1][f];
+  const Vector3& pK = faceCornerPositions[2][f];
+  Vector3 pOrig = bary.x * pI + bary.y * pJ + bary.z * pK;
 
   double scale = relativeScale * geom.meshLengthScale;
 
   // double minC = std::fmin(std::fmin(bary.x, bary.y), bary.z);
-  // Vector3 offset = geom.faceNormals[origF] * scale * minC;
+  // Vector3 offset = geom.faceNormals[f] * scale * minC;
 
   // basis function coefs
   double u = bary.y;
   double v = bary.z;
-  double w = bary.x;
-  double phiI = (1 - u - v) * (1 - 2 * u - 2 * v);
-  double phiJ = u * (2 * u - 1);
-  double phiK = v * (2 * v - 1);
   double phiIJ = 4 * u * (1 - u - v);
   double phiJK = 4 * u * v;
   double phiKI = 4 * v * (1 - u - v);
 
-  double lIJ = useEdgeScaling ? geom.edgeLengths[origF.halfedge().edge()] : 1.0;
-  Vector3 offsetIJ = edgeNormals[origF.halfedge().edge()] * lIJ;
-
-  double lJK = useEdgeScaling ? geom.edgeLengths[origF.halfedge().next().edge()] : 1.0;
-  Vector3 offsetJK = edgeNormals[origF.halfedge().next().edge()] * lJK;
-
-  double lKI = useEdgeScaling ? geom.edgeLengths[origF.halfedge().next().next().edge()] : 1.0;
-  Vector3 offsetKI = edgeNormals[origF.halfedge().next().next().edge()] * lKI;
-
-  Vector3 offset = offsetIJ * phiIJ + offsetJK * phiJK + offsetKI * phiKI;
+  double lIJ = useEdgeScaling ? faceEdgeLengths[0][f] : 1.0;
+  double lJK = useEdgeScaling ? faceEdgeLengths[1][f] : 1.0;
+  double lKI = useEdgeScaling ? faceEdgeLengths[2][f] : 1.0;
+  Vector3 offset = (faceEdgeNormals[0][f] * lIJ) * phiIJ + (faceEdgeNormals[1][f] * lJK) * phiJK +
+                   (faceEdgeNormals[2][f] * lKI) * phiKI;
   offset *= scale;
-  offset += normalOffset * geom.faceNormals[origF];
+  offset += normalOffset * geom.faceNormals[f];
 
   if (dialate > 0.0) {
     // pull towards center
     Vector3 initP = pOrig + offset;
-    Vector3 faceCenter = Vector3::zero();
-    for (Vertex v : origF.adjacentVertices()) {
-      faceCenter += geom.vertexPositions[v] / 3;
-    }
+    Vector3 faceCenter = pI / 3 + pJ / 3 + pK / 3;
     return dialate * faceCenter + (1.0 - dialate) * initP;
   } else {
     return pOrig + offset;
   }
 }
 
+void BubbleOffset::queryFacePoints(const std::vector<Face>& faces, const std::vector<Vector3>& baryCoords,
+                                   std::vector<Vector3>& out, size_t nThreads) const {
+  TUFTED_TRACE_SCOPE("bubble offset queries");
+  TUFTED_TRACE_COUNT("bubble offset points", faces.size());
+  out.resize(faces.size());
+  parallelForBlocks(faces.size(), nThreads, 4096, [&](size_t iThread, size_t iStart, size_t iEnd) {
+    for (size_t i = iStart; i < iEnd; i++) out[i] = queryFacePoint(faces[i], baryCoords[i]);
+  });
+}
+
 
 std::unique_ptr<SimplePolygonMesh> subdivideRounded(ManifoldSurfaceMesh& mesh, VertexPositionGeometry& geom,
-                                                    int subdivLevel, double scale, double dialate,
-                                                    double normalOffset) {
+                                                    int subdivLevel, double scale, double dialate, double normalOffset,
+                                                    size_t nThreads) {
+  std::vector<Face> faces;
+  faces.reserve(mesh.nFaces());
+  for (Face f : mesh.faces()) faces.push_back(f);
+  return subdivideRounded(mesh, geom, faces, subdivLevel, scale, dialate, normalOffset, nThreads);
+}
+
+std::unique_ptr<SimplePolygonMesh> subdivideRounded(ManifoldSurfaceMesh& mesh, VertexPositionGeometry& geom,
+                                                    const std::vector<Face>& faces, int subdivLevel, double scale,
+                                                    double dialate, double normalOffset, size_t nThreads) {
+  TUFTED_TRACE_SCOPE("subdivide rounded");
 
-  // Make a copy
   geom.requireVertexPositions();
   geom.requireFaceNormals();
   geom.requireFaceAreas();
   geom.requireEdgeLengths();
 
-
-  // == Good old-fashioned subdivision, preserving barycentric coords on to original triangle
-  std::vector<std::array<size_t, 3>> faces;       // per-face
-  std::vector<Vector3> vertexCoords;              // per-vert
-  std::vector<std::array<Vector3, 3>> baryCoords; // per-face
-  std::vector<Face> origFaceTri;                  // per-face
-
-  { // Initialize
-    for (Face f : mesh.faces()) {
-      baryCoords.push_back({Vector3{1., 0., 0.}, Vector3{0., 1., 0.}, Vector3{0., 0., 1.}});
-      origFaceTri.push_back(f);
-
-      faces.push_back({vertexCoords.size(), vertexCoords.size() + 1, vertexCoords.size() + 2});
-
-      // create distinct copies of the vertices
-      vertexCoords.push_back(geom.vertexPositions[f.halfedge().vertex()]);
-      vertexCoords.push_back(geom.vertexPositions[f.halfedge().next().vertex()]);
-      vertexCoords.push_back(geom.vertexPositions[f.halfedge().next().next().vertex()]);
-    }
-  }
-
-  // Iteratively subdivide
-  for (int iSub = 0; iSub < subdivLevel; iSub++) {
-
-    // New arrays
-    std::vector<Vector3> vertexCoordsNew = vertexCoords; // per-vertex, copy existing
-    // std::vector<Vector3> vertexOrigBaryCoordsNew = vertexOrigBaryCoords; // per-vertex, copy existing
-    std::vector<std::array<size_t, 3>> facesNew;       // per-face, all new
-    std::vector<Face> origFaceTriNew;                  // per-face, all new
-    std::vector<std::array<Vector3, 3>> baryCoordsNew; // per-face, all new
-
-    // Create new vertices along edges
-    std::map<std::tuple<size_t, size_t>, size_t> edgeVert;
-    std::vector<std::array<size_t, 3>> faceVert; // used if iSub == 0
-    if (iSub == 0) {
-      faceVert.resize(faces.size());
-      // if (false) {
-      // On the first iteration, separate the edges
-      for (size_t iF = 0; iF < faces.size(); iF++) {
-        for (size_t j = 0; j < 3; j++) {
-          size_t vTail = faces[iF][j];
-          size_t vTip = faces[iF][(j + 1) % 3];
-
-          size_t newInd = vertexCoordsNew.size();
-          Vector3 newPos = (vertexCoords[vTail] + vertexCoords[vTip]) / 2.;
-          vertexCoordsNew.push_back(newPos);
-
-          faceVert[iF][j] = newInd;
-        }
-      }
-    } else {
-
-      for (size_t iF = 0; iF < faces.size(); iF++) {
-        for (size_t j = 0; j < 3; j++) {
-          size_t vTail = faces[iF][j];
-          size_t vTip = faces[iF][(j + 1) % 3];
-
-          size_t newInd = vertexCoordsNew.size();
-          Vector3 newPos = (vertexCoords[vTail] + vertexCoords[vTip]) / 2.;
-          vertexCoordsNew.push_back(newPos);
-
-          std::tuple<size_t, size_t> key{vTail, vTip};
-          std::tuple<size_t, size_t> keyTwin{vTip, vTail};
-          if (edgeVert.find(key) == edgeVert.end()) {
-            edgeVert[key] = newInd;
-            edgeVert[keyTwin] = newInd;
-          }
-        }
-      }
-    }
-
-
-    // Create new faces
-    for (size_t iF = 0; iF < faces.size(); iF++) {
-
-      // Gather vertices
-      size_t vA = faces[iF][0];
-      size_t vB = faces[iF][1];
-      size_t vC = faces[iF][2];
-
-      size_t vAB, vBC, vCA;
-      if (iSub == 0) {
-        vAB = faceVert[iF][0];
-        vBC = faceVert[iF][1];
-        vCA = faceVert[iF][2];
-      } else {
-
-        if (edgeVert.find(std::tuple<size_t, size_t>{vA, vB}) == edgeVert.end())
-          throw std::runtime_error("edge key " + std::to_string(vA) + " --- " + std::to_string(vB));
-        if (edgeVert.find(std::tuple<size_t, size_t>{vB, vC}) == edgeVert.end())
-          throw std::runtime_error("edge key " + std::to_string(vB) + " --- " + std::to_string(vC));
-        if (edgeVert.find(std::tuple<size_t, size_t>{vC, vA}) == edgeVert.end())
-          throw std::runtime_error("edge key " + std::to_string(vC) + " --- " + std::to_string(vA));
-
-
-        vAB = edgeVert[std::tuple<size_t, size_t>{vA, vB}];
-        vBC = edgeVert[std::tuple<size_t, size_t>{vB, vC}];
-        vCA = edgeVert[std::tuple<size_t, size_t>{vC, vA}];
-      }
-
-      if (vAB == 0 || vBC == 0 || vCA == 0) {
-        std::cout << "  face " << iF << " has verts " << vAB << " " << vBC << " " << vCA << std::endl;
-      }
-
-      Vector3 bA = baryCoords[iF][0];
-      Vector3 bB = baryCoords[iF][1];
-      Vector3 bC = baryCoords[iF][2];
-      Vector3 bAB = 0.5 * (bA + bB);
-      Vector3 bBC = 0.5 * (bB + bC);
-      Vector3 bCA = 0.5 * (bC + bA);
-
-      // Create new faces
-
-      facesNew.push_back({vA, vAB, vCA});
-      baryCoordsNew.push_back({bA, bAB, bCA});
-      origFaceTriNew.push_back(origFaceTri[iF]);
-
-      facesNew.push_back({vAB, vB, vBC});
-      baryCoordsNew.push_back({bAB, bB, bBC});
-      origFaceTriNew.push_back(origFaceTri[iF]);
-
-      facesNew.push_back({vCA, vBC, vC});
-      baryCoordsNew.push_back({bCA, bBC, bC});
-      origFaceTriNew.push_back(origFaceTri[iF]);
-
-      facesNew.push_back({vAB, vBC, vCA});
-      baryCoordsNew.push_back({bAB, bBC, bCA});
-      origFaceTriNew.push_back(origFaceTri[iF]);
-    }
-
-    // Swap in new arrays
-    vertexCoords = vertexCoordsNew;
-    faces = facesNew;
-    origFaceTri = origFaceTriNew;
-    baryCoords = baryCoordsNew;
-  }
-
   BubbleOffset bubbleOffset(geom);
   bubbleOffset.relativeScale = scale;
   bubbleOffset.dialate = dialate;
   bubbleOffset.normalOffset = normalOffset;
 
-  // Apply offsets
-  // (this will process each vertex many times; that's fine)
-  std::vector<Vector3> vertexCoordsOffset(vertexCoords.size());
-  for (size_t iF = 0; iF < faces.size(); iF++) {
-    for (size_t j = 0; j < 3; j++) {
-      size_t vInd = faces[iF][j];
-      Vector3 pOrig = vertexCoords[vInd];
-      Face origF = origFaceTri[iF];
-      Vector3 origBary = baryCoords[iF][j];
-
-      SurfacePoint origP(origF, origBary);
-      vertexCoordsOffset[vInd] = bubbleOffset.queryPoint(origP);
+  // == Good old-fashioned subdivision, preserving barycentric coords on to original triangle
+  //
+  // Each face gets its own copy of its vertices, so the faces are subdivided independently: subdivLevel rounds of
+  // midpoint subdivision split a face in to a regular grid with n = 2^subdivLevel segments along each edge. The grid
+  // point in row r (0 <= r <= n) and column c (0 <= c <= r) has barycentric coordinates
+  // ((n - r) / n, (r - c) / n, c / n), which are exactly the coordinates repeated halving gives. Output sizes are known
+  // up front, so faces are processed in parallel, each writing its own range of vertices and triangles.
+  size_t n = static_cast<size_t>(1) << std::max(subdivLevel, 0);
+  size_t vertsPerFace = (n + 1) * (n + 2) / 2;
+  size_t trisPerFace = n * n;
+
+  std::unique_ptr<SimplePolygonMesh> outSoup(new SimplePolygonMesh());
+  outSoup->vertexCoordinates.resize(faces.size() * vertsPerFace);
+  outSoup->polygons.resize(faces.size() * trisPerFace);
+  TUFTED_TRACE_COUNT("bubble offset points", outSoup->vertexCoordinates.size());
+
+  parallelFor(faces.size(), nThreads, [&](size_t iThread, size_t iF) {
+    size_t vertStart = iF * vertsPerFace;
+    auto gridVert = [&](size_t r, size_t c) { return vertStart + r * (r + 1) / 2 + c; };
+
+    // Apply offsets
+    for (size_t r = 0; r <= n; r++) {
+      for (size_t c = 0; c <= r; c++) {
+        Vector3 origBary{static_cast<double>(n - r) / n, static_cast<double>(r - c) / n, static_cast<double>(c) / n};
+        outSoup->vertexCoordinates[gridVert(r, c)] = bubbleOffset.queryFacePoint(faces[iF], origBary);
+      }
     }
-  }
 
-
-  // Store the output here
-  std::unique_ptr<SimplePolygonMesh> outSoup(new SimplePolygonMesh({}, vertexCoordsOffset));
-  for (size_t iF = 0; iF < faces.size(); iF++) {
-    size_t vA = faces[iF][0];
-    size_t vB = faces[iF][1];
-    size_t vC = faces[iF][2];
-    outSoup->polygons.push_back({vA, vB, vC});
-  }
+    // Triangles pointing towards the first corner and away from it, both with the orientation of the face
+    std::vector<size_t>* tri = &outSoup->polygons[iF * trisPerFace];
+    for (size_t r = 0; r < n; r++) {
+      for (size_t c = 0; c <= r; c++) {
+        *tri++ = {gridVert(r, c), gridVert(r + 1, c), gridVert(r + 1, c + 1)};
+        if (c < r) *tri++ = {gridVert(r, c), gridVert(r + 1, c + 1), gridVert(r, c + 1)};
+      }
+    }
+  });
 
   return outSoup;
 }
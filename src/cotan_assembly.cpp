@@ -0,0 +1,236 @@
+#include "cotan_assembly.h"
+
+#include "instrumentation.h"
+#include "parallel_utilities.h"
+
+#include <Eigen/Core>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+using namespace geometrycentral;
+using namespace geometrycentral::surface;
+
+namespace {
+
+const size_t kernelBlockSize = 1024;
+
+// The areas of the triangles, and the cotan weight (half the cotangent of the opposite angle) of each side, as in
+// geometry-central's IntrinsicGeometryInterface
+struct TriangleWeights {
+  std::vector<double> areas;
+  std::array<std::vector<double>, 3> cotanWeights; // like IntrinsicTriangles::edgeLengths
+};
+
+TriangleWeights computeTriangleWeights(const IntrinsicTriangles& triangles, size_t nThreads) {
+  TUFTED_TRACE_SCOPE("cotan weights");
+  typedef Eigen::Map<const Eigen::ArrayXd> ConstMap;
+  typedef Eigen::Map<Eigen::ArrayXd> Map;
+
+  size_t nTriangles = triangles.nTriangles();
+  if (!triangles.faceScales.empty() && triangles.faceScales.size() != nTriangles) {
+    throw std::runtime_error("cotan assembly needs one face scale per triangle");
+  }
+  TriangleWeights result;
+  result.areas.resize(nTriangles);
+  for (std::vector<double>& w : result.cotanWeights) w.resize(nTriangles);
+
+  parallelForBlocks(nTriangles, nThreads, kernelBlockSize, [&](size_t iThread, size_t iStart, size_t iEnd) {
+    Eigen::Index n = static_cast<Eigen::Index>(iEnd - iStart);
+    ConstMap a(&triangles.edgeLengths[0][iStart], n);
+    ConstMap b(&triangles.edgeLengths[1][iStart], n);
+    ConstMap c(&triangles.edgeLengths[2][iStart], n);
+    Map area(&result.areas[iStart], n);
+    Map wA(&result.cotanWeights[0][iStart], n);
+    Map wB(&result.cotanWeights[1][iStart], n);
+    Map wC(&result.cotanWeights[2][iStart], n);
+
+    // Heron's formula, clamped at zero for (numerically) degenerate triangles
+    area = 0.25 * ((a + b + c) * (-a + b + c) * (a - b + c) * (a + b - c)).max(0.).sqrt();
+
+    // cot = (adjacent sides squared - opposite side squared) / (4 area), and the weight is half that
+    wA = (b.square() + c.square() - a.square()) / (8. * area);
+    wB = (c.square() + a.square() - b.square()) / (8. * area);
+    wC = (a.square() + b.square() - c.square()) / (8. * area);
+
+    if (!triangles.faceScales.empty()) {
+      ConstMap faceScale(&triangles.faceScales[iStart], n);
+      area *= faceScale;
+      wA *= faceScale;
+      wB *= faceScale;
+      wC *= faceScale;
+    }
+  });
+  return result;
+}
+
+// The corners of the triangles at each vertex, in compressed form: the corners at vertex iV are
+// corners[cornerStart[iV]..cornerStart[iV + 1]), each as 3 iF + j
+struct VertexCorners {
+  std::vector<size_t> cornerStart;
+  std::vector<uint32_t> corners;
+};
+
+VertexCorners buildVertexCorners(const IntrinsicTriangles& triangles) {
+  size_t nCorners = 3 * triangles.nTriangles();
+  if (nCorners > std::numeric_limits<uint32_t>::max()) {
+    throw std::runtime_error("too many triangles for cotan assembly");
+  }
+
+  VertexCorners result;
+  result.cornerStart.assign(triangles.nVertices + 1, 0);
+  for (const std::array<uint32_t, 3>& tri : triangles.vertices) {
+    for (uint32_t iV : tri) result.cornerStart[iV + 1]++;
+  }
+  for (size_t iV = 0; iV < triangles.nVertices; iV++) result.cornerStart[iV + 1] += result.cornerStart[iV];
+
+  result.corners.resize(nCorners);
+  std::vector<size_t> next(result.cornerStart.begin(), result.cornerStart.end() - 1);
+  for (size_t iC = 0; iC < nCorners; iC++) {
+    result.corners[next[triangles.vertices[iC / 3][iC % 3]]++] = static_cast<uint32_t>(iC);
+  }
+  return result;
+}
+
+} // namespace
+
+
+IntrinsicTriangles intrinsicTrianglesFromMesh(SurfaceMesh& mesh, const EdgeData<double>& edgeLengths,
+                                              size_t nThreads) {
+  IntrinsicTriangles result;
+  result.nVertices = mesh.nVertices();
+  result.vertices.resize(mesh.nFaces());
+  for (std::vector<double>& l : result.edgeLengths) l.resize(mesh.nFaces());
+
+  parallelFor(mesh.nFaces(), nThreads, [&](size_t iThread, size_t iF) {
+    Halfedge he = mesh.face(iF).halfedge();
+    for (size_t j = 0; j < 3; j++) {
+      result.vertices[iF][j] = static_cast<uint32_t>(he.tailVertex().getIndex());
+      result.edgeLengths[j][iF] = edgeLengths[he.edge()];
+      he = he.next();
+    }
+    if (he != mesh.face(iF).halfedge()) {
+      throw std::runtime_error("cotan assembly needs a triangle mesh");
+    }
+  });
+  return result;
+}
+
+IntrinsicTriangles intrinsicTrianglesFromPositions(const FlatTriangleMesh& mesh, size_t nThreads) {
+  IntrinsicTriangles result;
+  result.nVertices = mesh.nVertices();
+  result.vertices.resize(mesh.nTriangles());
+  for (std::vector<double>& l : result.edgeLengths) l.resize(mesh.nTriangles());
+
+  parallelFor(mesh.nTriangles(), nThreads, [&](size_t iThread, size_t iF) {
+    for (size_t j = 0; j < 3; j++) {
+      uint32_t iA = mesh.triangles[3 * iF + j];
+      uint32_t iB = mesh.triangles[3 * iF + (j + 1) % 3];
+      const double* pA = &mesh.vertexPositions[3 * iA];
+      const double* pB = &mesh.vertexPositions[3 * iB];
+      double dx = pB[0] - pA[0], dy = pB[1] - pA[1], dz = pB[2] - pA[2];
+      result.vertices[iF][j] = iA;
+      result.edgeLengths[j][iF] = std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+  });
+  return result;
+}
+
+void buildCotanOperators(const IntrinsicTriangles& triangles, double scale, SparseMatrix<double>& L,
+                         SparseMatrix<double>& M, size_t nThreads) {
+  TUFTED_TRACE_SCOPE("cotan operators");
+  typedef SparseMatrix<double>::StorageIndex StorageIndex;
+
+  size_t nVertices = triangles.nVertices;
+  TriangleWeights weights = computeTriangleWeights(triangles, nThreads);
+  VertexCorners vertexCorners = buildVertexCorners(triangles);
+
+  // The column of vertex iV, before merging: at each of its corners, the side to the next corner and the side from
+  // the previous one, each with the weight of that side. Sides which start and end at iV (possible after intrinsic
+  // flips) add nothing, since they cancel on the diagonal.
+  typedef std::pair<StorageIndex, double> ColumnEntry;
+  auto gatherColumn = [&](size_t iV, std::vector<ColumnEntry>& column) {
+    column.clear();
+    for (size_t i = vertexCorners.cornerStart[iV]; i < vertexCorners.cornerStart[iV + 1]; i++) {
+      size_t iC = vertexCorners.corners[i];
+      size_t iF = iC / 3, j = iC % 3;
+      size_t jNext = (j + 1) % 3, jPrev = (j + 2) % 3;
+      uint32_t iNext = triangles.vertices[iF][jNext];
+      uint32_t iPrev = triangles.vertices[iF][jPrev];
+      if (iNext != iV) column.emplace_back(static_cast<StorageIndex>(iNext), weights.cotanWeights[j][iF]);
+      if (iPrev != iV) column.emplace_back(static_cast<StorageIndex>(iPrev), weights.cotanWeights[jPrev][iF]);
+    }
+    std::sort(column.begin(), column.end()); // (by value too, so L comes out exactly symmetric)
+  };
+
+  // Lay out L: the distinct neighbors of each vertex, plus the diagonal
+  std::vector<size_t> columnSizes(nVertices);
+  parallelForBlocks(nVertices, nThreads, kernelBlockSize, [&](size_t iThread, size_t iStart, size_t iEnd) {
+    std::vector<uint32_t> neighbors;
+    for (size_t iV = iStart; iV < iEnd; iV++) {
+      neighbors.clear();
+      for (size_t i = vertexCorners.cornerStart[iV]; i < vertexCorners.cornerStart[iV + 1]; i++) {
+        size_t iC = vertexCorners.corners[i];
+        const std::array<uint32_t, 3>& tri = triangles.vertices[iC / 3];
+        for (uint32_t iU : {tri[(iC + 1) % 3], tri[(iC + 2) % 3]}) {
+          if (iU != iV) neighbors.push_back(iU);
+        }
+      }
+      std::sort(neighbors.begin(), neighbors.end());
+      size_t count = std::unique(neighbors.begin(), neighbors.end()) - neighbors.begin();
+      columnSizes[iV] = vertexCorners.cornerStart[iV + 1] > vertexCorners.cornerStart[iV] ? count + 1 : 0;
+    }
+  });
+  size_t nnz = 0;
+  for (size_t size : columnSizes) nnz += size;
+  if (nnz > static_cast<size_t>(std::numeric_limits<StorageIndex>::max())) {
+    throw std::runtime_error("cotan Laplacian has too many entries for 32-bit indices");
+  }
+  L = SparseMatrix<double>(nVertices, nVertices);
+  L.resizeNonZeros(nnz);
+  StorageIndex* outer = L.outerIndexPtr();
+  outer[0] = 0;
+  for (size_t iV = 0; iV < nVertices; iV++) outer[iV + 1] = outer[iV] + static_cast<StorageIndex>(columnSizes[iV]);
+  columnSizes = std::vector<size_t>();
+
+  // Fill in L and M, merging repeated neighbors (the diagonal goes in its sorted place)
+  M = SparseMatrix<double>(nVertices, nVertices);
+  M.resizeNonZeros(nVertices);
+  StorageIndex* inner = L.innerIndexPtr();
+  double* values = L.valuePtr();
+  parallelForBlocks(nVertices, nThreads, kernelBlockSize, [&](size_t iThread, size_t iStart, size_t iEnd) {
+    std::vector<ColumnEntry> column;
+    for (size_t iV = iStart; iV < iEnd; iV++) {
+      double mass = 0.;
+      for (size_t i = vertexCorners.cornerStart[iV]; i < vertexCorners.cornerStart[iV + 1]; i++) {
+        mass += weights.areas[vertexCorners.corners[i] / 3] / 3.;
+      }
+      M.outerIndexPtr()[iV] = static_cast<StorageIndex>(iV);
+      M.innerIndexPtr()[iV] = static_cast<StorageIndex>(iV);
+      M.valuePtr()[iV] = scale * mass;
+      if (outer[iV] == outer[iV + 1]) continue;
+
+      gatherColumn(iV, column);
+      StorageIndex iEntry = outer[iV];
+      StorageIndex iDiagonal = -1;
+      double offDiagonalSum = 0.;
+      for (size_t k = 0; k < column.size(); k++) {
+        if (iDiagonal < 0 && column[k].first > static_cast<StorageIndex>(iV)) iDiagonal = iEntry++;
+        if (k == 0 || column[k].first != column[k - 1].first) {
+          inner[iEntry] = column[k].first;
+          values[iEntry] = 0.;
+          iEntry++;
+        }
+        values[iEntry - 1] -= scale * column[k].second;
+        offDiagonalSum += scale * column[k].second;
+      }
+      if (iDiagonal < 0) iDiagonal = iEntry;
+      inner[iDiagonal] = static_cast<StorageIndex>(iV);
+      values[iDiagonal] = offDiagonalSum;
+    }
+  });
+  M.outerIndexPtr()[nVertices] = static_cast<StorageIndex>(nVertices);
+}
@@ -0,0 +1,156 @@
+#include "instrumentation.h"
+
+#ifdef TUFTED_ENABLE_TRACING
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+struct ScopeEvent {
+  const char* name;
+  size_t tid;
+  double startMicros, durationMicros;
+};
+
+struct CounterSample {
+  const char* name;
+  double micros;
+  uint64_t value;
+};
+
+// Everything below is guarded by the mutex
+struct TraceState {
+  std::mutex mutex;
+  std::atomic<bool> active{false};
+  std::chrono::steady_clock::time_point origin;
+  std::vector<std::unique_ptr<TraceCounter>> counters;
+  std::vector<uint64_t> lastSampled; // for each counter
+  std::vector<ScopeEvent> scopes;
+  std::vector<CounterSample> samples;
+};
+
+TraceState& traceState() {
+  static TraceState state;
+  return state;
+}
+
+// A small id for the calling thread, in the order threads first record something
+size_t threadId() {
+  static std::atomic<size_t> nextId(0);
+  thread_local size_t id = nextId++;
+  return id;
+}
+
+double microsSince(std::chrono::steady_clock::time_point origin, std::chrono::steady_clock::time_point t) {
+  return std::chrono::duration<double, std::micro>(t - origin).count();
+}
+
+// Sample every counter which changed since the last sample (the caller holds the lock)
+void sampleCounters(TraceState& state, double micros) {
+  for (size_t iC = 0; iC < state.counters.size(); iC++) {
+    uint64_t value = state.counters[iC]->total();
+    if (value == state.lastSampled[iC]) continue;
+    state.lastSampled[iC] = value;
+    state.samples.push_back(CounterSample{state.counters[iC]->name, micros, value});
+  }
+}
+
+// Names are string literals from the macros, but escape them anyway
+std::string jsonString(const char* s) {
+  std::string out = "\"";
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') out += '\\';
+    out += *s;
+  }
+  return out + "\"";
+}
+
+} // namespace
+
+
+TraceCounter::TraceCounter(const char* name_) : name(name_) {}
+
+uint64_t TraceCounter::total() const {
+  uint64_t sum = 0;
+  for (const Slot& slot : slots) sum += slot.value.load(std::memory_order_relaxed);
+  return sum;
+}
+
+void TraceCounter::reset() {
+  for (Slot& slot : slots) slot.value.store(0, std::memory_order_relaxed);
+}
+
+TraceCounter& registerTraceCounter(const char* name) {
+  TraceState& state = traceState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  for (const std::unique_ptr<TraceCounter>& counter : state.counters) {
+    if (std::strcmp(counter->name, name) == 0) return *counter;
+  }
+  state.counters.emplace_back(new TraceCounter(name));
+  state.lastSampled.push_back(0);
+  return *state.counters.back();
+}
+
+void startTracing() {
+  TraceState& state = traceState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  for (const std::unique_ptr<TraceCounter>& counter : state.counters) counter->reset();
+  std::fill(state.lastSampled.begin(), state.lastSampled.end(), 0);
+  state.scopes.clear();
+  state.samples.clear();
+  state.origin = std::chrono::steady_clock::now();
+  state.active = true;
+}
+
+bool tracingActive() { return traceState().active.load(std::memory_order_relaxed); }
+
+void recordTraceScope(const char* name, std::chrono::steady_clock::time_point start,
+                      std::chrono::steady_clock::time_point end) {
+  size_t tid = threadId();
+  TraceState& state = traceState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  if (!state.active) return;
+  double startMicros = microsSince(state.origin, start);
+  double endMicros = microsSince(state.origin, end);
+  state.scopes.push_back(ScopeEvent{name, tid, startMicros, endMicros - startMicros});
+  sampleCounters(state, endMicros);
+}
+
+void stopTracing(const std::string& filename) {
+  TraceState& state = traceState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.active = false;
+  sampleCounters(state, microsSince(state.origin, std::chrono::steady_clock::now()));
+
+  std::unique_ptr<FILE, int (*)(FILE*)> file(std::fopen(filename.c_str(), "w"), std::fclose);
+  if (!file) {
+    throw std::runtime_error("failed to open trace file " + filename);
+  }
+  std::fprintf(file.get(), "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  const char* separator = "";
+  for (const ScopeEvent& event : state.scopes) {
+    std::fprintf(file.get(), "%s{\"name\": %s, \"cat\": \"tufted\", \"ph\": \"X\", \"pid\": 1, \"tid\": %zu, "
+                             "\"ts\": %.3f, \"dur\": %.3f}",
+                 separator, jsonString(event.name).c_str(), event.tid, event.startMicros, event.durationMicros);
+    separator = ",\n";
+  }
+  for (const CounterSample& sample : state.samples) {
+    std::fprintf(file.get(), "%s{\"name\": %s, \"cat\": \"tufted\", \"ph\": \"C\", \"pid\": 1, \"ts\": %.3f, "
+                             "\"args\": {\"value\": %llu}}",
+                 separator, jsonString(sample.name).c_str(), sample.micros,
+                 static_cast<unsigned long long>(sample.value));
+    separator = ",\n";
+  }
+  std::fprintf(file.get(), "\n]}\n");
+  if (std::ferror(file.get())) {
+    throw std::runtime_error("failed to write trace file " + filename);
+  }
+}
+
+#endif
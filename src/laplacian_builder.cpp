@@ -0,0 +1,387 @@
+#include "laplacian_builder.h"
+
+#include "cotan_assembly.h"
+#include "instrumentation.h"
+#include "manifold_precheck.h"
+#include "mesh_sanitation.h"
+#include "operator_cache.h"
+#include "tiled_point_cloud.h"
+
+#include "geometrycentral/surface/halfedge_factories.h"
+#include "geometrycentral/surface/intrinsic_mollification.h"
+#include "geometrycentral/surface/simple_idt.h"
+#include "geometrycentral/surface/tufted_laplacian.h"
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using namespace geometrycentral;
+using namespace geometrycentral::surface;
+
+namespace {
+
+// The polygon list of flat vertex index triples
+std::vector<std::vector<size_t>> polygonsOfTriangles(const std::vector<uint32_t>& triangles) {
+  std::vector<std::vector<size_t>> polygons(triangles.size() / 3);
+  for (size_t iT = 0; iT < polygons.size(); iT++) {
+    polygons[iT] = {triangles[3 * iT], triangles[3 * iT + 1], triangles[3 * iT + 2]};
+  }
+  return polygons;
+}
+
+// The union of the local triangulations of a point cloud. With dedupTriangles, each distinct triangle appears once, and
+// `faceScales` gets its weight: the fraction of its three vertices whose local triangulation found it, so that it
+// counts as much as all its copies would. (The operators are close to, but not the same as, those with every copy kept
+// and the result divided by 3: the tufted cover and Delaunay flips see one face rather than its copies.)
+std::vector<std::array<size_t, 3>> triangulatePointCloud(const std::vector<Vector3>& points,
+                                                         const TuftedLaplacianOptions& options, std::ostream& log,
+                                                         std::vector<double>& faceScales) {
+
+  size_t nThreads = options.nThreads;
+
+  std::vector<std::array<size_t, 3>> cloudTriangles;
+  if (!options.referencePointCloud && !options.checkLocalTriangulator) {
+    PointCloudTriangulation cloudTri = build_point_cloud_triangulation(points, options.nNeigh, nThreads,
+                                                                       options.normalEstimator,
+                                                                       options.localTriangulator, &log);
+    cloudTriangles = std::move(cloudTri.triangles);
+  } else {
+    NeighborTable neigh = generate_knn_table(points, options.nNeigh, nThreads);
+    std::vector<Vector3> normals = generate_normals(points, neigh, nThreads, options.normalEstimator);
+    std::vector<Vector2> coords = generate_coords_projection(points, normals, neigh, nThreads);
+    LocalTriangulationResult localTri =
+        build_delaunay_triangulations(coords, neigh, false, nThreads, options.localTriangulator, &log);
+
+    if (options.checkLocalTriangulator) {
+      LocalTriangulationResult referenceTri =
+          build_delaunay_triangulations(coords, neigh, false, nThreads, LocalTriangulator::Voronoi);
+      LocalTriangulationComparison comp = compare_local_triangulations(referenceTri, localTri);
+      log << "local triangulator check: " << comp.nPointsDiffering << " / " << localTri.pointTriangles.size()
+          << " points differ from voronoi, with " << comp.nMissingTriangles << " missing and " << comp.nExtraTriangles
+          << " extra triangles. max relative area difference = " << comp.maxRelativeAreaDiff << std::endl;
+    }
+
+    // Take the union of all triangles in all the neighborhoods
+    for (size_t iPt = 0; iPt < points.size(); iPt++) {
+      const uint32_t* thisNeigh = neigh[iPt];
+
+      // Accumulate over triangles
+      for (const auto& tri : localTri.pointTriangles[iPt]) {
+        std::array<size_t, 3> triGlobal = {thisNeigh[tri[0]], thisNeigh[tri[1]], thisNeigh[tri[2]]};
+        cloudTriangles.push_back(triGlobal);
+      }
+    }
+  }
+
+  if (options.dedupTriangles) {
+    DeduplicatedTriangles dedup = deduplicate_triangles(cloudTriangles);
+    std::array<size_t, 4> countsByMultiplicity = {0, 0, 0, 0};
+    for (uint8_t m : dedup.multiplicity) countsByMultiplicity[std::min<size_t>(m, 3)]++;
+    log << "merged " << cloudTriangles.size() << " local triangles in to " << dedup.triangles.size()
+        << " distinct triangles (" << countsByMultiplicity[3] << " found 3+ times, " << countsByMultiplicity[2]
+        << " twice, " << countsByMultiplicity[1] << " once)" << std::endl;
+    cloudTriangles = std::move(dedup.triangles);
+    faceScales.resize(dedup.multiplicity.size());
+    for (size_t iF = 0; iF < faceScales.size(); iF++) faceScales[iF] = dedup.multiplicity[iF] / 3.;
+  }
+
+  return cloudTriangles;
+}
+
+// Re-index the rows and columns of a matrix over the sanitized vertices by input vertex, leaving empty rows and
+// columns for dropped vertices
+SparseMatrix<double> scatterToInputVertices(const SparseMatrix<double>& mat, const std::vector<size_t>& newToOld,
+                                            size_t nInputVertices) {
+  std::vector<Eigen::Triplet<double>> triplets;
+  triplets.reserve(mat.nonZeros());
+  for (int k = 0; k < mat.outerSize(); k++) {
+    for (SparseMatrix<double>::InnerIterator it(mat, k); it; ++it) {
+      triplets.emplace_back(newToOld[it.row()], newToOld[it.col()], it.value());
+    }
+  }
+  SparseMatrix<double> scattered(nInputVertices, nInputVertices);
+  scattered.setFromTriplets(triplets.begin(), triplets.end());
+  return scattered;
+}
+
+// The matrices of the cover, flipped to Delaunay (it counts every face twice). `coverFaceScales` are the
+// IntrinsicTriangles::faceScales of its faces, if any; faces keep theirs through flips, which only ever join faces of
+// equal scale.
+void buildCoverOperators(SurfaceMesh& tuftedMesh, const EdgeData<double>& tuftedEdgeLengths,
+                         std::vector<double> coverFaceScales, size_t nThreads, TuftedLaplacianResult& result) {
+  IntrinsicTriangles triangles = intrinsicTrianglesFromMesh(tuftedMesh, tuftedEdgeLengths, nThreads);
+  triangles.faceScales = std::move(coverFaceScales);
+  buildCotanOperators(triangles, 0.5, result.L, result.M, nThreads);
+}
+
+// The same steps as geometry-central's buildTuftedLaplacian(), but with the matrices assembled by
+// buildCotanOperators(), and (with keepTuftedCover) keeping a copy of the tufted cover, before it is flipped to
+// Delaunay, in the result
+void buildTuftedLaplacianOnCover(const TuftedLaplacianOptions& options, TuftedLaplacianResult& result) {
+  double mollifyFactor = options.mollifyFactor;
+
+  // Create a copy of the mesh / geometry to operate on
+  std::unique_ptr<SurfaceMesh> tuftedMesh = result.mesh->copyToSurfaceMesh();
+  result.geometry->requireVertexPositions();
+  std::unique_ptr<VertexPositionGeometry> tuftedGeom(
+      new VertexPositionGeometry(*tuftedMesh, result.geometry->vertexPositions.reinterpretTo(*tuftedMesh)));
+  tuftedGeom->requireEdgeLengths();
+  EdgeData<double> tuftedEdgeLengths = tuftedGeom->edgeLengths;
+
+  // Mollify, if requested
+  if (mollifyFactor > 0) {
+    mollifyIntrinsic(*tuftedMesh, tuftedEdgeLengths, mollifyFactor);
+  }
+
+  // Build the cover
+  buildIntrinsicTuftedCover(*tuftedMesh, tuftedEdgeLengths, tuftedGeom.get());
+  std::vector<double> coverFaceScales;
+  if (!result.faceScales.empty()) coverFaceScales = coverFaceValues(*result.mesh, *tuftedMesh, result.faceScales);
+
+  // Keep it, before flipping
+  if (options.keepTuftedCover) {
+    result.tuftedCover = tuftedMesh->copyToSurfaceMesh();
+    result.tuftedCoverGeometry = tuftedGeom->reinterpretTo(*result.tuftedCover);
+    result.tuftedCoverEdgeLengths = tuftedEdgeLengths.reinterpretTo(*result.tuftedCover);
+  }
+  tuftedGeom.reset();
+
+  // Flip to delaunay (but not between faces of different scales, see flipToDelaunayWithinScales())
+  size_t nFlips = flipToDelaunayWithinScales(*tuftedMesh, tuftedEdgeLengths, coverFaceScales);
+  TUFTED_TRACE_COUNT("delaunay flips", nFlips);
+
+  buildCoverOperators(*tuftedMesh, tuftedEdgeLengths, std::move(coverFaceScales), options.nThreads, result);
+}
+
+// The same steps again, but with the cover built by buildFlatTuftedCover() from `flatMesh` (the mesh of `result`, as
+// flat arrays)
+void buildTuftedLaplacianOnFlatCover(const FlatTriangleMesh& flatMesh, const TuftedLaplacianOptions& options,
+                                     TuftedLaplacianResult& result) {
+
+  // Mollified edge lengths, and the cover
+  EdgeIncidence edges = buildEdgeIncidence(flatMesh, options.nThreads);
+  std::vector<double> edgeLengths = buildEdgeLengths(flatMesh, edges, options.mollifyFactor, options.nThreads);
+  std::unique_ptr<SurfaceMesh> tuftedMesh;
+  std::vector<size_t> coverEdgeToInput;
+  {
+    FlatTuftedCover cover = buildFlatTuftedCover(flatMesh, edges, options.nThreads);
+    tuftedMesh = makeTuftedCoverMesh(cover, edges, coverEdgeToInput, options.nThreads);
+  }
+  EdgeData<double> tuftedEdgeLengths(*tuftedMesh);
+  for (size_t iE = 0; iE < coverEdgeToInput.size(); iE++) {
+    tuftedEdgeLengths[iE] = edgeLengths[coverEdgeToInput[iE]];
+  }
+
+  // Keep it, before flipping
+  if (options.keepTuftedCover) {
+    result.geometry->requireVertexPositions();
+    result.tuftedCover = tuftedMesh->copyToSurfaceMesh();
+    result.tuftedCoverGeometry.reset(new VertexPositionGeometry(
+        *result.tuftedCover, result.geometry->vertexPositions.reinterpretTo(*result.tuftedCover)));
+    result.tuftedCoverEdgeLengths = tuftedEdgeLengths.reinterpretTo(*result.tuftedCover);
+  }
+
+  // (cover triangles 2 iF and 2 iF + 1 are copies of input triangle iF)
+  std::vector<double> coverFaceScales;
+  if (!result.faceScales.empty()) {
+    coverFaceScales.resize(2 * result.faceScales.size());
+    for (size_t iC = 0; iC < coverFaceScales.size(); iC++) coverFaceScales[iC] = result.faceScales[iC / 2];
+  }
+
+  // Flip to delaunay (but not between faces of different scales, see flipToDelaunayWithinScales())
+  size_t nFlips = flipToDelaunayWithinScales(*tuftedMesh, tuftedEdgeLengths, coverFaceScales);
+  TUFTED_TRACE_COUNT("delaunay flips", nFlips);
+  buildCoverOperators(*tuftedMesh, tuftedEdgeLengths, std::move(coverFaceScales), options.nThreads, result);
+}
+
+// If the pre-check finds the tufted cover of `flatMesh` trivial (see manifold_precheck.h), build the operators straight
+// from the mesh and return true
+bool buildOnManifoldFastPath(const FlatTriangleMesh& flatMesh, const TuftedLaplacianOptions& options,
+                             std::ostream& log, TuftedLaplacianResult& result) {
+  EdgeIncidence edges = buildEdgeIncidence(flatMesh, options.nThreads);
+  std::vector<double> edgeLengths = buildEdgeLengths(flatMesh, edges, options.mollifyFactor, options.nThreads);
+  ManifoldPrecheck check = precheckTuftedCover(flatMesh, edges, edgeLengths, options.nThreads);
+  log << "manifold precheck: " << check.nNonmanifoldEdges << " nonmanifold edges, " << check.nNonmanifoldVertices
+      << " nonmanifold vertices, " << check.nBoundaryEdges << " boundary edges, " << check.nNonDelaunayEdges
+      << " non-Delaunay edges" << std::endl;
+  if (!check.coverIsTrivial()) {
+    log << "  ...building the tufted cover" << std::endl;
+    return false;
+  }
+
+  log << "  ...the tufted cover is trivial, building the cotan Laplacian directly" << std::endl;
+  TUFTED_TRACE_SCOPE("manifold fast path");
+  IntrinsicTriangles triangles = intrinsicTrianglesFromEdgeLengths(flatMesh, edges, edgeLengths, options.nThreads);
+  triangles.faceScales = result.faceScales;
+  buildCotanOperators(triangles, 1., result.L, result.M, options.nThreads);
+  return true;
+}
+
+// Build the operators on a sanitized mesh, with `nInputVertices` vertices before sanitizing (and result.faceScales, if
+// any, for its triangles)
+void buildOnSanitizedMesh(SanitizedMesh& sanitized, size_t nInputVertices, const TuftedLaplacianOptions& options,
+                          std::ostream& log, TuftedLaplacianResult& result) {
+
+  size_t nDroppedVertices = nInputVertices - sanitized.newToOld.size();
+  if (sanitized.nDroppedFaces > 0 || nDroppedVertices > 0) {
+    log << "removed " << sanitized.nDroppedFaces << " faces with repeated vertices and " << nDroppedVertices
+        << " vertices not used by any face" << std::endl;
+  }
+  result.vertexIndices = std::move(sanitized.newToOld);
+  result.vertexRows = std::move(sanitized.oldToNew);
+
+  // Look for the finished operators in the cache
+  bool scaleByThird = result.isPointCloud && !options.dedupTriangles; // each triangle appears (up to) once per vertex
+  std::string cacheKey;
+  bool cacheHit = false;
+  if (!options.cacheDirectory.empty()) {
+    TUFTED_TRACE_SCOPE("cache lookup");
+    cacheKey = operatorCacheKey(sanitized.mesh, options.mollifyFactor, scaleByThird ? 1. / 3. : 1., result.faceScales,
+                                options.nThreads);
+    cacheHit = loadCachedOperators(options.cacheDirectory, cacheKey, sanitized.mesh.nVertices(), result.L, result.M);
+  }
+
+  // Keep the mesh as flat arrays. The halfedge mesh is built from a polygon list, which is only made if it is needed
+  // (point clouds whose triangles are not merged are never manifold, so they skip the pre-check).
+  SimplePolygonMesh& triangleMesh = result.triangleMesh;
+  triangleMesh = SimplePolygonMesh();
+  triangleMesh.vertexCoordinates.resize(sanitized.mesh.nVertices());
+  for (size_t iV = 0; iV < sanitized.mesh.nVertices(); iV++) {
+    const double* p = &sanitized.mesh.vertexPositions[3 * iV];
+    triangleMesh.vertexCoordinates[iV] = Vector3{p[0], p[1], p[2]};
+  }
+  bool tryFastPath = options.manifoldFastPath && !options.keepTuftedCover && !scaleByThird;
+  FlatTriangleMesh flatMesh = std::move(sanitized.mesh);
+  sanitized.mesh = FlatTriangleMesh();
+
+  if (cacheHit) {
+    log << "Loaded tufted Laplacian from cache entry " << cacheKey << std::endl;
+  } else {
+    if (tryFastPath) {
+      result.tookManifoldFastPath = buildOnManifoldFastPath(flatMesh, options, log, result);
+    }
+
+    if (!result.tookManifoldFastPath) {
+      if (options.coverBuilder != CoverBuilder::Flat) flatMesh.vertexPositions = std::vector<double>();
+      {
+        TUFTED_TRACE_SCOPE("halfedge mesh");
+        triangleMesh.polygons = polygonsOfTriangles(flatMesh.triangles);
+        std::tie(result.mesh, result.geometry) =
+            makeGeneralHalfedgeAndGeometry(triangleMesh.polygons, triangleMesh.vertexCoordinates);
+      }
+
+      // ta-da! (the algorithm from geometry-central)
+      log << "Building tufted Laplacian..." << std::endl;
+      TUFTED_TRACE_SCOPE("tufted laplacian");
+      if (options.coverBuilder == CoverBuilder::Flat) {
+        buildTuftedLaplacianOnFlatCover(flatMesh, options, result);
+      } else {
+        buildTuftedLaplacianOnCover(options, result);
+      }
+      log << "  ...done!" << std::endl;
+    }
+    if (scaleByThird) {
+      result.L = result.L / 3.;
+      result.M = result.M / 3.;
+    }
+
+    if (!options.cacheDirectory.empty()) {
+      try {
+        saveCachedOperators(options.cacheDirectory, cacheKey, result.L, result.M);
+      } catch (const std::runtime_error& e) {
+        log << "warning: could not write cache entry: " << e.what() << std::endl;
+      }
+    }
+  }
+
+  result.triangles = std::move(flatMesh.triangles);
+
+  if (options.preserveVertexIndices) {
+    result.L = scatterToInputVertices(result.L, result.vertexIndices, nInputVertices);
+    result.M = scatterToInputVertices(result.M, result.vertexIndices, nInputVertices);
+  }
+}
+
+} // namespace
+
+
+void requirePolygons(TuftedLaplacianResult& result) {
+  if (result.triangleMesh.polygons.empty()) result.triangleMesh.polygons = polygonsOfTriangles(result.triangles);
+}
+
+TuftedLaplacianResult buildTuftedLaplacianFromPolygonMesh(SimplePolygonMesh inputMesh,
+                                                          const TuftedLaplacianOptions& options) {
+
+  std::ostream nullLog(nullptr);
+  std::ostream& log = options.log ? *options.log : nullLog;
+
+  TuftedLaplacianResult result;
+  size_t nInputVertices = inputMesh.vertexCoordinates.size();
+  SanitizedMesh sanitized;
+
+  // if it's a point cloud, generate some triangles (large clouds are handled tile by tile, start to finish)
+  result.isPointCloud = inputMesh.polygons.empty();
+  if (result.isPointCloud && options.tilePoints > 0 && nInputVertices > options.tilePoints) {
+    buildTiledPointCloudLaplacian(inputMesh.vertexCoordinates, options, log, result);
+    return result;
+  }
+  if (result.isPointCloud) {
+    std::vector<std::array<size_t, 3>> cloudTriangles =
+        triangulatePointCloud(inputMesh.vertexCoordinates, options, log, result.faceScales);
+    sanitized = sanitizeTriangles(inputMesh.vertexCoordinates, cloudTriangles, options.nThreads);
+    if (!result.faceScales.empty() && sanitized.nDroppedFaces > 0) {
+      throw std::runtime_error("point cloud triangles should never repeat a vertex");
+    }
+  } else {
+    // make sure the input really is a triangle mesh
+    sanitized = sanitizePolygons(inputMesh.vertexCoordinates, inputMesh.polygons, options.nThreads);
+  }
+  inputMesh = SimplePolygonMesh(); // (no longer needed)
+
+  buildOnSanitizedMesh(sanitized, nInputVertices, options, log, result);
+  return result;
+}
+
+template <typename IndexT>
+TuftedLaplacianResult buildTuftedLaplacianFromMesh(const double* vertexPositions, size_t nVertices,
+                                                   const IndexT* faceIndices, size_t nFaces, size_t faceDegree,
+                                                   const TuftedLaplacianOptions& options) {
+  if (nFaces == 0) {
+    return buildTuftedLaplacianFromPoints(vertexPositions, nVertices, options);
+  }
+  if (faceDegree < 3) {
+    throw std::runtime_error("faces must have at least 3 vertices");
+  }
+
+  std::ostream nullLog(nullptr);
+  std::ostream& log = options.log ? *options.log : nullLog;
+
+  TuftedLaplacianResult result;
+  SanitizedMesh sanitized =
+      sanitizeFaces(vertexPositions, nVertices, faceIndices, nFaces, faceDegree, options.nThreads);
+  buildOnSanitizedMesh(sanitized, nVertices, options, log, result);
+  return result;
+}
+
+template TuftedLaplacianResult buildTuftedLaplacianFromMesh(const double*, size_t, const int32_t*, size_t, size_t,
+                                                            const TuftedLaplacianOptions&);
+template TuftedLaplacianResult buildTuftedLaplacianFromMesh(const double*, size_t, const uint32_t*, size_t, size_t,
+                                                            const TuftedLaplacianOptions&);
+template TuftedLaplacianResult buildTuftedLaplacianFromMesh(const double*, size_t, const int64_t*, size_t, size_t,
+                                                            const TuftedLaplacianOptions&);
+template TuftedLaplacianResult buildTuftedLaplacianFromMesh(const double*, size_t, const uint64_t*, size_t, size_t,
+                                                            const TuftedLaplacianOptions&);
+
+TuftedLaplacianResult buildTuftedLaplacianFromPoints(const double* pointPositions, size_t nPoints,
+                                                     const TuftedLaplacianOptions& options) {
+  SimplePolygonMesh cloud;
+  cloud.vertexCoordinates.resize(nPoints);
+  for (size_t iV = 0; iV < nPoints; iV++) {
+    const double* p = pointPositions + 3 * iV;
+    cloud.vertexCoordinates[iV] = Vector3{p[0], p[1], p[2]};
+  }
+  return buildTuftedLaplacianFromPolygonMesh(std::move(cloud), options);
+}
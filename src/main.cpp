@@ -1,5 +1,12 @@
-#include "bubble_offset.h"
+#include "batch_utilities.h"
+#include "instrumentation.h"
+#include "laplacian_builder.h"
+#include "matrix_io.h"
+#include "mesh_io.h"
+#include "parallel_utilities.h"
+#include "partitioned_laplacian.h"
 #include "point_cloud_utilities.h"
+#include "spectral_solves.h"
 
 #include "geometrycentral/numerical/linear_algebra_utilities.h"
 #include "geometrycentral/surface/edge_length_geometry.h"
@@ -10,17 +17,27 @@
 #include "geometrycentral/surface/signpost_intrinsic_triangulation.h"
 #include "geometrycentral/surface/simple_polygon_mesh.h"
 #include "geometrycentral/surface/surface_mesh.h"
+#include "geometrycentral/surface/trace_geodesic.h"
 #include "geometrycentral/surface/tufted_laplacian.h"
 #include "geometrycentral/surface/vertex_position_geometry.h"
 
+#include "args/args.hxx"
+
+#ifdef TUFTED_WITH_GUI
+#include "bubble_offset.h"
+
 #include "polyscope/curve_network.h"
 #include "polyscope/point_cloud.h"
 #include "polyscope/polyscope.h"
 #include "polyscope/surface_mesh.h"
 
-#include "args/args.hxx"
 #include "imgui.h"
+#endif
 
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <random>
 #include <sstream>
 
 using namespace geometrycentral;
@@ -30,38 +47,92 @@ using namespace geometrycentral::surface;
 std::unique_ptr<SurfaceMesh> mesh;
 std::unique_ptr<VertexPositionGeometry> geometry;
 
+#ifdef TUFTED_WITH_GUI
 // used only during visualization
 std::unique_ptr<SurfaceMesh> tuftedMesh;
 std::unique_ptr<ManifoldSurfaceMesh> manifoldTuftedMesh;
 std::unique_ptr<VertexPositionGeometry> tuftedGeom;
 std::unique_ptr<EdgeLengthGeometry> tuftedIntrinsicGeom;
 std::unique_ptr<SignpostIntrinsicTriangulation> signpostTri;
+#endif
 
 // Parameters
 float mollifyFactor = 0.;
 bool isPointCloud = false;
 unsigned int nNeigh = 30;
+size_t nThreads = 1;
+bool referencePointCloud = false;
+NormalEstimator normalEstimator = NormalEstimator::SVD;
+LocalTriangulator localTriangulator = LocalTriangulator::Voronoi;
+bool checkLocalTriangulator = false;
+bool dedupTriangles = false;
+CoverBuilder coverBuilder = CoverBuilder::GeometryCentral;
+bool manifoldFastPath = true;
+size_t tilePoints = 0;
+bool referenceLoader = false;
+bool preserveVertexIndices = false;
+std::string cacheDirectory;
+
+// Output parameters
+bool writeLaplacian = false;
+bool writeMass = false;
+bool writeMapped = false;
+MatrixFormat matrixFormat = MatrixFormat::SPMAT;
+bool singlePrecision = false;
+
+// Solve parameters
+unsigned int nEigs = 0;
+bool heatSolve = false;
+unsigned int heatSource = 0;
+double heatTimeFactor = 1.;
 
 // Viz Parameters
 bool withGUI = true;
+#ifdef TUFTED_WITH_GUI
 float bubbleScale = .2;
 int subdivLevel = 2;
 int pointsPerTriEdge = 10;
+int maxBubbleFaces = 2000000; // the subdivision level is lowered to stay under this many bubble faces
+int regionFace = -1;          // if >= 0, only the faces of the cover nearest this one are shown, in full detail
+int maxTracedEdges = 100000;  // at most this many intrinsic edges are traced
+int edgesPerFrame = 2000;     // traced per frame, in the background, while the intrinsic edges are shown
+bool showIntrinsicEdges = false;
 polyscope::SurfaceMesh* psMesh = nullptr;
 
-// This re-runs the whole tufted cover algorithm, but does extra processing to separate out vertex tangent spaces so
-// that we can use signposts, trace edges, and make some visualizations.
-void generateVertexSeparatedTuftedCover() {
-
-  // Create a copy of the mesh / geometry to operate on
-  tuftedMesh = mesh->copyToSurfaceMesh();
-  geometry->requireVertexPositions();
-  tuftedGeom.reset(new VertexPositionGeometry(*tuftedMesh, geometry->vertexPositions.reinterpretTo(*tuftedMesh)));
-  tuftedGeom->requireEdgeLengths();
-  EdgeData<double> tuftedEdgeLengths = tuftedGeom->edgeLengths;
-
-  // Build the cover
-  buildIntrinsicTuftedCover(*tuftedMesh, tuftedEdgeLengths, tuftedGeom.get());
+// Intrinsic edges are traced a few at a time, across frames, only once they are shown. This holds the progress so far,
+// and is reset by generateVisualization().
+struct EdgeTracing {
+  std::vector<Edge> edges; // of the signpost triangulation, in the order they will be traced
+  size_t nTraced = 0;
+  std::unique_ptr<BubbleOffset> bubbleOffset;
+  std::vector<polyscope::Quantity*> quantities; // one per traced batch, so that each frame only registers its own lines
+};
+EdgeTracing edgeTracing;
+
+// This takes the tufted cover, but does extra processing to separate out vertex tangent spaces so that we can use
+// signposts, trace edges, and make some visualizations. The cover the Laplacian was built on is reused if `result` kept
+// it (see TuftedLaplacianOptions::keepTuftedCover); otherwise the whole tufted cover algorithm is re-run.
+void generateVertexSeparatedTuftedCover(TuftedLaplacianResult& result) {
+  TUFTED_TRACE_SCOPE("vertex separated cover");
+
+  EdgeData<double> tuftedEdgeLengths;
+  bool lengthsAreMollified = false;
+  if (result.tuftedCover) {
+    tuftedMesh = std::move(result.tuftedCover);
+    tuftedGeom = std::move(result.tuftedCoverGeometry);
+    tuftedEdgeLengths = result.tuftedCoverEdgeLengths;
+    lengthsAreMollified = true;
+  } else {
+    // Create a copy of the mesh / geometry to operate on
+    tuftedMesh = mesh->copyToSurfaceMesh();
+    geometry->requireVertexPositions();
+    tuftedGeom.reset(new VertexPositionGeometry(*tuftedMesh, geometry->vertexPositions.reinterpretTo(*tuftedMesh)));
+    tuftedGeom->requireEdgeLengths();
+    tuftedEdgeLengths = tuftedGeom->edgeLengths;
+
+    // Build the cover
+    buildIntrinsicTuftedCover(*tuftedMesh, tuftedEdgeLengths, tuftedGeom.get());
+  }
 
   // Split the vertices
   VertexData<Vertex> origVert = tuftedMesh->separateNonmanifoldVertices();
@@ -75,14 +146,20 @@ void generateVertexSeparatedTuftedCover() {
   manifoldTuftedMesh->printStatistics();
   tuftedGeom = tuftedGeom->reinterpretTo(*manifoldTuftedMesh);
   tuftedGeom->requireEdgeLengths();
-  tuftedEdgeLengths = tuftedGeom->edgeLengths;
-
-  // Mollify, if requested
-  if (mollifyFactor > 0) {
-    mollifyIntrinsic(*manifoldTuftedMesh, tuftedEdgeLengths, mollifyFactor);
+  EdgeData<double> manifoldEdgeLengths;
+  if (lengthsAreMollified) {
+    // (splitting vertices leaves the edges as they were, so the lengths carry over)
+    manifoldEdgeLengths = tuftedEdgeLengths.reinterpretTo(*manifoldTuftedMesh);
+  } else {
+    manifoldEdgeLengths = tuftedGeom->edgeLengths;
+
+    // Mollify, if requested
+    if (mollifyFactor > 0) {
+      mollifyIntrinsic(*manifoldTuftedMesh, manifoldEdgeLengths, mollifyFactor);
+    }
   }
 
-  tuftedIntrinsicGeom.reset(new EdgeLengthGeometry(*manifoldTuftedMesh, tuftedEdgeLengths));
+  tuftedIntrinsicGeom.reset(new EdgeLengthGeometry(*manifoldTuftedMesh, manifoldEdgeLengths));
 
 
   // Create a signpost triangulation
@@ -92,122 +169,416 @@ void generateVertexSeparatedTuftedCover() {
   signpostTri->flipToDelaunay();
 }
 
-void generateVisualization() {
-
-  // == Generate the the bubbly mesh visualization
-  std::unique_ptr<SimplePolygonMesh> subSoup =
-      subdivideRounded(*manifoldTuftedMesh, *tuftedGeom, subdivLevel, bubbleScale, 0, 0);
-  auto* bubMesh = polyscope::registerSurfaceMesh("bubble tufted cover", subSoup->vertexCoordinates, subSoup->polygons);
-  bubMesh->setSmoothShade(true);
+// Trace an intrinsic halfedge across the input mesh, as if its length were scaled by `lengthFactor`.
+//
+// A length factor slightly below 1 works around amibiguity in sharedFace() when interpolating along the trace; there
+// could be multiple shared faces at the end, but stopping early helps create a surface point in the one we want. This
+// is the trace SignpostIntrinsicTriangulation::traceHalfedge() does, on a locally scaled copy of the halfedge's vector,
+// so it only reads the triangulation and can run concurrently, as long as the input geometry's quantities the trace
+// needs already exist (see requireTraceQuantities()).
+std::vector<SurfacePoint> traceShortenedHalfedge(const SignpostIntrinsicTriangulation& tri, Halfedge he,
+                                                 double lengthFactor) {
+  Vector2 traceVec = lengthFactor * tri.halfedgeVector(he);
+  TraceOptions options;
+  options.includePath = true;
+  TraceGeodesicResult result = traceGeodesic(tri.inputGeom, tri.vertexLocations[he.tailVertex()], traceVec, options);
+  return result.pathPoints;
+}
 
+// Compute the quantities of the input geometry which traceGeodesic() would otherwise compute lazily, so that
+// concurrent traces only read them
+void requireTraceQuantities(IntrinsicGeometryInterface& inputGeom) {
+  inputGeom.requireEdgeLengths();
+  inputGeom.requireCornerAngles();
+  inputGeom.requireVertexAngleSums();
+  inputGeom.requireHalfedgeVectorsInFace();
+  inputGeom.requireHalfedgeVectorsInVertex();
+}
 
-  // == Trace intrinsic edges across the bubbly mesh
+// Trace the next (up to) nEdges edges of edgeTracing, as lines
+void traceMoreEdges(size_t nEdges, std::vector<std::vector<Vector3>>& lines) {
 
-  BubbleOffset bubbleOffset(*tuftedGeom);
-  bubbleOffset.relativeScale = bubbleScale;
+  std::vector<Edge>& edges = edgeTracing.edges;
+  size_t iFirst = edgeTracing.nTraced;
+  size_t iLast = std::min(edges.size(), iFirst + nEdges);
+  if (iFirst == iLast) return;
+  TUFTED_TRACE_SCOPE("trace edges");
+  TUFTED_TRACE_COUNT("traced edges", iLast - iFirst);
 
-  // Build out the output here
-  SimplePolygonMesh outSoup;
-  std::vector<std::vector<Vector3>> lines;
+  // Interpolation weights between consecutive points of a trace
+  std::vector<double> interpWeights(std::max(pointsPerTriEdge, 0));
+  for (size_t iInterp = 0; iInterp < interpWeights.size(); iInterp++) {
+    interpWeights[iInterp] = static_cast<double>(iInterp + 1) / (pointsPerTriEdge + 1);
+  }
 
-  // Trace the halfedges as lines
-  auto pushLinePoint = [&](SurfacePoint p) {
-    Vector3 newPos = bubbleOffset.queryPoint(p);
-    lines.back().push_back(newPos);
+  // Samples along the lines, gathered per block of edges (so their order does not depend on the thread count), and all
+  // evaluated at once at the end
+  struct LineSamples {
+    std::vector<Face> faces;
+    std::vector<Vector3> baryCoords;
+    std::vector<size_t> lineSizes;
   };
-  for (Edge e : signpostTri->mesh.edges()) {
-    Halfedge he = e.halfedge();
-
-    // This is bit of an ugly hack.
-    // This length factor works around amibiguity in sharedFace() below; there could be multiple
-    // shared faces, but stopping early helps create a surface point in the one we want.
-    double oldLen = signpostTri->intrinsicEdgeLengths[e];
-    signpostTri->intrinsicEdgeLengths[e] *= .999;
+  const size_t edgeBlockSize = 256;
+  std::vector<LineSamples> blockSamples((iLast - iFirst + edgeBlockSize - 1) / edgeBlockSize);
 
-    std::vector<SurfacePoint> points = signpostTri->traceHalfedge(he, false);
-
-    signpostTri->intrinsicEdgeLengths[e] = oldLen; // restore the pre-adjusted length from above
+  // Trace the halfedges as lines
+  requireTraceQuantities(signpostTri->inputGeom);
+  parallelForBlocks(iLast - iFirst, nThreads, edgeBlockSize, [&](size_t iThread, size_t iStart, size_t iEnd) {
+    LineSamples& samples = blockSamples[iStart / edgeBlockSize];
+    auto pushLinePoint = [&](SurfacePoint p) {
+      SurfacePoint faceP = p.inSomeFace();
+      samples.faces.push_back(faceP.face);
+      samples.baryCoords.push_back(faceP.faceCoords);
+    };
+
+    for (size_t iE = iFirst + iStart; iE < iFirst + iEnd; iE++) {
+      std::vector<SurfacePoint> points = traceShortenedHalfedge(*signpostTri, edges[iE].halfedge(), .999);
+      size_t lineStart = samples.faces.size();
+
+      // = first point
+      pushLinePoint(points.front());
+
+      for (size_t i = 0; i + 1 < points.size(); i++) {
+
+        // = interpolation between
+        SurfacePoint& pA = points[i];
+        SurfacePoint& pB = points[i + 1];
+
+        // get both points in some face
+        Face sharedF = sharedFace(pA, pB);
+        SurfacePoint pAF = pA.inFace(sharedF);
+        SurfacePoint pBF = pB.inFace(sharedF);
+
+        for (double tInterp : interpWeights) {
+          Vector3 baryInterp = (1. - tInterp) * pAF.faceCoords + tInterp * pBF.faceCoords;
+          pushLinePoint(SurfacePoint(sharedF, baryInterp));
+        }
+
+        // = next point
+        pushLinePoint(pB);
+      }
 
-    lines.emplace_back();
+      samples.lineSizes.push_back(samples.faces.size() - lineStart);
+    }
+  });
 
-    // = first point
-    pushLinePoint(points.front());
+  std::vector<Face> sampleFaces;
+  std::vector<Vector3> sampleBaryCoords;
+  for (const LineSamples& samples : blockSamples) {
+    sampleFaces.insert(sampleFaces.end(), samples.faces.begin(), samples.faces.end());
+    sampleBaryCoords.insert(sampleBaryCoords.end(), samples.baryCoords.begin(), samples.baryCoords.end());
+  }
+  std::vector<Vector3> samplePositions;
+  edgeTracing.bubbleOffset->queryFacePoints(sampleFaces, sampleBaryCoords, samplePositions, nThreads);
+
+  lines.clear();
+  size_t iSample = 0;
+  for (const LineSamples& samples : blockSamples) {
+    for (size_t lineSize : samples.lineSizes) {
+      lines.emplace_back(samplePositions.begin() + iSample, samplePositions.begin() + iSample + lineSize);
+      iSample += lineSize;
+    }
+  }
+  edgeTracing.nTraced = iLast;
+}
 
-    for (size_t i = 0; i + 1 < points.size(); i++) {
+void generateVisualization() {
+  TUFTED_TRACE_SCOPE("visualization");
+
+  // == Choose the faces to show
+  //
+  // Either every face, at as many subdivision rounds as fit in the face budget, or the faces nearest regionFace (in
+  // breadth-first order), as many as fit in the budget at the full subdivision level.
+  int nRounds = std::min(std::max(subdivLevel, 0), 15);
+  size_t faceBudget = std::max(maxBubbleFaces, 1);
+  std::vector<Face> faces;
+  if (regionFace >= 0 && static_cast<size_t>(regionFace) < manifoldTuftedMesh->nFaces()) {
+    size_t maxFaces = std::max(faceBudget >> (2 * nRounds), static_cast<size_t>(1));
+    std::vector<char> isQueued(manifoldTuftedMesh->nFaces(), false);
+    faces.push_back(manifoldTuftedMesh->face(regionFace));
+    isQueued[regionFace] = true;
+    for (size_t iNext = 0; iNext < faces.size() && faces.size() < maxFaces; iNext++) {
+      for (Halfedge he : faces[iNext].adjacentHalfedges()) {
+        if (!he.twin().isInterior()) continue;
+        Face neighF = he.twin().face();
+        if (isQueued[neighF.getIndex()] || faces.size() == maxFaces) continue;
+        isQueued[neighF.getIndex()] = true;
+        faces.push_back(neighF);
+      }
+    }
+  } else {
+    for (Face f : manifoldTuftedMesh->faces()) faces.push_back(f);
+    while (nRounds > 0 && (faces.size() << (2 * nRounds)) > faceBudget) nRounds--;
+    if (nRounds < subdivLevel) {
+      std::cout << "  (subdividing " << nRounds << " rounds, to stay within " << faceBudget << " bubble faces)"
+                << std::endl;
+    }
+  }
 
-      // = interpolation between
-      SurfacePoint& pA = points[i];
-      SurfacePoint& pB = points[i + 1];
+  // == Generate the the bubbly mesh visualization
+  std::unique_ptr<SimplePolygonMesh> subSoup =
+      subdivideRounded(*manifoldTuftedMesh, *tuftedGeom, faces, nRounds, bubbleScale, 0, 0, nThreads);
+  auto* bubMesh = polyscope::registerSurfaceMesh("bubble tufted cover", subSoup->vertexCoordinates, subSoup->polygons);
+  bubMesh->setSmoothShade(true);
 
-      // get both points in some face
-      Face sharedF = sharedFace(pA, pB);
-      SurfacePoint pAF = pA.inFace(sharedF);
-      SurfacePoint pBF = pB.inFace(sharedF);
 
-      for (int iInterp = 0; iInterp < pointsPerTriEdge; iInterp++) {
-        double tInterp = static_cast<double>(iInterp + 1) / (pointsPerTriEdge + 1);
+  // == Prepare to trace intrinsic edges across the bubbly mesh
 
-        Vector3 baryInterp = (1. - tInterp) * pAF.faceCoords + tInterp * pBF.faceCoords;
-        SurfacePoint pInterp(sharedF, baryInterp);
-        pushLinePoint(pInterp);
-      }
+  // (re-registering the mesh removed any old lines)
+  edgeTracing = EdgeTracing();
+  edgeTracing.bubbleOffset.reset(new BubbleOffset(*tuftedGeom));
+  edgeTracing.bubbleOffset->relativeScale = bubbleScale;
 
-      // = next point
-      pushLinePoint(pB);
+  // The intrinsic triangulation has the same vertices as the cover, so edges are kept if both their endpoints are in
+  // one of the shown faces
+  std::vector<char> isShownVertex(manifoldTuftedMesh->nVertices(), false);
+  for (Face f : faces) {
+    for (Vertex v : f.adjacentVertices()) isShownVertex[v.getIndex()] = true;
+  }
+  for (Edge e : signpostTri->mesh.edges()) {
+    if (isShownVertex[e.halfedge().tailVertex().getIndex()] && isShownVertex[e.halfedge().tipVertex().getIndex()]) {
+      edgeTracing.edges.push_back(e);
     }
-
-    // pushLinePoint(SurfacePoint(he.twin().vertex()));
   }
 
-  polyscope::getSurfaceMesh("bubble tufted cover")->addSurfaceGraphQuantity("intrinsic edges", lines)->setEnabled(true);
+  // Over budget, trace a (fixed) random subset, which covers the mesh evenly as it fills in
+  size_t edgeBudget = std::max(maxTracedEdges, 0);
+  if (edgeTracing.edges.size() > edgeBudget) {
+    std::mt19937 randomGen(0);
+    std::shuffle(edgeTracing.edges.begin(), edgeTracing.edges.end(), randomGen);
+    edgeTracing.edges.resize(edgeBudget);
+    std::cout << "  (tracing " << edgeBudget << " of the intrinsic edges)" << std::endl;
+  }
 }
 
 
-template <typename T>
-void saveMatrix(std::string filename, SparseMatrix<T>& matrix) {
+void myCallback() {
 
-  // WARNING: this follows matlab convention and thus is 1-indexed
+  ImGui::PushItemWidth(100);
 
-  std::cout << "Writing sparse matrix to: " << filename << std::endl;
+  ImGui::TextUnformatted("Visualization:");
+  ImGui::SliderFloat("bubble magnitude", &bubbleScale, .0, .5);
+  ImGui::InputInt("bubble subivsion rounds", &subdivLevel);
+  ImGui::InputInt("traced edge resolution", &pointsPerTriEdge);
+  ImGui::InputInt("max bubble faces", &maxBubbleFaces);
+  ImGui::InputInt("region around face (-1 for all)", &regionFace);
+  ImGui::InputInt("max traced edges", &maxTracedEdges);
 
-  std::ofstream outFile(filename);
-  if (!outFile) {
-    throw std::runtime_error("failed to open output file " + filename);
+  if (ImGui::Button("Regenerate visualization")) {
+    generateVisualization();
   }
 
-  // Write a comment on the first line giving the dimensions
-  // outFile << "# sparse " << matrix.rows() << " " << matrix.cols() << std::endl;
+  // == Intrinsic edges, traced progressively while shown
+  if (ImGui::Checkbox("show intrinsic edges", &showIntrinsicEdges)) {
+    for (polyscope::Quantity* quantity : edgeTracing.quantities) quantity->setEnabled(showIntrinsicEdges);
+  }
+  ImGui::InputInt("edges traced per frame", &edgesPerFrame);
+  if (showIntrinsicEdges && edgeTracing.nTraced < edgeTracing.edges.size()) {
+    std::vector<std::vector<Vector3>> lines;
+    traceMoreEdges(std::max(edgesPerFrame, 1), lines);
+    std::string name = "intrinsic edges " + std::to_string(edgeTracing.quantities.size());
+    edgeTracing.quantities.push_back(
+        polyscope::getSurfaceMesh("bubble tufted cover")->addSurfaceGraphQuantity(name, lines)->setEnabled(true));
+  }
+  if (showIntrinsicEdges) {
+    ImGui::Text("traced %zu / %zu edges", edgeTracing.nTraced, edgeTracing.edges.size());
+  }
 
-  outFile << std::setprecision(16);
 
-  for (int k = 0; k < matrix.outerSize(); ++k) {
-    for (typename SparseMatrix<T>::InnerIterator it(matrix, k); it; ++it) {
-      T val = it.value();
-      size_t iRow = it.row();
-      size_t iCol = it.col();
+  ImGui::PopItemWidth();
+}
+#endif // TUFTED_WITH_GUI
+
+// Write an output matrix in the selected format and precision. Single precision rounds each entry once, so it is within
+// a relative 2^-24 of the double value.
+void saveOutputMatrix(const std::string& filename, const SparseMatrix<double>& matrix, std::ostream& log) {
+  log << "Writing sparse matrix to: " << filename << std::endl;
+  TUFTED_TRACE_COUNT("nonzeros written", matrix.nonZeros());
+  if (singlePrecision) {
+    saveMatrix<float>(filename, matrix, matrixFormat);
+  } else {
+    saveMatrix<double>(filename, matrix, matrixFormat);
+  }
+}
+
+// The builder options for the parameters above
+TuftedLaplacianOptions makeBuilderOptions(size_t inputThreads, std::ostream& log) {
+  TuftedLaplacianOptions options;
+  options.mollifyFactor = mollifyFactor;
+  options.nNeigh = nNeigh;
+  options.normalEstimator = normalEstimator;
+  options.localTriangulator = localTriangulator;
+  options.dedupTriangles = dedupTriangles;
+  options.coverBuilder = coverBuilder;
+  options.manifoldFastPath = manifoldFastPath;
+  options.tilePoints = tilePoints;
+  options.referencePointCloud = referencePointCloud;
+  options.checkLocalTriangulator = checkLocalTriangulator;
+  options.nThreads = inputThreads;
+  options.preserveVertexIndices = preserveVertexIndices;
+  options.cacheDirectory = cacheDirectory;
+  options.keepTuftedCover = withGUI; // (reused by the visualization)
+  options.log = &log;
+  return options;
+}
 
-      outFile << (iRow + 1) << " " << (iCol + 1) << " " << val << std::endl;
+// Run the whole pipeline on one input file: triangulate it if it is a point cloud, build the tufted Laplacian, and
+// write the requested output files with the given prefix. Uses the parameters above, except for the thread count.
+// Progress is reported to `log`, failures are thrown.
+TuftedLaplacianResult processInput(const std::string& filename, const std::string& outputPrefix, size_t inputThreads,
+                                   std::ostream& log) {
+
+  TuftedLaplacianOptions options = makeBuilderOptions(inputThreads, log);
+
+  // Load mesh, and build the operators
+  TuftedLaplacianResult result;
+  FlatTriangleMesh flatMesh;
+  SimplePolygonMesh polygonMesh;
+  bool isFlat;
+  {
+    TUFTED_TRACE_SCOPE("load");
+    isFlat = !referenceLoader && loadFlatMesh(filename, flatMesh, inputThreads);
+    if (!isFlat) polygonMesh = SimplePolygonMesh(filename);
+  }
+  if (isFlat) {
+    result = buildTuftedLaplacianFromMesh(flatMesh.vertexPositions.data(), flatMesh.nVertices(),
+                                          flatMesh.triangles.data(), flatMesh.nTriangles(), 3, options);
+  } else {
+    result = buildTuftedLaplacianFromPolygonMesh(std::move(polygonMesh), options);
+  }
+
+  // write output matrices, if requested
+  {
+    TUFTED_TRACE_SCOPE("outputs");
+    if (writeLaplacian) {
+      saveOutputMatrix(outputPrefix + "laplacian." + matrixFormatExtension(matrixFormat), result.L, log);
+    }
+    if (writeMass) {
+      saveOutputMatrix(outputPrefix + "lumped_mass." + matrixFormatExtension(matrixFormat), result.M, log);
+    }
+    if (writeMapped) {
+      log << "Writing mapped operators to: " << outputPrefix << "operators.mmap" << std::endl;
+      TUFTED_TRACE_COUNT("nonzeros written", result.L.nonZeros() + result.M.nonZeros());
+      saveOperatorsMapped(outputPrefix + "operators.mmap", result.L, result.M);
+    }
+  }
+
+  // run solves, if requested
+  if (nEigs > 0) {
+    TUFTED_TRACE_SCOPE("eigenpairs");
+    Eigen::VectorXd eigenvalues;
+    Eigen::MatrixXd eigenvectors;
+    if (!smallestEigenpairs(result.L, result.M, nEigs, eigenvalues, eigenvectors, inputThreads)) {
+      log << "WARNING: eigenpairs did not fully converge" << std::endl;
+    }
+    saveDenseMatrix(outputPrefix + "eigenvalues.txt", eigenvalues);
+    saveDenseMatrix(outputPrefix + "eigenvectors.txt", eigenvectors);
+  }
+  if (heatSolve) {
+    TUFTED_TRACE_SCOPE("heat solve");
+    if (heatSource >= result.L.rows()) {
+      throw std::runtime_error("heat source " + std::to_string(heatSource) + " is out of range");
+    }
+    double h = meanEdgeLength(result.triangleMesh.vertexCoordinates, result.triangles);
+    if (!(h > 0.)) { // (tiled point clouds do not keep their triangles)
+      throw std::runtime_error("no triangles to choose the heat solve time step from");
     }
+    HeatSolver heatSolver(result.L, result.M, heatTimeFactor * h * h);
+    Eigen::VectorXd u0 = Eigen::VectorXd::Zero(result.L.rows());
+    u0[heatSource] = 1.;
+    saveDenseMatrix(outputPrefix + "heat.txt", heatSolver.diffuse(u0));
   }
 
-  outFile.close();
+  return result;
 }
 
-void myCallback() {
+// Stop recording the trace, if there is one (see --trace), and write it out
+void finishTracing(const std::string& traceFilename) {
+#ifdef TUFTED_ENABLE_TRACING
+  if (traceFilename.empty()) return;
+  try {
+    stopTracing(traceFilename);
+    std::cout << "wrote trace to " << traceFilename << std::endl;
+  } catch (const std::runtime_error& e) {
+    std::cerr << e.what() << std::endl;
+  }
+#endif
+}
 
-  ImGui::PushItemWidth(100);
+// Build one partition of an input file (see partitioned_laplacian.h), writing its block to blockFilename
+void processPartition(const std::string& filename, size_t nPartitions, size_t iPartition, size_t ghostRings,
+                      const std::string& blockFilename) {
+  TuftedLaplacianOptions options = makeBuilderOptions(nThreads, std::cout);
+  FlatTriangleMesh flatMesh;
+  if (!referenceLoader && loadFlatMesh(filename, flatMesh, nThreads)) {
+    buildTuftedLaplacianPartition(flatMesh.vertexPositions.data(), flatMesh.nVertices(), flatMesh.triangles.data(),
+                                  flatMesh.nTriangles(), 3, nPartitions, iPartition, ghostRings, blockFilename,
+                                  options);
+  } else {
+    buildTuftedLaplacianPartition(SimplePolygonMesh(filename), nPartitions, iPartition, ghostRings, blockFilename,
+                                  options);
+  }
+}
 
-  ImGui::TextUnformatted("Visualization:");
-  ImGui::SliderFloat("bubble magnitude", &bubbleScale, .0, .5);
-  ImGui::InputInt("bubble subivsion rounds", &subdivLevel);
-  ImGui::InputInt("traced edge resolution", &pointsPerTriEdge);
+// Process every input of a batch (see listBatchInputs()), returning the number which failed. Inputs at least
+// `largeInputBytes` in size are processed one at a time, each using all threads; the rest are processed concurrently,
+// one per thread.
+size_t runBatch(const std::vector<BatchInput>& inputs, size_t largeInputBytes) {
+
+  std::vector<size_t> order(inputs.size());
+  for (size_t i = 0; i < order.size(); i++) order[i] = i;
+  std::stable_sort(order.begin(), order.end(),
+                   [&](size_t iA, size_t iB) { return inputs[iA].fileBytes > inputs[iB].fileBytes; });
+  size_t nLarge = 0;
+  while (nLarge < order.size() && inputs[order[nLarge]].fileBytes >= largeInputBytes) nLarge++;
+
+  std::vector<std::string> status(inputs.size());
+  std::mutex outputMutex;
+  size_t nFinished = 0;
+
+  auto processOne = [&](size_t iInput, size_t inputThreads) {
+    const BatchInput& input = inputs[iInput];
+    std::ostringstream log;
+    std::ostringstream line;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    try {
+      TuftedLaplacianResult result = processInput(input.filename, input.outputPrefix, inputThreads, log);
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      line << "[ok] " << input.filename << " (" << result.triangleMesh.vertexCoordinates.size() << " vertices, "
+           << result.triangles.size() / 3 << " faces, " << seconds << "s)";
+    } catch (const std::exception& e) {
+      line << "[FAILED] " << input.filename << ": " << e.what();
+    } catch (...) {
+      line << "[FAILED] " << input.filename << ": unknown error";
+    }
+    status[iInput] = line.str();
 
-  if (ImGui::Button("Regenerate visualization")) {
-    generateVisualization();
+    std::lock_guard<std::mutex> lock(outputMutex);
+    nFinished++;
+    std::cout << "(" << nFinished << " / " << inputs.size() << ") " << status[iInput] << std::endl;
+    if (status[iInput].compare(0, 4, "[ok]") != 0 && !log.str().empty()) {
+      std::cout << log.str();
+    }
+  };
+
+  // Large inputs: one at a time, parallel within the input
+  for (size_t i = 0; i < nLarge; i++) {
+    processOne(order[i], nThreads);
   }
 
+  // Small inputs: one per thread
+  parallelForBlocks(order.size() - nLarge, nThreads, 1, [&](size_t iThread, size_t iStart, size_t iEnd) {
+    for (size_t i = iStart; i < iEnd; i++) processOne(order[nLarge + i], 1);
+  });
 
-  ImGui::PopItemWidth();
+  size_t nFailed = 0;
+  std::cout << "\nBatch summary:" << std::endl;
+  for (const std::string& line : status) {
+    std::cout << "  " << line << std::endl;
+    if (line.compare(0, 4, "[ok]") != 0) nFailed++;
+  }
+  std::cout << (inputs.size() - nFailed) << " / " << inputs.size() << " inputs succeeded" << std::endl;
+  return nFailed;
 }
 
 int main(int argc, char** argv) {
@@ -221,12 +592,43 @@ int main(int argc, char** argv) {
   args::Group algorithmOptions(parser, "algorithm options");
   args::ValueFlag<double> mollifyFactorArg(algorithmOptions, "mollifyFactor", "Amount of intrinsic mollification to perform, which gives robustness to degenerate triangles. Defined relative to the mean edge length. Default: 1e-6", {"mollifyFactor"}, 1e-6);
   args::ValueFlag<unsigned int> nNeighArg(algorithmOptions, "nNeigh", "Number of neighbors to use for point cloud Laplacian (usually does not need to be changed). Default: 30", {"nNeigh"}, 30);
+  args::Flag referencePointCloudArg(algorithmOptions, "referencePointCloud", "Triangulate point clouds with the unfused reference implementation, which materializes each step for all points. Slower, only useful for comparison.", {"referencePointCloud"});
+  args::ValueFlag<std::string> normalEstimatorArg(algorithmOptions, "normalEstimator", "How to estimate point cloud normals, one of 'svd' or 'covariance'. Both give the same normals up to roundoff, 'covariance' is faster. Default: svd", {"normalEstimator"}, "svd");
+  args::ValueFlag<std::string> localTriangulatorArg(algorithmOptions, "localTriangulator", "How to build the local Delaunay triangulation of each point cloud neighborhood, one of 'voronoi' (full Voronoi diagram) or 'star' (only the cell of the center point, much faster). Default: voronoi", {"localTriangulator"}, "voronoi");
+  args::Flag checkLocalTriangulatorArg(algorithmOptions, "checkLocalTriangulator", "Also triangulate point cloud neighborhoods with the 'voronoi' triangulator, and report how the selected one differs from it.", {"checkLocalTriangulator"});
+  args::Flag dedupTrianglesArg(algorithmOptions, "dedupTriangles", "Merge the copies of each point cloud triangle found by neighboring points before building the Laplacian, weighting each triangle by the number of copies / 3, rather than keeping them all and dividing the result by 3. Much less work, and the same total mass, but the operators differ slightly: the tufted cover sees one face rather than its copies, and edges between triangles of different weights are not flipped.", {"dedupTriangles"});
+  args::ValueFlag<std::string> coverBuilderArg(algorithmOptions, "coverBuilder", "How to build the tufted cover, one of 'geometry-central' (buildIntrinsicTuftedCover) or 'flat' (from sorted flat arrays, in parallel, and so scales with --threads). Both give the same result up to roundoff. Default: geometry-central", {"coverBuilder"}, "geometry-central");
+  args::Flag alwaysBuildCoverArg(algorithmOptions, "alwaysBuildCover", "Always build the tufted cover. By default, meshes which are edge-manifold and already intrinsic Delaunay skip it, and get the cotan Laplacian directly (the same result up to roundoff, much faster).", {"alwaysBuildCover"});
+  args::ValueFlag<size_t> tilePointsArg(algorithmOptions, "tilePoints", "Build the Laplacian of point clouds with more than this many points in spatial tiles of (at most) this size, each with a halo of neighboring points, so that memory is bounded by the tile size. Matches the untiled result except for small differences near tile boundaries, and, when --mollifyFactor changes any edge lengths, everywhere (mollification is computed per tile). Default: 0 (no tiling)", {"tilePoints"}, 0);
+  args::Flag referenceLoaderArg(algorithmOptions, "referenceLoader", "Load inputs with geometry-central's general mesh loader, instead of the fast loader used for .obj, binary .ply and .tmesh files. Slower, only useful for comparison.", {"referenceLoader"});
+  args::ValueFlag<std::string> cacheDirArg(algorithmOptions, "cacheDir", "Cache the final operators in this directory, keyed by a hash of the sanitized mesh and the algorithm options. Later runs on the same input load them from the cache instead of rebuilding them. Default: no cache", {"cacheDir"});
+  args::ValueFlag<unsigned int> threadsArg(algorithmOptions, "threads", "Number of threads to use for point cloud processing, 0 uses all hardware threads. The output does not depend on this. Default: 1", {"threads"}, 1);
 
   args::Group output(parser, "ouput");
   args::Flag gui(output, "gui", "open a GUI after processing and generate some visualizations", {"gui"});
   args::ValueFlag<std::string> outputPrefixArg(output, "outputPrefix", "Prefix to prepend to output file paths. Default: tufted_", {"outputPrefix"}, "tufted_");
-  args::Flag writeLaplacian(output, "writeLaplacian", "Write out the resulting (weak) Laplacian as a sparse matrix. name: 'laplacian.spmat'", {"writeLaplacian"});
-  args::Flag writeMass(output, "writeMass", "Write out the resulting diagonal lumped mass matrix sparse matrix. name: 'lumped_mass.spmat'", {"writeMass"});
+  args::Flag writeLaplacianArg(output, "writeLaplacian", "Write out the resulting (weak) Laplacian as a sparse matrix. name: 'laplacian.spmat'", {"writeLaplacian"});
+  args::Flag writeMassArg(output, "writeMass", "Write out the resulting diagonal lumped mass matrix sparse matrix. name: 'lumped_mass.spmat'", {"writeMass"});
+  args::Flag preserveVertexIndicesArg(output, "preserveVertexIndices", "Index the rows and columns of the output matrices by input vertex. By default, vertices which are not used by any face are removed and the remaining ones renumbered; with this flag they are kept, with empty rows and columns.", {"preserveVertexIndices"});
+  args::Flag writeMappedArg(output, "writeMapped", "Write out the Laplacian (as raw CSC arrays) and the diagonal of the mass matrix together in a single file which can be memory-mapped directly. name: 'operators.mmap'", {"writeMapped"});
+  args::ValueFlag<std::string> precisionArg(output, "precision", "Value type of the output matrices, one of 'double' or 'float' (32-bit values, halving their size; each entry is within a relative 2^-24 of the double value). Indices are always 32-bit. Does not affect --writeMapped. Default: double", {"precision"}, "double");
+  args::ValueFlag<std::string> traceArg(output, "trace", "Record where the time goes (each stage, and counters such as local triangulations, degenerate neighbor perturbations, Delaunay flips and nonzeros written), and write it to this file as Chrome trace JSON, for chrome://tracing or ui.perfetto.dev. Only available when built with TUFTED_WITH_TRACING=ON. Default: no trace", {"trace"});
+  args::ValueFlag<std::string> matrixFormatArg(output, "matrixFormat", "File format for output matrices, one of 'spmat' (1-indexed ascii 'row col value' lines), 'bin' (raw binary CSC arrays), 'mtx' (Matrix Market) or 'npz' (numpy COO triplets, for scipy.sparse.load_npz). The file extension follows the format. Default: spmat", {"matrixFormat"}, "spmat");
+
+  args::Group solveOptions(parser, "solves");
+  args::ValueFlag<unsigned int> eigsArg(solveOptions, "eigs", "Compute the K smallest generalized eigenpairs L phi = lambda M phi, and write them out (instead of, or as well as, the matrices). names: 'eigenvalues.txt', 'eigenvectors.txt' (one column per eigenvector)", {"eigs"}, 0);
+  args::Flag heatSolveArg(solveOptions, "heatSolve", "Diffuse heat from one vertex for a single backward Euler step, solving (M + t L) u = M u0, and write out u. name: 'heat.txt'", {"heatSolve"});
+  args::ValueFlag<unsigned int> heatSourceArg(solveOptions, "heatSource", "Index of the heat source vertex, as a row of the output matrices. Default: 0", {"heatSource"}, 0);
+  args::ValueFlag<double> heatTimeArg(solveOptions, "heatTime", "Heat solve time step t, as a multiple of the squared mean edge length. Default: 1", {"heatTime"}, 1.);
+
+  args::Group partitionOptions(parser, "partitioned builds");
+  args::ValueFlag<unsigned int> partitionsArg(partitionOptions, "partitions", "Build only one of this many spatial partitions of the mesh, for building very large meshes on several machines (or in several processes), and write its entries to a block file instead of the outputs above. Combine the blocks of all partitions with tufted-merge. name: 'partition_<I>.tblk'", {"partitions"});
+  args::ValueFlag<unsigned int> partitionArg(partitionOptions, "partition", "Index of the partition to build, from 0 to partitions - 1. Default: 0", {"partition"}, 0);
+  args::ValueFlag<unsigned int> ghostRingsArg(partitionOptions, "ghostRings", "Number of rings of faces around each partition to include in its build, so that its intrinsic Delaunay flips match the whole mesh. Default: 3", {"ghostRings"}, 3);
+
+  args::Group batchOptions(parser, "batch processing");
+  args::ValueFlag<std::string> batchArg(batchOptions, "batch", "Process many inputs in one run, instead of the single mesh argument. Either a directory (all .obj/.ply/.off/.stl/.tmesh files in it) or a manifest file listing one input path per line. Outputs for each input are prefixed with outputPrefix + the input's name + '_'. A failing input does not stop the batch.", {"batch"});
+  args::ValueFlag<double> batchLargeInputMBArg(batchOptions, "batchLargeInputMB", "In batch mode, inputs at least this large (in MB on disk) are processed one at a time using all threads; smaller inputs are processed concurrently, one per thread. Default: 64", {"batchLargeInputMB"}, 64.);
   // clang-format on
 
   // Parse args
@@ -242,75 +644,149 @@ int main(int argc, char** argv) {
   }
 
   // Make sure a mesh name was given
-  if (!inputFilename) {
+  if (!inputFilename && !batchArg) {
     std::cout << parser;
     return EXIT_FAILURE;
   }
 
   // Set options
   withGUI = gui;
+#ifndef TUFTED_WITH_GUI
+  if (withGUI) {
+    std::cerr << "the GUI is not available, tufted-idt was built with TUFTED_WITH_GUI=OFF" << std::endl;
+    return EXIT_FAILURE;
+  }
+#endif
   mollifyFactor = args::get(mollifyFactorArg);
   nNeigh = args::get(nNeighArg);
+  nThreads = args::get(threadsArg);
+  referencePointCloud = referencePointCloudArg;
+  std::string normalEstimatorName = args::get(normalEstimatorArg);
+  if (normalEstimatorName == "svd") {
+    normalEstimator = NormalEstimator::SVD;
+  } else if (normalEstimatorName == "covariance") {
+    normalEstimator = NormalEstimator::Covariance;
+  } else {
+    std::cerr << "unrecognized normal estimator: " << normalEstimatorName << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::string localTriangulatorName = args::get(localTriangulatorArg);
+  if (localTriangulatorName == "voronoi") {
+    localTriangulator = LocalTriangulator::Voronoi;
+  } else if (localTriangulatorName == "star") {
+    localTriangulator = LocalTriangulator::Star;
+  } else {
+    std::cerr << "unrecognized local triangulator: " << localTriangulatorName << std::endl;
+    return EXIT_FAILURE;
+  }
+  checkLocalTriangulator = checkLocalTriangulatorArg;
+  dedupTriangles = dedupTrianglesArg;
+  std::string coverBuilderName = args::get(coverBuilderArg);
+  if (coverBuilderName == "geometry-central") {
+    coverBuilder = CoverBuilder::GeometryCentral;
+  } else if (coverBuilderName == "flat") {
+    coverBuilder = CoverBuilder::Flat;
+  } else {
+    std::cerr << "unrecognized cover builder: " << coverBuilderName << std::endl;
+    return EXIT_FAILURE;
+  }
+  manifoldFastPath = !alwaysBuildCoverArg;
+  tilePoints = args::get(tilePointsArg);
+  referenceLoader = referenceLoaderArg;
+  if (cacheDirArg) cacheDirectory = args::get(cacheDirArg);
   std::string outputPrefix = args::get(outputPrefixArg);
-
-  // Load mesh
-  SimplePolygonMesh inputMesh(args::get(inputFilename));
-
-  // if it's a point cloud, generate some triangles
-  isPointCloud = inputMesh.polygons.empty();
-  if (isPointCloud) {
-    Neighbors_t neigh = generate_knn(inputMesh.vertexCoordinates, nNeigh);
-    std::vector<Vector3> normals = generate_normals(inputMesh.vertexCoordinates, neigh);
-    std::vector<std::vector<Vector2>> coords = generate_coords_projection(inputMesh.vertexCoordinates, normals, neigh);
-    LocalTriangulationResult localTri = build_delaunay_triangulations(coords, neigh, false);
-
-    // Take the union of all triangles in all the neighborhoods
-    for (size_t iPt = 0; iPt < inputMesh.vertexCoordinates.size(); iPt++) {
-      const std::vector<size_t>& thisNeigh = neigh[iPt];
-      size_t nNeigh = thisNeigh.size();
-
-      // Accumulate over triangles
-      for (const auto& tri : localTri.pointTriangles[iPt]) {
-        std::array<size_t, 3> triGlobal = {thisNeigh[tri[0]], thisNeigh[tri[1]], thisNeigh[tri[2]]};
-        inputMesh.polygons.push_back({triGlobal[0], triGlobal[1], triGlobal[2]});
-      }
-    }
+  writeLaplacian = writeLaplacianArg;
+  writeMass = writeMassArg;
+  writeMapped = writeMappedArg;
+  preserveVertexIndices = preserveVertexIndicesArg;
+  nEigs = args::get(eigsArg);
+  heatSolve = heatSolveArg;
+  heatSource = args::get(heatSourceArg);
+  heatTimeFactor = args::get(heatTimeArg);
+  try {
+    matrixFormat = parseMatrixFormat(args::get(matrixFormatArg));
+  } catch (const std::runtime_error& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
   }
-
-  // make sure the input really is a triangle mesh
-  inputMesh.stripFacesWithDuplicateVertices(); // need a richer format to encode these
-  inputMesh.stripUnusedVertices();             // TODO: maybe should insert a 1 into final matrix for these?
-  inputMesh.triangulate();                     // probably what the user wants
-
-  std::tie(mesh, geometry) = makeGeneralHalfedgeAndGeometry(inputMesh.polygons, inputMesh.vertexCoordinates);
-
-
-  // ta-da! (invoke the algorithm from geometry-central)
-  std::cout << "Building tufted Laplacian..." << std::endl;
-  SparseMatrix<double> L, M;
-  std::tie(L, M) = buildTuftedLaplacian(*mesh, *geometry, mollifyFactor);
-  if (isPointCloud) {
-    L = L / 3.;
-    M = M / 3.;
+  std::string precisionName = args::get(precisionArg);
+  if (precisionName == "double") {
+    singlePrecision = false;
+  } else if (precisionName == "float") {
+    singlePrecision = true;
+  } else {
+    std::cerr << "unrecognized precision: " << precisionName << std::endl;
+    return EXIT_FAILURE;
   }
-  std::cout << "  ...done!" << std::endl;
 
+  std::string traceFilename;
+  if (traceArg) {
+#ifndef TUFTED_ENABLE_TRACING
+    std::cerr << "tracing is not available, tufted-idt was built with TUFTED_WITH_TRACING=OFF" << std::endl;
+    return EXIT_FAILURE;
+#else
+    traceFilename = args::get(traceArg);
+    startTracing();
+#endif
+  }
 
-  // write output matrices, if requested
-  if (writeLaplacian) {
-    saveMatrix(outputPrefix + "laplacian.spmat", L);
+  // Build a single partition, if requested
+  if (partitionsArg) {
+    if (withGUI || batchArg || !inputFilename) {
+      std::cerr << "partitioned builds take a single mesh argument, and no GUI or batch" << std::endl;
+      return EXIT_FAILURE;
+    }
+    size_t iPartition = args::get(partitionArg);
+    std::string blockFilename = outputPrefix + "partition_" + std::to_string(iPartition) + ".tblk";
+    try {
+      processPartition(args::get(inputFilename), args::get(partitionsArg), iPartition, args::get(ghostRingsArg),
+                       blockFilename);
+    } catch (const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+    finishTracing(traceFilename);
+    return EXIT_SUCCESS;
   }
-  if (writeMass) {
-    saveMatrix(outputPrefix + "lumped_mass.spmat", M);
+
+  // Process a whole batch, if requested
+  if (batchArg) {
+    if (withGUI) {
+      std::cerr << "the GUI is not available in batch mode" << std::endl;
+      return EXIT_FAILURE;
+    }
+    std::vector<BatchInput> inputs;
+    try {
+      inputs = listBatchInputs(args::get(batchArg), outputPrefix);
+    } catch (const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+    size_t largeInputBytes = static_cast<size_t>(std::max(args::get(batchLargeInputMBArg), 0.) * 1024. * 1024.);
+    size_t nFailed = runBatch(inputs, largeInputBytes);
+    finishTracing(traceFilename);
+    return nFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
   }
 
+  // Process the input
+  TuftedLaplacianResult result = processInput(args::get(inputFilename), outputPrefix, nThreads, std::cout);
+  isPointCloud = result.isPointCloud;
+  mesh = std::move(result.mesh);
+  geometry = std::move(result.geometry);
+
+#ifdef TUFTED_WITH_GUI
   if (withGUI) {
+    requirePolygons(result);
+    SimplePolygonMesh& inputMesh = result.triangleMesh;
+    if (!mesh) { // (the operators were loaded from the cache)
+      std::tie(mesh, geometry) = makeGeneralHalfedgeAndGeometry(inputMesh.polygons, inputMesh.vertexCoordinates);
+    }
     std::cout << "Generating visualization..." << std::endl;
     // Initialize polyscope
     polyscope::init();
 
     // Run the totally-separate version of the algorithm with signposts for tracing
-    generateVertexSeparatedTuftedCover();
+    generateVertexSeparatedTuftedCover(result);
     generateVisualization();
 
     // Set the callback function
@@ -330,6 +806,8 @@ int main(int argc, char** argv) {
     std::cout << "  ...done!" << std::endl;
     polyscope::show();
   }
+#endif
 
+  finishTracing(traceFilename);
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,114 @@
+#include "manifold_precheck.h"
+
+#include "instrumentation.h"
+#include "parallel_utilities.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// geometry-central's default tolerance in flipToDelaunay(): edges whose cotan weight is at least -delaunayEPS are kept
+const double delaunayEPS = 1e-6;
+
+// The cotan weight (half the cotangent of the opposite angle) of halfedge iHe, from the lengths of its triangle's sides
+double halfedgeCotanWeight(const EdgeIncidence& edges, const std::vector<double>& edgeLengths, size_t iHe) {
+  size_t iF = iHe / 3, j = iHe % 3;
+  double a = edgeLengths[edges.halfedgeEdge[3 * iF + j]];
+  double b = edgeLengths[edges.halfedgeEdge[3 * iF + (j + 1) % 3]];
+  double c = edgeLengths[edges.halfedgeEdge[3 * iF + (j + 2) % 3]];
+  double area = 0.25 * std::sqrt(std::max((a + b + c) * (-a + b + c) * (a - b + c) * (a + b - c), 0.));
+  return (b * b + c * c - a * a) / (8. * area);
+}
+
+size_t findRoot(std::vector<uint32_t>& parent, size_t i) {
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+} // namespace
+
+
+ManifoldPrecheck precheckTuftedCover(const FlatTriangleMesh& mesh, const EdgeIncidence& edges,
+                                     const std::vector<double>& edgeLengths, size_t nThreads) {
+  TUFTED_TRACE_SCOPE("manifold precheck");
+  ManifoldPrecheck result;
+
+  // Edges, in parallel (and NaN weights, from degenerate triangles, count as not Delaunay)
+  std::vector<uint8_t> edgeFlags(edges.nEdges()); // 1: nonmanifold, 2: boundary, 4: not Delaunay
+  parallelFor(edges.nEdges(), nThreads, [&](size_t iThread, size_t iE) {
+    size_t iStart = edges.edgeStart[iE], nFaces = edges.edgeStart[iE + 1] - iStart;
+    if (nFaces > 2) {
+      edgeFlags[iE] = 1;
+      return;
+    }
+    double weight = halfedgeCotanWeight(edges, edgeLengths, edges.edgeHalfedges[iStart]);
+    if (nFaces == 2) {
+      weight += halfedgeCotanWeight(edges, edgeLengths, edges.edgeHalfedges[iStart + 1]);
+    } else {
+      weight *= 2.; // (glued to its mirror image)
+    }
+    edgeFlags[iE] = (nFaces == 1 ? 2 : 0) | (weight >= -delaunayEPS ? 0 : 4);
+  });
+  for (uint8_t flags : edgeFlags) {
+    if (flags & 1) result.nNonmanifoldEdges++;
+    if (flags & 2) result.nBoundaryEdges++;
+    if (flags & 4) result.nNonDelaunayEdges++;
+  }
+
+  // Vertices: join the corners of the faces on either side of each manifold edge, at both of its endpoints. Each
+  // vertex then has one set of corners per fan.
+  if (mesh.triangles.size() > std::numeric_limits<uint32_t>::max()) {
+    throw std::runtime_error("too many triangles for the manifold precheck");
+  }
+  std::vector<uint32_t> parent(mesh.triangles.size());
+  std::iota(parent.begin(), parent.end(), 0);
+  for (size_t iE = 0; iE < edges.nEdges(); iE++) {
+    if (edges.edgeStart[iE + 1] - edges.edgeStart[iE] != 2) continue;
+    size_t iHeA = edges.edgeHalfedges[edges.edgeStart[iE]];
+    size_t iHeB = edges.edgeHalfedges[edges.edgeStart[iE] + 1];
+    size_t iHeANext = iHeA % 3 == 2 ? iHeA - 2 : iHeA + 1;
+    size_t iHeBNext = iHeB % 3 == 2 ? iHeB - 2 : iHeB + 1;
+
+    // (halfedge iHe starts at corner iHe)
+    bool sameDirection = mesh.triangles[iHeA] == mesh.triangles[iHeB];
+    std::pair<size_t, size_t> joins[2] = {{iHeA, sameDirection ? iHeB : iHeBNext},
+                                          {iHeANext, sameDirection ? iHeBNext : iHeB}};
+    for (const std::pair<size_t, size_t>& join : joins) {
+      size_t rootA = findRoot(parent, join.first), rootB = findRoot(parent, join.second);
+      if (rootA != rootB) parent[std::max(rootA, rootB)] = static_cast<uint32_t>(std::min(rootA, rootB));
+    }
+  }
+  std::vector<uint32_t> nFans(mesh.nVertices(), 0);
+  for (size_t iC = 0; iC < parent.size(); iC++) {
+    if (parent[iC] == iC) nFans[mesh.triangles[iC]]++;
+  }
+  for (uint32_t n : nFans) {
+    if (n > 1) result.nNonmanifoldVertices++;
+  }
+  return result;
+}
+
+IntrinsicTriangles intrinsicTrianglesFromEdgeLengths(const FlatTriangleMesh& mesh, const EdgeIncidence& edges,
+                                                     const std::vector<double>& edgeLengths, size_t nThreads) {
+  IntrinsicTriangles result;
+  result.nVertices = mesh.nVertices();
+  result.vertices.resize(mesh.nTriangles());
+  for (std::vector<double>& l : result.edgeLengths) l.resize(mesh.nTriangles());
+
+  parallelFor(mesh.nTriangles(), nThreads, [&](size_t iThread, size_t iF) {
+    for (size_t j = 0; j < 3; j++) {
+      result.vertices[iF][j] = mesh.triangles[3 * iF + j];
+      result.edgeLengths[j][iF] = edgeLengths[edges.halfedgeEdge[3 * iF + j]];
+    }
+  });
+  return result;
+}
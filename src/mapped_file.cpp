@@ -0,0 +1,63 @@
+#include "mapped_file.h"
+
+#include <fstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& filename) {
+
+#ifndef _WIN32
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("failed to open file " + filename);
+  }
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0) {
+    close(fd);
+    throw std::runtime_error("failed to stat file " + filename);
+  }
+  nBytes = fileStat.st_size;
+  if (nBytes == 0) { // (mmap rejects empty ranges)
+    close(fd);
+    return;
+  }
+  void* mapped = mmap(nullptr, nBytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); // (the mapping stays valid)
+  if (mapped == MAP_FAILED) {
+    throw std::runtime_error("failed to map file " + filename);
+  }
+  bytes = static_cast<const unsigned char*>(mapped);
+  isMapped = true;
+#else
+  std::ifstream inFile(filename, std::ios::binary | std::ios::ate);
+  if (!inFile) {
+    throw std::runtime_error("failed to open file " + filename);
+  }
+  fallbackBuffer.resize(static_cast<size_t>(inFile.tellg()));
+  inFile.seekg(0);
+  inFile.read(reinterpret_cast<char*>(fallbackBuffer.data()), fallbackBuffer.size());
+  if (!inFile) {
+    throw std::runtime_error("failed to read file " + filename);
+  }
+  bytes = fallbackBuffer.data();
+  nBytes = fallbackBuffer.size();
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+  if (isMapped) munmap(const_cast<unsigned char*>(bytes), nBytes);
+#endif
+}
+
+void MappedFile::adviseSequential() const {
+#ifndef _WIN32
+  if (isMapped) madvise(const_cast<unsigned char*>(bytes), nBytes, MADV_SEQUENTIAL);
+#endif
+}
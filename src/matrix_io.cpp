@@ -0,0 +1,592 @@
+#include "matrix_io.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// NOTE: the binary formats below are written in the native byte order, which is assumed to be little-endian.
+
+namespace {
+
+typedef SparseMatrix<double>::StorageIndex StorageIndex;
+static_assert(sizeof(StorageIndex) == 4, "binary matrix formats store 32-bit indices");
+
+// Accumulates output in a large buffer, and hands it to the file in big chunks
+class BufferedFileWriter {
+public:
+  explicit BufferedFileWriter(const std::string& filename_) : filename(filename_), buffer(bufferSize) {
+    outFile.open(filename, std::ios::binary);
+    if (!outFile) {
+      throw std::runtime_error("failed to open output file " + filename);
+    }
+  }
+
+  void write(const void* data, size_t n) {
+    if (used + n > buffer.size()) flush();
+    if (n >= buffer.size()) { // big writes skip the buffer
+      writeThrough(static_cast<const char*>(data), n);
+      return;
+    }
+    std::memcpy(&buffer[used], data, n);
+    used += n;
+  }
+
+  template <typename T>
+  void writeValue(const T& val) {
+    write(&val, sizeof(T));
+  }
+
+  // Get space to format a line of text directly in to the buffer, then commit() the bytes actually used
+  char* reserveLine() {
+    if (used + maxLineLength > buffer.size()) flush();
+    return &buffer[used];
+  }
+  void commitLine(int len) {
+    if (len < 0 || static_cast<size_t>(len) >= maxLineLength) {
+      throw std::runtime_error("failed to format output for " + filename);
+    }
+    used += len;
+  }
+
+  size_t bytesWritten() const { return flushedBytes + used; }
+
+  void flush() {
+    writeThrough(buffer.data(), used);
+    used = 0;
+  }
+
+  void close() {
+    flush();
+    outFile.close();
+    if (!outFile) {
+      throw std::runtime_error("failed to write output file " + filename);
+    }
+  }
+
+  static const size_t maxLineLength = 256;
+
+private:
+  static const size_t bufferSize = 1 << 20;
+
+  void writeThrough(const char* data, size_t n) {
+    if (n == 0) return;
+    outFile.write(data, n);
+    if (!outFile) {
+      throw std::runtime_error("failed to write output file " + filename);
+    }
+    flushedBytes += n;
+  }
+
+  std::string filename;
+  std::ofstream outFile;
+  std::vector<char> buffer;
+  size_t used = 0;
+  size_t flushedBytes = 0;
+};
+const size_t BufferedFileWriter::maxLineLength;
+const size_t BufferedFileWriter::bufferSize;
+
+// How each value type is written
+template <typename T>
+struct ValueFormat;
+template <>
+struct ValueFormat<double> {
+  // (%.16g matches the std::setprecision(16) stream output the text formats always used)
+  static const char* entryLine() { return "%lld %lld %.16g\n"; }
+  static const char* npyDescr() { return "<f8"; }
+};
+template <>
+struct ValueFormat<float> {
+  static const char* entryLine() { return "%lld %lld %.9g\n"; }
+  static const char* npyDescr() { return "<f4"; }
+};
+
+// Write every entry as a 1-indexed `row col value` line, with the value rounded to T
+template <typename T>
+void writeEntriesText(BufferedFileWriter& out, const SparseMatrix<double>& matrix) {
+  for (int k = 0; k < matrix.outerSize(); ++k) {
+    for (SparseMatrix<double>::InnerIterator it(matrix, k); it; ++it) {
+      char* line = out.reserveLine();
+      out.commitLine(std::snprintf(line, BufferedFileWriter::maxLineLength, ValueFormat<T>::entryLine(),
+                                   static_cast<long long>(it.row()) + 1, static_cast<long long>(it.col()) + 1,
+                                   static_cast<double>(static_cast<T>(it.value()))));
+    }
+  }
+}
+
+// Write an array of values as T, converting a chunk at a time
+template <typename T>
+void writeValuesAs(BufferedFileWriter& out, const double* values, size_t n) {
+  const size_t chunkSize = 4096;
+  std::array<T, chunkSize> chunk;
+  for (size_t iStart = 0; iStart < n; iStart += chunkSize) {
+    size_t nChunk = std::min(chunkSize, n - iStart);
+    for (size_t i = 0; i < nChunk; i++) chunk[i] = static_cast<T>(values[iStart + i]);
+    out.write(chunk.data(), nChunk * sizeof(T));
+  }
+}
+template <>
+void writeValuesAs<double>(BufferedFileWriter& out, const double* values, size_t n) {
+  out.write(values, n * sizeof(double));
+}
+
+// == CRC-32 (as used by zip)
+
+class CRC32 {
+public:
+  CRC32() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int j = 0; j < 8; j++) c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+      table[i] = c;
+    }
+  }
+
+  uint32_t update(uint32_t crc, const void* data, size_t n) const {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++) crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+  }
+
+private:
+  std::array<uint32_t, 256> table;
+};
+
+// == NPY / NPZ
+
+// An array to be stored as a .npy file in the archive
+struct NPYArray {
+  std::string name;
+  std::string header; // the full .npy header, including magic string and padding
+  const void* data;
+  size_t dataBytes;
+};
+
+NPYArray makeNPYArray(const std::string& name, const std::string& descr, const std::string& shape, const void* data,
+                      size_t dataBytes) {
+  std::string dict = "{'descr': '" + descr + "', 'fortran_order': False, 'shape': " + shape + ", }";
+
+  // pad with spaces and a final newline such that magic + version + length + header is a multiple of 64 bytes
+  const size_t preambleBytes = 10;
+  size_t totalBytes = preambleBytes + dict.size() + 1;
+  totalBytes = ((totalBytes + 63) / 64) * 64;
+  dict.append(totalBytes - preambleBytes - dict.size() - 1, ' ');
+  dict.push_back('\n');
+
+  std::string header = "\x93NUMPY";
+  header.push_back('\x01'); // version 1.0
+  header.push_back('\x00');
+  header.push_back(static_cast<char>(dict.size() & 0xFF));
+  header.push_back(static_cast<char>((dict.size() >> 8) & 0xFF));
+  header += dict;
+
+  NPYArray arr;
+  arr.name = name + ".npy";
+  arr.header = header;
+  arr.data = data;
+  arr.dataBytes = dataBytes;
+  return arr;
+}
+
+// Write a zip archive with each array as an uncompressed entry
+void writeNPZ(BufferedFileWriter& out, const std::vector<NPYArray>& arrays, const std::string& filename) {
+
+  const uint32_t maxZip32 = 0xFFFFFFFFu;
+  const uint16_t zipVersion = 20;
+  const uint16_t dosDate = (0 << 9) | (1 << 5) | 1; // 1980-01-01, the zip epoch
+
+  CRC32 crcTable;
+  std::vector<uint32_t> crcs, sizes, offsets;
+
+  // Local file entries
+  for (const NPYArray& arr : arrays) {
+    size_t entryBytes = arr.header.size() + arr.dataBytes;
+    if (entryBytes > maxZip32 || out.bytesWritten() > maxZip32) {
+      throw std::runtime_error("matrix too large for the npz writer (no zip64 support), use another format for " +
+                               filename);
+    }
+
+    uint32_t crc = crcTable.update(0, arr.header.data(), arr.header.size());
+    crc = crcTable.update(crc, arr.data, arr.dataBytes);
+    crcs.push_back(crc);
+    sizes.push_back(static_cast<uint32_t>(entryBytes));
+    offsets.push_back(static_cast<uint32_t>(out.bytesWritten()));
+
+    out.writeValue<uint32_t>(0x04034b50); // local file header signature
+    out.writeValue<uint16_t>(zipVersion);
+    out.writeValue<uint16_t>(0); // flags
+    out.writeValue<uint16_t>(0); // compression: stored
+    out.writeValue<uint16_t>(0); // time
+    out.writeValue<uint16_t>(dosDate);
+    out.writeValue<uint32_t>(crc);
+    out.writeValue<uint32_t>(static_cast<uint32_t>(entryBytes)); // compressed size
+    out.writeValue<uint32_t>(static_cast<uint32_t>(entryBytes)); // uncompressed size
+    out.writeValue<uint16_t>(static_cast<uint16_t>(arr.name.size()));
+    out.writeValue<uint16_t>(0); // extra field length
+    out.write(arr.name.data(), arr.name.size());
+
+    out.write(arr.header.data(), arr.header.size());
+    out.write(arr.data, arr.dataBytes);
+  }
+
+  // Central directory
+  size_t centralStart = out.bytesWritten();
+  for (size_t i = 0; i < arrays.size(); i++) {
+    const NPYArray& arr = arrays[i];
+    out.writeValue<uint32_t>(0x02014b50); // central file header signature
+    out.writeValue<uint16_t>(zipVersion); // version made by
+    out.writeValue<uint16_t>(zipVersion); // version needed
+    out.writeValue<uint16_t>(0);          // flags
+    out.writeValue<uint16_t>(0);          // compression: stored
+    out.writeValue<uint16_t>(0);          // time
+    out.writeValue<uint16_t>(dosDate);
+    out.writeValue<uint32_t>(crcs[i]);
+    out.writeValue<uint32_t>(sizes[i]);
+    out.writeValue<uint32_t>(sizes[i]);
+    out.writeValue<uint16_t>(static_cast<uint16_t>(arr.name.size()));
+    out.writeValue<uint16_t>(0); // extra field length
+    out.writeValue<uint16_t>(0); // comment length
+    out.writeValue<uint16_t>(0); // disk number
+    out.writeValue<uint16_t>(0); // internal attributes
+    out.writeValue<uint32_t>(0); // external attributes
+    out.writeValue<uint32_t>(offsets[i]);
+    out.write(arr.name.data(), arr.name.size());
+  }
+  size_t centralBytes = out.bytesWritten() - centralStart;
+  if (out.bytesWritten() > maxZip32) {
+    throw std::runtime_error("matrix too large for the npz writer (no zip64 support), use another format for " +
+                             filename);
+  }
+
+  // End of central directory
+  out.writeValue<uint32_t>(0x06054b50);
+  out.writeValue<uint16_t>(0); // this disk
+  out.writeValue<uint16_t>(0); // disk with the central directory
+  out.writeValue<uint16_t>(static_cast<uint16_t>(arrays.size()));
+  out.writeValue<uint16_t>(static_cast<uint16_t>(arrays.size()));
+  out.writeValue<uint32_t>(static_cast<uint32_t>(centralBytes));
+  out.writeValue<uint32_t>(static_cast<uint32_t>(centralStart));
+  out.writeValue<uint16_t>(0); // comment length
+}
+
+} // namespace
+
+
+MatrixFormat parseMatrixFormat(const std::string& name) {
+  if (name == "spmat") return MatrixFormat::SPMAT;
+  if (name == "bin") return MatrixFormat::Binary;
+  if (name == "mtx") return MatrixFormat::MatrixMarket;
+  if (name == "npz") return MatrixFormat::NPZ;
+  throw std::runtime_error("unrecognized matrix format: " + name);
+}
+
+std::string matrixFormatExtension(MatrixFormat format) {
+  switch (format) {
+  case MatrixFormat::SPMAT:
+    return "spmat";
+  case MatrixFormat::Binary:
+    return "bin";
+  case MatrixFormat::MatrixMarket:
+    return "mtx";
+  case MatrixFormat::NPZ:
+    return "npz";
+  }
+  return "";
+}
+
+template <typename T>
+void saveMatrix(const std::string& filename, const SparseMatrix<double>& matrix, MatrixFormat format) {
+
+  switch (format) {
+  case MatrixFormat::SPMAT:
+    saveMatrixSPMAT<T>(filename, matrix);
+    break;
+  case MatrixFormat::Binary:
+    saveMatrixBinary<T>(filename, matrix);
+    break;
+  case MatrixFormat::MatrixMarket:
+    saveMatrixMarket<T>(filename, matrix);
+    break;
+  case MatrixFormat::NPZ:
+    saveMatrixNPZ<T>(filename, matrix);
+    break;
+  }
+}
+
+template <typename T>
+void saveMatrixSPMAT(const std::string& filename, const SparseMatrix<double>& matrix) {
+
+  // WARNING: this follows matlab convention and thus is 1-indexed
+
+  BufferedFileWriter out(filename);
+  writeEntriesText<T>(out, matrix);
+  out.close();
+}
+
+template <typename T>
+void saveMatrixBinary(const std::string& filename, const SparseMatrix<double>& matrix) {
+
+  // Work directly from the compressed arrays
+  SparseMatrix<double> compressedCopy;
+  const SparseMatrix<double>* mat = &matrix;
+  if (!matrix.isCompressed()) {
+    compressedCopy = matrix;
+    compressedCopy.makeCompressed();
+    mat = &compressedCopy;
+  }
+  size_t nnz = mat->nonZeros();
+
+  BufferedFileWriter out(filename);
+
+  const char magic[8] = {'T', 'U', 'F', 'T', 'C', 'S', 'C', '\0'};
+  out.write(magic, sizeof(magic));
+  out.writeValue<uint32_t>(1);
+  out.writeValue<uint32_t>(sizeof(T));
+  out.writeValue<uint64_t>(mat->rows());
+  out.writeValue<uint64_t>(mat->cols());
+  out.writeValue<uint64_t>(nnz);
+
+  for (Eigen::Index iCol = 0; iCol <= mat->outerSize(); iCol++) {
+    out.writeValue<int64_t>(mat->outerIndexPtr()[iCol]);
+  }
+  out.write(mat->innerIndexPtr(), nnz * sizeof(StorageIndex));
+  writeValuesAs<T>(out, mat->valuePtr(), nnz);
+
+  out.close();
+}
+
+template <typename T>
+void saveMatrixMarket(const std::string& filename, const SparseMatrix<double>& matrix) {
+  BufferedFileWriter out(filename);
+  const std::string banner = "%%MatrixMarket matrix coordinate real general\n";
+  out.write(banner.data(), banner.size());
+  char* line = out.reserveLine();
+  out.commitLine(std::snprintf(line, BufferedFileWriter::maxLineLength, "%lld %lld %lld\n",
+                               static_cast<long long>(matrix.rows()), static_cast<long long>(matrix.cols()),
+                               static_cast<long long>(matrix.nonZeros())));
+  writeEntriesText<T>(out, matrix);
+  out.close();
+}
+
+template <typename T>
+void saveMatrixNPZ(const std::string& filename, const SparseMatrix<double>& matrix) {
+
+  // Gather COO triplets (in column-major order)
+  size_t nnz = matrix.nonZeros();
+  std::vector<int32_t> rows, cols;
+  std::vector<T> vals;
+  rows.reserve(nnz);
+  cols.reserve(nnz);
+  vals.reserve(nnz);
+  for (int k = 0; k < matrix.outerSize(); ++k) {
+    for (SparseMatrix<double>::InnerIterator it(matrix, k); it; ++it) {
+      rows.push_back(static_cast<int32_t>(it.row()));
+      cols.push_back(static_cast<int32_t>(it.col()));
+      vals.push_back(static_cast<T>(it.value()));
+    }
+  }
+  std::array<int64_t, 2> shape = {static_cast<int64_t>(matrix.rows()), static_cast<int64_t>(matrix.cols())};
+  const char formatName[3] = {'c', 'o', 'o'};
+
+  std::string nnzShape = "(" + std::to_string(nnz) + ",)";
+  std::vector<NPYArray> arrays;
+  arrays.push_back(makeNPYArray("row", "<i4", nnzShape, rows.data(), nnz * sizeof(int32_t)));
+  arrays.push_back(makeNPYArray("col", "<i4", nnzShape, cols.data(), nnz * sizeof(int32_t)));
+  arrays.push_back(makeNPYArray("data", ValueFormat<T>::npyDescr(), nnzShape, vals.data(), nnz * sizeof(T)));
+  arrays.push_back(makeNPYArray("shape", "<i8", "(2,)", shape.data(), sizeof(shape)));
+  arrays.push_back(makeNPYArray("format", "|S3", "()", formatName, sizeof(formatName)));
+
+  BufferedFileWriter out(filename);
+  writeNPZ(out, arrays, filename);
+  out.close();
+}
+
+#define TUFTED_INSTANTIATE_MATRIX_WRITERS(T)                                                                           \
+  template void saveMatrix<T>(const std::string&, const SparseMatrix<double>&, MatrixFormat);                          \
+  template void saveMatrixSPMAT<T>(const std::string&, const SparseMatrix<double>&);                                   \
+  template void saveMatrixBinary<T>(const std::string&, const SparseMatrix<double>&);                                  \
+  template void saveMatrixMarket<T>(const std::string&, const SparseMatrix<double>&);                                  \
+  template void saveMatrixNPZ<T>(const std::string&, const SparseMatrix<double>&);
+TUFTED_INSTANTIATE_MATRIX_WRITERS(double)
+TUFTED_INSTANTIATE_MATRIX_WRITERS(float)
+#undef TUFTED_INSTANTIATE_MATRIX_WRITERS
+
+
+// === Dense output
+
+void saveDenseMatrix(const std::string& filename, const Eigen::MatrixXd& matrix) {
+  BufferedFileWriter out(filename);
+  for (Eigen::Index i = 0; i < matrix.rows(); i++) {
+    for (Eigen::Index j = 0; j < matrix.cols(); j++) {
+      const char* fieldFormat = j + 1 < matrix.cols() ? "%.16g " : "%.16g\n";
+      char* field = out.reserveLine();
+      out.commitLine(std::snprintf(field, BufferedFileWriter::maxLineLength, fieldFormat, matrix(i, j)));
+    }
+  }
+  out.close();
+}
+
+
+// === Memory-mapped operators
+
+namespace {
+
+const char mappedMagic[8] = {'T', 'U', 'F', 'T', 'M', 'A', 'P', '\0'};
+const uint64_t mappedAlignment = 64;
+
+struct MappedHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t indexBytes;
+  uint32_t valueBytes;
+  uint32_t padding;
+  int64_t V;
+  int64_t nnz;
+  uint64_t outerOffset;
+  uint64_t innerOffset;
+  uint64_t valueOffset;
+  uint64_t massOffset;
+};
+
+uint64_t alignUp(uint64_t offset) { return ((offset + mappedAlignment - 1) / mappedAlignment) * mappedAlignment; }
+
+} // namespace
+
+void saveOperatorsMapped(const std::string& filename, const SparseMatrix<double>& L, const SparseMatrix<double>& M) {
+
+  if (L.rows() != L.cols() || M.rows() != L.rows() || M.cols() != L.cols()) {
+    throw std::runtime_error("saveOperatorsMapped() expects square L and M of the same size");
+  }
+
+  SparseMatrix<double> compressedCopy;
+  const SparseMatrix<double>* Lc = &L;
+  if (!L.isCompressed()) {
+    compressedCopy = L;
+    compressedCopy.makeCompressed();
+    Lc = &compressedCopy;
+  }
+  Eigen::VectorXd massDiag = M.diagonal();
+
+  // Lay out the file
+  MappedHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, mappedMagic, sizeof(mappedMagic));
+  header.version = 1;
+  header.indexBytes = sizeof(StorageIndex);
+  header.valueBytes = sizeof(double);
+  header.V = Lc->rows();
+  header.nnz = Lc->nonZeros();
+  size_t outerBytes = (header.V + 1) * sizeof(StorageIndex);
+  size_t innerBytes = header.nnz * sizeof(StorageIndex);
+  size_t valueBytes = header.nnz * sizeof(double);
+  size_t massBytes = header.V * sizeof(double);
+  header.outerOffset = alignUp(sizeof(MappedHeader));
+  header.innerOffset = alignUp(header.outerOffset + outerBytes);
+  header.valueOffset = alignUp(header.innerOffset + innerBytes);
+  header.massOffset = alignUp(header.valueOffset + valueBytes);
+  size_t fileBytes = header.massOffset + massBytes;
+
+#ifndef _WIN32
+
+  int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw std::runtime_error("failed to open output file " + filename);
+  }
+  if (ftruncate(fd, fileBytes) != 0) {
+    close(fd);
+    throw std::runtime_error("failed to resize output file " + filename);
+  }
+  void* mapped = mmap(nullptr, fileBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapped == MAP_FAILED) {
+    close(fd);
+    throw std::runtime_error("failed to map output file " + filename);
+  }
+
+  // (ftruncate zero-fills, so the padding between arrays is already set)
+  unsigned char* out = static_cast<unsigned char*>(mapped);
+  std::memcpy(out, &header, sizeof(header));
+  std::memcpy(out + header.outerOffset, Lc->outerIndexPtr(), outerBytes);
+  std::memcpy(out + header.innerOffset, Lc->innerIndexPtr(), innerBytes);
+  std::memcpy(out + header.valueOffset, Lc->valuePtr(), valueBytes);
+  std::memcpy(out + header.massOffset, massDiag.data(), massBytes);
+
+  bool synced = msync(mapped, fileBytes, MS_SYNC) == 0;
+  munmap(mapped, fileBytes);
+  bool closed = close(fd) == 0;
+  if (!synced || !closed) {
+    throw std::runtime_error("failed to write output file " + filename);
+  }
+
+#else
+
+  // No mmap, write the same layout with ordinary (buffered) writes
+  BufferedFileWriter out(filename);
+  const std::vector<char> zeros(mappedAlignment, 0);
+  auto padTo = [&](uint64_t offset) { out.write(zeros.data(), offset - out.bytesWritten()); };
+  out.write(&header, sizeof(header));
+  padTo(header.outerOffset);
+  out.write(Lc->outerIndexPtr(), outerBytes);
+  padTo(header.innerOffset);
+  out.write(Lc->innerIndexPtr(), innerBytes);
+  padTo(header.valueOffset);
+  out.write(Lc->valuePtr(), valueBytes);
+  padTo(header.massOffset);
+  out.write(massDiag.data(), massBytes);
+  out.close();
+
+#endif
+}
+
+MappedOperators::MappedOperators(const std::string& filename) : file(filename) {
+
+  const unsigned char* data = file.data();
+  size_t dataBytes = file.size();
+
+  // Validate the header
+  MappedHeader header;
+  bool valid = dataBytes >= sizeof(header);
+  if (valid) {
+    std::memcpy(&header, data, sizeof(header));
+    valid = std::memcmp(header.magic, mappedMagic, sizeof(mappedMagic)) == 0 && header.version == 1 &&
+            header.indexBytes == sizeof(StorageIndex) && header.valueBytes == sizeof(double) && header.V >= 0 &&
+            header.nnz >= 0 && header.outerOffset + (header.V + 1) * sizeof(StorageIndex) <= dataBytes &&
+            header.innerOffset + header.nnz * sizeof(StorageIndex) <= dataBytes &&
+            header.valueOffset + header.nnz * sizeof(double) <= dataBytes &&
+            header.massOffset + header.V * sizeof(double) <= dataBytes;
+  }
+  if (!valid) {
+    throw std::runtime_error("not a valid mapped operator file: " + filename);
+  }
+
+  V = header.V;
+  nnz = header.nnz;
+  outerOffset = header.outerOffset;
+  innerOffset = header.innerOffset;
+  valueOffset = header.valueOffset;
+  massOffset = header.massOffset;
+}
+
+Eigen::Map<const SparseMatrix<double>> MappedOperators::laplacian() const {
+  const unsigned char* data = file.data();
+  return Eigen::Map<const SparseMatrix<double>>(V, V, nnz, reinterpret_cast<const StorageIndex*>(data + outerOffset),
+                                                reinterpret_cast<const StorageIndex*>(data + innerOffset),
+                                                reinterpret_cast<const double*>(data + valueOffset));
+}
+
+Eigen::Map<const Eigen::VectorXd> MappedOperators::massDiagonal() const {
+  const unsigned char* data = file.data();
+  return Eigen::Map<const Eigen::VectorXd>(reinterpret_cast<const double*>(data + massOffset), V);
+}
@@ -0,0 +1,93 @@
+// Merge tool: combines the block files written by partitioned tufted-idt builds (see partitioned_laplacian.h) in to
+// the Laplacian and mass matrix of the whole mesh.
+
+#include "matrix_io.h"
+#include "operator_assembly.h"
+
+#include "args/args.hxx"
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+// Write L and M with values of type T
+template <typename T>
+void saveOutputs(const std::string& outputPrefix, const SparseMatrix<double>& L, const SparseMatrix<double>& M,
+                 MatrixFormat format) {
+  std::string laplacianFilename = outputPrefix + "laplacian." + matrixFormatExtension(format);
+  std::cout << "Writing sparse matrix to: " << laplacianFilename << std::endl;
+  saveMatrix<T>(laplacianFilename, L, format);
+  std::string massFilename = outputPrefix + "lumped_mass." + matrixFormatExtension(format);
+  std::cout << "Writing sparse matrix to: " << massFilename << std::endl;
+  saveMatrix<T>(massFilename, M, format);
+}
+
+int main(int argc, char** argv) {
+
+  // clang-format off
+  args::ArgumentParser parser("Merge the partition blocks written by tufted-idt --partitions in to the Laplacian and lumped mass matrix of the whole mesh.");
+  args::HelpFlag help(parser, "help", "Display this help message", {'h', "help"});
+  args::PositionalList<std::string> blockFilenames(parser, "blocks", "The block file of every partition (partition_<I>.tblk), in any order");
+
+  args::ValueFlag<std::string> outputPrefixArg(parser, "outputPrefix", "Prefix to prepend to output file paths. Default: tufted_", {"outputPrefix"}, "tufted_");
+  args::ValueFlag<std::string> matrixFormatArg(parser, "matrixFormat", "File format for output matrices, one of 'spmat', 'bin', 'mtx' or 'npz' (see tufted-idt). names: 'laplacian.<ext>', 'lumped_mass.<ext>'. Default: spmat", {"matrixFormat"}, "spmat");
+  args::ValueFlag<std::string> precisionArg(parser, "precision", "Value type of the output matrices, one of 'double' or 'float'. Does not affect --writeMapped. Default: double", {"precision"}, "double");
+  args::Flag writeMappedArg(parser, "writeMapped", "Also write the Laplacian and the diagonal of the mass matrix to a single memory-mappable file. name: 'operators.mmap'", {"writeMapped"});
+  args::ValueFlag<unsigned int> threadsArg(parser, "threads", "Number of threads to use, 0 uses all hardware threads. Default: 1", {"threads"}, 1);
+  // clang-format on
+
+  try {
+    parser.ParseCLI(argc, argv);
+  } catch (args::Help& e) {
+    std::cout << parser;
+    return 0;
+  } catch (args::ParseError& e) {
+    std::cerr << e.what() << std::endl;
+    std::cerr << parser;
+    return 1;
+  }
+
+  if (!blockFilenames) {
+    std::cout << parser;
+    return EXIT_FAILURE;
+  }
+
+  std::string outputPrefix = args::get(outputPrefixArg);
+  MatrixFormat matrixFormat;
+  try {
+    matrixFormat = parseMatrixFormat(args::get(matrixFormatArg));
+  } catch (const std::runtime_error& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::string precisionName = args::get(precisionArg);
+  if (precisionName != "double" && precisionName != "float") {
+    std::cerr << "unrecognized precision: " << precisionName << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  try {
+    SparseMatrix<double> L, M;
+    mergeOperatorBlocks(args::get(blockFilenames), L, M, args::get(threadsArg));
+    std::cout << "merged " << args::get(blockFilenames).size() << " blocks: " << L.rows() << " rows, "
+              << L.nonZeros() << " nonzeros" << std::endl;
+
+    if (precisionName == "float") {
+      saveOutputs<float>(outputPrefix, L, M, matrixFormat);
+    } else {
+      saveOutputs<double>(outputPrefix, L, M, matrixFormat);
+    }
+    if (writeMappedArg) {
+      std::cout << "Writing mapped operators to: " << outputPrefix << "operators.mmap" << std::endl;
+      saveOperatorsMapped(outputPrefix + "operators.mmap", L, M);
+    }
+  } catch (const std::runtime_error& e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
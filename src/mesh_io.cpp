@@ -0,0 +1,685 @@
+#include "mesh_io.h"
+
+#include "mapped_file.h"
+#include "parallel_utilities.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+const uint64_t maxVertices = std::numeric_limits<uint32_t>::max(); // (indices are stored as uint32)
+
+std::string lowercaseExtension(const std::string& filename) {
+  size_t iDot = filename.find_last_of('.');
+  if (iDot == std::string::npos) return "";
+  std::string ext = filename.substr(iDot + 1);
+  std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+  return ext;
+}
+
+// Fan-triangulate a polygon on to the end of `triangles`, unless it repeats a vertex (then it is dropped)
+void appendPolygon(const int64_t* polygon, size_t degree, std::vector<uint32_t>& triangles) {
+  if (degree < 3) return;
+  for (size_t i = 0; i < degree; i++) {
+    for (size_t j = i + 1; j < degree; j++) {
+      if (polygon[i] == polygon[j]) return;
+    }
+  }
+  for (size_t i = 1; i + 1 < degree; i++) {
+    triangles.push_back(static_cast<uint32_t>(polygon[0]));
+    triangles.push_back(static_cast<uint32_t>(polygon[i]));
+    triangles.push_back(static_cast<uint32_t>(polygon[i + 1]));
+  }
+}
+
+// Range-check (throwing) an index parsed from `filename`
+int64_t checkIndex(int64_t ind, uint64_t nVertices, const std::string& filename) {
+  if (ind < 0 || static_cast<uint64_t>(ind) >= nVertices) {
+    throw std::runtime_error("vertex index " + std::to_string(ind) + " out of range (" + std::to_string(nVertices) +
+                             " vertices) in " + filename);
+  }
+  return ind;
+}
+
+// Check that all indices are less than nVertices, and remove any triangles which repeat a vertex
+void finishTriangles(FlatTriangleMesh& mesh, size_t nThreads, const std::string& filename) {
+  std::vector<uint32_t>& tris = mesh.triangles;
+  size_t nTri = mesh.nTriangles();
+  uint64_t nVertices = mesh.nVertices();
+
+  std::atomic<bool> anyDegenerate(false);
+  std::atomic<bool> anyOutOfRange(false);
+  parallelForBlocks(nTri, nThreads, 1 << 16, [&](size_t iThread, size_t iStart, size_t iEnd) {
+    bool degenerate = false, outOfRange = false;
+    for (size_t iT = iStart; iT < iEnd; iT++) {
+      uint32_t a = tris[3 * iT], b = tris[3 * iT + 1], c = tris[3 * iT + 2];
+      degenerate = degenerate || a == b || b == c || a == c;
+      outOfRange = outOfRange || a >= nVertices || b >= nVertices || c >= nVertices;
+    }
+    if (degenerate) anyDegenerate = true;
+    if (outOfRange) anyOutOfRange = true;
+  });
+
+  if (anyOutOfRange) {
+    uint32_t maxIndex = *std::max_element(tris.begin(), tris.end());
+    checkIndex(maxIndex, nVertices, filename); // (throws)
+  }
+
+  if (anyDegenerate) {
+    size_t nKept = 0;
+    for (size_t iT = 0; iT < nTri; iT++) {
+      uint32_t a = tris[3 * iT], b = tris[3 * iT + 1], c = tris[3 * iT + 2];
+      if (a == b || b == c || a == c) continue;
+      tris[3 * nKept] = a;
+      tris[3 * nKept + 1] = b;
+      tris[3 * nKept + 2] = c;
+      nKept++;
+    }
+    tris.resize(3 * nKept);
+  }
+}
+
+
+// === PLY
+
+enum class PLYType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+bool parsePLYType(const std::string& name, PLYType& type) {
+  if (name == "char" || name == "int8") type = PLYType::Int8;
+  else if (name == "uchar" || name == "uint8") type = PLYType::UInt8;
+  else if (name == "short" || name == "int16") type = PLYType::Int16;
+  else if (name == "ushort" || name == "uint16") type = PLYType::UInt16;
+  else if (name == "int" || name == "int32") type = PLYType::Int32;
+  else if (name == "uint" || name == "uint32") type = PLYType::UInt32;
+  else if (name == "float" || name == "float32") type = PLYType::Float32;
+  else if (name == "double" || name == "float64") type = PLYType::Float64;
+  else return false;
+  return true;
+}
+
+size_t plyTypeBytes(PLYType type) {
+  switch (type) {
+  case PLYType::Int8:
+  case PLYType::UInt8:
+    return 1;
+  case PLYType::Int16:
+  case PLYType::UInt16:
+    return 2;
+  case PLYType::Int32:
+  case PLYType::UInt32:
+  case PLYType::Float32:
+    return 4;
+  case PLYType::Float64:
+    return 8;
+  }
+  return 0;
+}
+
+struct PLYProperty {
+  std::string name;
+  PLYType type = PLYType::Float32; // (the item type, for lists)
+  bool isList = false;
+  PLYType countType = PLYType::UInt8;
+};
+
+struct PLYElement {
+  std::string name;
+  size_t count = 0;
+  std::vector<PLYProperty> properties;
+
+  bool isFixedSize() const {
+    for (const PLYProperty& p : properties) {
+      if (p.isList) return false;
+    }
+    return true;
+  }
+  size_t fixedBytes() const {
+    size_t bytes = 0;
+    for (const PLYProperty& p : properties) bytes += plyTypeBytes(p.type);
+    return bytes;
+  }
+};
+
+// Decode one value of the given type (which may be unaligned, and may need a byte swap)
+template <typename T>
+T readPLYValue(const unsigned char* ptr, PLYType type, bool swapBytes) {
+  unsigned char buf[8];
+  size_t nBytes = plyTypeBytes(type);
+  if (swapBytes) {
+    for (size_t i = 0; i < nBytes; i++) buf[i] = ptr[nBytes - 1 - i];
+  } else {
+    std::memcpy(buf, ptr, nBytes);
+  }
+
+  switch (type) {
+  case PLYType::Int8: {
+    int8_t v;
+    std::memcpy(&v, buf, 1);
+    return static_cast<T>(v);
+  }
+  case PLYType::UInt8:
+    return static_cast<T>(buf[0]);
+  case PLYType::Int16: {
+    int16_t v;
+    std::memcpy(&v, buf, 2);
+    return static_cast<T>(v);
+  }
+  case PLYType::UInt16: {
+    uint16_t v;
+    std::memcpy(&v, buf, 2);
+    return static_cast<T>(v);
+  }
+  case PLYType::Int32: {
+    int32_t v;
+    std::memcpy(&v, buf, 4);
+    return static_cast<T>(v);
+  }
+  case PLYType::UInt32: {
+    uint32_t v;
+    std::memcpy(&v, buf, 4);
+    return static_cast<T>(v);
+  }
+  case PLYType::Float32: {
+    float v;
+    std::memcpy(&v, buf, 4);
+    return static_cast<T>(v);
+  }
+  case PLYType::Float64: {
+    double v;
+    std::memcpy(&v, buf, 8);
+    return static_cast<T>(v);
+  }
+  }
+  return T(0);
+}
+
+bool isLittleEndianHost() {
+  uint16_t probe = 1;
+  unsigned char firstByte;
+  std::memcpy(&firstByte, &probe, 1);
+  return firstByte == 1;
+}
+
+// Returns false if the file is ASCII PLY
+bool tryLoadPLY(const std::string& filename, FlatTriangleMesh& mesh, size_t nThreads) {
+
+  MappedFile file(filename);
+  const unsigned char* data = file.data();
+  size_t dataBytes = file.size();
+  auto malformed = [&](const std::string& why) {
+    return std::runtime_error("malformed PLY file " + filename + ": " + why);
+  };
+
+  // == Parse the header
+  const char endHeader[] = "end_header";
+  const unsigned char* headerEnd =
+      std::search(data, data + dataBytes, endHeader, endHeader + sizeof(endHeader) - 1,
+                  [](unsigned char a, char b) { return a == static_cast<unsigned char>(b); });
+  if (headerEnd == data + dataBytes) throw malformed("no end_header");
+  const unsigned char* body = std::find(headerEnd, data + dataBytes, '\n');
+  if (body == data + dataBytes) throw malformed("no data after end_header");
+  body++;
+
+  std::istringstream header(std::string(reinterpret_cast<const char*>(data), headerEnd - data));
+  std::string line;
+  std::getline(header, line);
+  if (line.compare(0, 3, "ply") != 0) throw malformed("missing 'ply' magic");
+
+  bool swapBytes = false;
+  bool foundFormat = false;
+  std::vector<PLYElement> elements;
+  while (std::getline(header, line)) {
+    std::istringstream tokens(line);
+    std::string keyword;
+    if (!(tokens >> keyword)) continue;
+
+    if (keyword == "format") {
+      std::string format;
+      tokens >> format;
+      if (format == "ascii") return false;
+      if (format == "binary_little_endian") swapBytes = !isLittleEndianHost();
+      else if (format == "binary_big_endian") swapBytes = isLittleEndianHost();
+      else throw malformed("unknown format " + format);
+      foundFormat = true;
+    } else if (keyword == "element") {
+      PLYElement elem;
+      if (!(tokens >> elem.name >> elem.count)) throw malformed("bad element line '" + line + "'");
+      elements.push_back(elem);
+    } else if (keyword == "property") {
+      if (elements.empty()) throw malformed("property before any element");
+      PLYProperty prop;
+      std::string typeName;
+      tokens >> typeName;
+      if (typeName == "list") {
+        std::string countTypeName;
+        tokens >> countTypeName >> typeName;
+        prop.isList = true;
+        if (!parsePLYType(countTypeName, prop.countType)) throw malformed("unknown type " + countTypeName);
+      }
+      if (!parsePLYType(typeName, prop.type)) throw malformed("unknown type " + typeName);
+      if (!(tokens >> prop.name)) throw malformed("bad property line '" + line + "'");
+      elements.back().properties.push_back(prop);
+    }
+    // (comment, obj_info, ... are ignored)
+  }
+  if (!foundFormat) throw malformed("no format line");
+
+  // == Read the elements
+  const unsigned char* ptr = body;
+  const unsigned char* end = data + dataBytes;
+  std::vector<int64_t> polygon;
+  for (const PLYElement& elem : elements) {
+    bool isVertex = elem.name == "vertex";
+    bool isFace = elem.name == "face";
+
+    // Locate the properties we need
+    size_t iX = elem.properties.size(), iY = iX, iZ = iX, iIndices = iX;
+    for (size_t iP = 0; iP < elem.properties.size(); iP++) {
+      const PLYProperty& p = elem.properties[iP];
+      if (isVertex && !p.isList && p.name == "x") iX = iP;
+      if (isVertex && !p.isList && p.name == "y") iY = iP;
+      if (isVertex && !p.isList && p.name == "z") iZ = iP;
+      if (isFace && p.isList && (p.name == "vertex_indices" || p.name == "vertex_index")) iIndices = iP;
+    }
+    if (isVertex && (iX == elem.properties.size() || iY == iX || iZ == iX)) {
+      throw malformed("vertex element does not have x, y and z properties");
+    }
+    if (isVertex) {
+      if (elem.count > maxVertices) throw malformed("too many vertices");
+      mesh.vertexPositions.resize(3 * elem.count);
+    }
+
+    if (elem.isFixedSize()) {
+      // Fixed-size records, read them in parallel
+      size_t stride = elem.fixedBytes();
+      if (stride > 0 && elem.count > static_cast<size_t>(end - ptr) / stride) throw malformed("truncated " + elem.name);
+      if (isVertex) {
+        std::array<size_t, 3> offsets = {0, 0, 0};
+        std::array<PLYType, 3> types;
+        std::array<size_t, 3> props = {iX, iY, iZ};
+        for (size_t j = 0; j < 3; j++) {
+          for (size_t iP = 0; iP < props[j]; iP++) offsets[j] += plyTypeBytes(elem.properties[iP].type);
+          types[j] = elem.properties[props[j]].type;
+        }
+        parallelForBlocks(elem.count, nThreads, 1 << 16, [&](size_t iThread, size_t iStart, size_t iEnd) {
+          for (size_t iV = iStart; iV < iEnd; iV++) {
+            const unsigned char* record = ptr + iV * stride;
+            for (size_t j = 0; j < 3; j++) {
+              mesh.vertexPositions[3 * iV + j] = readPLYValue<double>(record + offsets[j], types[j], swapBytes);
+            }
+          }
+        });
+      }
+      ptr += elem.count * stride;
+      continue;
+    }
+
+    // Records containing lists. The common case of a face element holding only triangle indices is still fixed-size in
+    // practice, so try reading it in parallel first.
+    if (isFace && elem.properties.size() == 1 && iIndices == 0) {
+      const PLYProperty& p = elem.properties[0];
+      size_t countBytes = plyTypeBytes(p.countType);
+      size_t indexBytes = plyTypeBytes(p.type);
+      size_t stride = countBytes + 3 * indexBytes;
+      if (elem.count <= static_cast<size_t>(end - ptr) / stride) {
+        std::atomic<bool> allTriangles(true);
+        std::atomic<bool> anyOutOfRange(false);
+        mesh.triangles.resize(3 * elem.count);
+        parallelForBlocks(elem.count, nThreads, 1 << 16, [&](size_t iThread, size_t iStart, size_t iEnd) {
+          for (size_t iF = iStart; iF < iEnd && allTriangles; iF++) {
+            const unsigned char* record = ptr + iF * stride;
+            if (readPLYValue<int64_t>(record, p.countType, swapBytes) != 3) {
+              allTriangles = false;
+              break;
+            }
+            for (size_t j = 0; j < 3; j++) {
+              int64_t ind = readPLYValue<int64_t>(record + countBytes + j * indexBytes, p.type, swapBytes);
+              if (ind < 0 || static_cast<uint64_t>(ind) > maxVertices) {
+                anyOutOfRange = true;
+                ind = 0;
+              }
+              mesh.triangles[3 * iF + j] = static_cast<uint32_t>(ind);
+            }
+          }
+        });
+        if (allTriangles) {
+          if (anyOutOfRange) throw malformed("negative or huge vertex index");
+          ptr += elem.count * stride;
+          continue;
+        }
+        mesh.triangles.clear(); // (not all triangles, start over below)
+      }
+    }
+
+    // General case, walk the records one at a time
+    for (size_t iRec = 0; iRec < elem.count; iRec++) {
+      for (size_t iP = 0; iP < elem.properties.size(); iP++) {
+        const PLYProperty& p = elem.properties[iP];
+        size_t itemBytes = plyTypeBytes(p.type);
+        if (!p.isList) {
+          if (static_cast<size_t>(end - ptr) < itemBytes) throw malformed("truncated " + elem.name);
+          if (isVertex && (iP == iX || iP == iY || iP == iZ)) {
+            size_t j = iP == iX ? 0 : (iP == iY ? 1 : 2);
+            mesh.vertexPositions[3 * iRec + j] = readPLYValue<double>(ptr, p.type, swapBytes);
+          }
+          ptr += itemBytes;
+          continue;
+        }
+
+        size_t countBytes = plyTypeBytes(p.countType);
+        if (static_cast<size_t>(end - ptr) < countBytes) throw malformed("truncated " + elem.name);
+        int64_t count = readPLYValue<int64_t>(ptr, p.countType, swapBytes);
+        ptr += countBytes;
+        if (count < 0 || static_cast<uint64_t>(count) > static_cast<size_t>(end - ptr) / itemBytes) {
+          throw malformed("truncated " + elem.name);
+        }
+        if (iP == iIndices) {
+          polygon.resize(count);
+          for (int64_t j = 0; j < count; j++) {
+            polygon[j] = readPLYValue<int64_t>(ptr + j * itemBytes, p.type, swapBytes);
+            if (polygon[j] < 0 || static_cast<uint64_t>(polygon[j]) > maxVertices) {
+              throw malformed("negative or huge vertex index");
+            }
+          }
+          appendPolygon(polygon.data(), polygon.size(), mesh.triangles);
+        }
+        ptr += count * itemBytes;
+      }
+    }
+  }
+
+  finishTriangles(mesh, nThreads, filename);
+  return true;
+}
+
+
+// === OBJ
+
+// One chunk of the file, parsed independently
+struct OBJChunk {
+  const char* begin = nullptr;
+  const char* end = nullptr;
+
+  std::vector<double> vertexPositions;
+
+  // Polygons, as encoded indices (see parseOBJChunk()) and degrees
+  std::vector<int64_t> polygonIndices;
+  std::vector<uint32_t> polygonDegrees;
+
+  size_t vertexOffset = 0; // the number of vertices in all chunks before this one
+  std::vector<uint32_t> triangles;
+};
+
+bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+void parseOBJChunk(OBJChunk& chunk, const std::string& filename) {
+  std::string line;
+  const char* ptr = chunk.begin;
+  while (ptr < chunk.end) {
+    const char* lineEnd = static_cast<const char*>(std::memchr(ptr, '\n', chunk.end - ptr));
+    if (!lineEnd) lineEnd = chunk.end;
+    const char* lineStart = ptr;
+    ptr = lineEnd + 1;
+
+    while (lineStart < lineEnd && isSpace(*lineStart)) lineStart++;
+    if (lineEnd - lineStart < 2 || !isSpace(lineStart[1])) continue; // (vt, vn, comments, ...)
+    char keyword = lineStart[0];
+    if (keyword != 'v' && keyword != 'f') continue;
+
+    // (copy the line so it is null-terminated for strtod / strtoll; lines are short)
+    line.assign(lineStart + 2, lineEnd);
+    const char* p = line.c_str();
+    char* next = nullptr;
+
+    if (keyword == 'v') {
+      for (int j = 0; j < 3; j++) {
+        double val = std::strtod(p, &next);
+        if (next == p) throw std::runtime_error("malformed vertex line '" + std::string(lineStart, lineEnd) + "' in " +
+                                                filename);
+        chunk.vertexPositions.push_back(val);
+        p = next;
+      }
+      continue;
+    }
+
+    // An index is either absolute and 1-based, or negative and relative to the end of the vertex list so far. Since
+    // earlier chunks have not been counted yet, store absolute indices i as 2 * (i - 1), and relative ones as
+    // 2 * (local vertex index) + 1 (where the local index may be negative).
+    int64_t nLocalVertices = chunk.vertexPositions.size() / 3;
+    uint32_t degree = 0;
+    while (true) {
+      while (isSpace(*p)) p++;
+      if (*p == '\0') break;
+      long long ind = std::strtoll(p, &next, 10);
+      if (next == p || ind == 0) {
+        throw std::runtime_error("malformed face line '" + std::string(lineStart, lineEnd) + "' in " + filename);
+      }
+      chunk.polygonIndices.push_back(ind > 0 ? 2 * (ind - 1) : 2 * (nLocalVertices + ind) + 1);
+      degree++;
+      p = next;
+      while (*p != '\0' && !isSpace(*p)) p++; // (skip any /texture/normal indices)
+    }
+    chunk.polygonDegrees.push_back(degree);
+  }
+}
+
+// Resolve a chunk's polygons to global indices, and fan-triangulate them
+void triangulateOBJChunk(OBJChunk& chunk, uint64_t nVertices, const std::string& filename) {
+  std::vector<int64_t> polygon;
+  const int64_t* encoded = chunk.polygonIndices.data();
+  for (uint32_t degree : chunk.polygonDegrees) {
+    polygon.resize(degree);
+    for (uint32_t j = 0; j < degree; j++) {
+      int64_t e = encoded[j];
+      bool isRelative = (e & 1) != 0;
+      int64_t ind = (e - (isRelative ? 1 : 0)) / 2;
+      if (isRelative) ind += chunk.vertexOffset;
+      polygon[j] = checkIndex(ind, nVertices, filename);
+    }
+    encoded += degree;
+    appendPolygon(polygon.data(), degree, chunk.triangles);
+  }
+  std::vector<int64_t>().swap(chunk.polygonIndices);
+  std::vector<uint32_t>().swap(chunk.polygonDegrees);
+}
+
+} // namespace
+
+
+bool loadFlatMesh(const std::string& filename, FlatTriangleMesh& mesh, size_t nThreads) {
+  mesh = FlatTriangleMesh();
+  std::string ext = lowercaseExtension(filename);
+  if (ext == "ply") {
+    if (!tryLoadPLY(filename, mesh, nThreads)) {
+      mesh = FlatTriangleMesh();
+      return false;
+    }
+    return true;
+  }
+  if (ext == "obj") {
+    loadFlatMeshOBJ(filename, mesh, nThreads);
+    return true;
+  }
+  if (ext == "tmesh") {
+    loadFlatMeshRaw(filename, mesh, nThreads);
+    return true;
+  }
+  return false;
+}
+
+void loadFlatMeshPLY(const std::string& filename, FlatTriangleMesh& mesh, size_t nThreads) {
+  mesh = FlatTriangleMesh();
+  if (!tryLoadPLY(filename, mesh, nThreads)) {
+    throw std::runtime_error("ASCII PLY is not supported by the fast loader: " + filename);
+  }
+}
+
+void loadFlatMeshOBJ(const std::string& filename, FlatTriangleMesh& mesh, size_t nThreads) {
+
+  MappedFile file(filename);
+  file.adviseSequential();
+  const char* data = reinterpret_cast<const char*>(file.data());
+  const char* dataEnd = data + file.size();
+
+  // Split the file in to chunks of whole lines
+  const size_t chunkBytes = 8 << 20;
+  std::vector<OBJChunk> chunks;
+  const char* chunkStart = data;
+  while (chunkStart < dataEnd) {
+    const char* chunkEnd = chunkStart + std::min<size_t>(chunkBytes, dataEnd - chunkStart);
+    if (chunkEnd < dataEnd) {
+      const char* newline = static_cast<const char*>(std::memchr(chunkEnd, '\n', dataEnd - chunkEnd));
+      chunkEnd = newline ? newline + 1 : dataEnd;
+    }
+    OBJChunk chunk;
+    chunk.begin = chunkStart;
+    chunk.end = chunkEnd;
+    chunks.push_back(std::move(chunk));
+    chunkStart = chunkEnd;
+  }
+
+  parallelForBlocks(chunks.size(), nThreads, 1, [&](size_t iThread, size_t iStart, size_t iEnd) {
+    for (size_t iC = iStart; iC < iEnd; iC++) parseOBJChunk(chunks[iC], filename);
+  });
+
+  size_t nVertices = 0;
+  for (OBJChunk& chunk : chunks) {
+    chunk.vertexOffset = nVertices;
+    nVertices += chunk.vertexPositions.size() / 3;
+  }
+  if (nVertices > maxVertices) {
+    throw std::runtime_error("too many vertices for the fast loader in " + filename);
+  }
+
+  parallelForBlocks(chunks.size(), nThreads, 1, [&](size_t iThread, size_t iStart, size_t iEnd) {
+    for (size_t iC = iStart; iC < iEnd; iC++) triangulateOBJChunk(chunks[iC], nVertices, filename);
+  });
+
+  // Gather the chunks in order
+  std::vector<size_t> triangleOffsets(chunks.size() + 1, 0);
+  for (size_t iC = 0; iC < chunks.size(); iC++) {
+    triangleOffsets[iC + 1] = triangleOffsets[iC] + chunks[iC].triangles.size();
+  }
+  mesh.vertexPositions.resize(3 * nVertices);
+  mesh.triangles.resize(triangleOffsets.back());
+  parallelForBlocks(chunks.size(), nThreads, 1, [&](size_t iThread, size_t iStart, size_t iEnd) {
+    for (size_t iC = iStart; iC < iEnd; iC++) {
+      OBJChunk& chunk = chunks[iC];
+      std::copy(chunk.vertexPositions.begin(), chunk.vertexPositions.end(),
+                mesh.vertexPositions.begin() + 3 * chunk.vertexOffset);
+      std::copy(chunk.triangles.begin(), chunk.triangles.end(), mesh.triangles.begin() + triangleOffsets[iC]);
+      std::vector<double>().swap(chunk.vertexPositions);
+      std::vector<uint32_t>().swap(chunk.triangles);
+    }
+  });
+}
+
+
+// === Raw format
+
+namespace {
+
+const char rawMagic[8] = {'T', 'U', 'F', 'T', 'M', 'S', 'H', '\0'};
+
+struct RawHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t nVertices;
+  uint64_t nTriangles;
+};
+static_assert(sizeof(RawHeader) == 32, "unexpected padding in RawHeader");
+
+} // namespace
+
+void loadFlatMeshRaw(const std::string& filename, FlatTriangleMesh& mesh, size_t nThreads) {
+  MappedFile file(filename);
+  const unsigned char* data = file.data();
+  size_t dataBytes = file.size();
+
+  RawHeader header;
+  bool valid = dataBytes >= sizeof(header) && isLittleEndianHost();
+  if (valid) {
+    std::memcpy(&header, data, sizeof(header));
+    valid = std::memcmp(header.magic, rawMagic, sizeof(rawMagic)) == 0 && header.version == 1 &&
+            header.nVertices <= maxVertices && header.nTriangles <= (dataBytes - sizeof(header)) / 12 &&
+            sizeof(header) + 12 * (header.nVertices + header.nTriangles) <= dataBytes;
+  }
+  if (!valid) {
+    throw std::runtime_error("not a valid raw mesh file: " + filename);
+  }
+
+  const unsigned char* positions = data + sizeof(header);
+  const unsigned char* triangles = positions + 12 * header.nVertices;
+
+  mesh.vertexPositions.resize(3 * header.nVertices);
+  parallelForBlocks(mesh.vertexPositions.size(), nThreads, 1 << 18, [&](size_t iThread, size_t iStart, size_t iEnd) {
+    for (size_t i = iStart; i < iEnd; i++) {
+      float val;
+      std::memcpy(&val, positions + 4 * i, 4);
+      mesh.vertexPositions[i] = val;
+    }
+  });
+
+  std::atomic<bool> anyNegative(false);
+  mesh.triangles.resize(3 * header.nTriangles);
+  parallelForBlocks(mesh.triangles.size(), nThreads, 1 << 18, [&](size_t iThread, size_t iStart, size_t iEnd) {
+    for (size_t i = iStart; i < iEnd; i++) {
+      int32_t ind;
+      std::memcpy(&ind, triangles + 4 * i, 4);
+      if (ind < 0) anyNegative = true;
+      mesh.triangles[i] = static_cast<uint32_t>(ind);
+    }
+  });
+  if (anyNegative) {
+    throw std::runtime_error("negative vertex index in " + filename);
+  }
+
+  finishTriangles(mesh, nThreads, filename);
+}
+
+void saveFlatMeshRaw(const std::string& filename, const FlatTriangleMesh& mesh) {
+  if (!isLittleEndianHost()) {
+    throw std::runtime_error("raw mesh files can only be written on little-endian machines");
+  }
+  if (mesh.nVertices() > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+    throw std::runtime_error("too many vertices for a raw mesh file (indices are int32)");
+  }
+
+  std::ofstream outFile(filename, std::ios::binary);
+  if (!outFile) {
+    throw std::runtime_error("failed to open output file " + filename);
+  }
+
+  RawHeader header;
+  std::memcpy(header.magic, rawMagic, sizeof(rawMagic));
+  header.version = 1;
+  header.reserved = 0;
+  header.nVertices = mesh.nVertices();
+  header.nTriangles = mesh.nTriangles();
+  outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  // Convert in blocks, to avoid a full-size temporary
+  const size_t blockSize = 1 << 16;
+  std::vector<float> floatBlock;
+  for (size_t iStart = 0; iStart < mesh.vertexPositions.size(); iStart += blockSize) {
+    size_t iEnd = std::min(iStart + blockSize, mesh.vertexPositions.size());
+    floatBlock.assign(mesh.vertexPositions.begin() + iStart, mesh.vertexPositions.begin() + iEnd);
+    outFile.write(reinterpret_cast<const char*>(floatBlock.data()), floatBlock.size() * sizeof(float));
+  }
+  // (indices below 2^31 have the same bytes as uint32 and int32)
+  outFile.write(reinterpret_cast<const char*>(mesh.triangles.data()), mesh.triangles.size() * sizeof(uint32_t));
+
+  if (!outFile) {
+    throw std::runtime_error("failed to write output file " + filename);
+  }
+}
@@ -0,0 +1,189 @@
+#include "mesh_sanitation.h"
+
+#include "instrumentation.h"
+#include "parallel_utilities.h"
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+const size_t faceBlockSize = 1 << 14;
+
+// The same implementation handles every input layout, through accessors:
+//   faceDegree(iF) -> size_t
+//   faceVertex(iF, j) -> int64_t (so that negative and out-of-range indices can be caught)
+//   vertexPosition(iV, double* xyz)
+template <typename DegreeFunc, typename VertexFunc, typename PositionFunc>
+SanitizedMesh sanitize(size_t nVertices, size_t nFaces, DegreeFunc&& faceDegree, VertexFunc&& faceVertex,
+                       PositionFunc&& vertexPosition, size_t nThreads) {
+  TUFTED_TRACE_SCOPE("sanitize");
+
+  if (nVertices > std::numeric_limits<uint32_t>::max()) {
+    throw std::runtime_error("too many vertices (" + std::to_string(nVertices) + "), indices are stored as uint32");
+  }
+
+  // 0 if the face should be kept, 1 if it is dropped, 2 if it references a nonexistent vertex
+  auto classifyFace = [&](size_t iF) {
+    size_t degree = faceDegree(iF);
+    for (size_t j = 0; j < degree; j++) {
+      int64_t iV = faceVertex(iF, j);
+      if (iV < 0 || static_cast<uint64_t>(iV) >= nVertices) return 2;
+    }
+    if (degree < 3) return 1;
+    for (size_t j = 0; j < degree; j++) {
+      int64_t iV = faceVertex(iF, j);
+      for (size_t k = j + 1; k < degree; k++) {
+        if (faceVertex(iF, k) == iV) return 1;
+      }
+    }
+    return 0;
+  };
+
+  // == Pass over the faces: count output triangles per block, and mark used vertices
+  size_t nBlocks = (nFaces + faceBlockSize - 1) / faceBlockSize;
+  std::vector<size_t> blockTriangleStart(nBlocks + 1, 0);
+  std::vector<size_t> blockDropped(nBlocks, 0);
+  std::unique_ptr<std::atomic<uint8_t>[]> isUsed(new std::atomic<uint8_t>[nVertices]);
+  for (size_t iV = 0; iV < nVertices; iV++) isUsed[iV].store(0, std::memory_order_relaxed);
+  std::atomic<bool> anyInvalid(false);
+
+  parallelForBlocks(nFaces, nThreads, faceBlockSize, [&](size_t iThread, size_t iStart, size_t iEnd) {
+    size_t iBlock = iStart / faceBlockSize;
+    size_t nTriangles = 0, nDropped = 0;
+    for (size_t iF = iStart; iF < iEnd; iF++) {
+      int faceClass = classifyFace(iF);
+      if (faceClass == 2) {
+        anyInvalid = true;
+        return;
+      }
+      if (faceClass == 1) {
+        nDropped++;
+        continue;
+      }
+      size_t degree = faceDegree(iF);
+      nTriangles += degree - 2;
+      for (size_t j = 0; j < degree; j++) isUsed[faceVertex(iF, j)].store(1, std::memory_order_relaxed);
+    }
+    blockTriangleStart[iBlock + 1] = nTriangles;
+    blockDropped[iBlock] = nDropped;
+  });
+
+  if (anyInvalid) {
+    // (find the first bad face, so the error does not depend on the thread count)
+    for (size_t iF = 0; iF < nFaces; iF++) {
+      for (size_t j = 0; j < faceDegree(iF); j++) {
+        int64_t iV = faceVertex(iF, j);
+        if (iV < 0 || static_cast<uint64_t>(iV) >= nVertices) {
+          throw std::runtime_error("face " + std::to_string(iF) + " references vertex " + std::to_string(iV) +
+                                   ", but there are only " + std::to_string(nVertices) + " vertices");
+        }
+      }
+    }
+  }
+
+  SanitizedMesh result;
+  for (size_t iBlock = 0; iBlock < nBlocks; iBlock++) {
+    blockTriangleStart[iBlock + 1] += blockTriangleStart[iBlock];
+    result.nDroppedFaces += blockDropped[iBlock];
+  }
+
+  // == Renumber the used vertices, in order
+  result.oldToNew.resize(nVertices);
+  for (size_t iV = 0; iV < nVertices; iV++) {
+    if (isUsed[iV].load(std::memory_order_relaxed)) {
+      result.oldToNew[iV] = result.newToOld.size();
+      result.newToOld.push_back(iV);
+    } else {
+      result.oldToNew[iV] = INVALID_IND;
+    }
+  }
+  isUsed.reset();
+
+  FlatTriangleMesh& mesh = result.mesh;
+  mesh.vertexPositions.resize(3 * result.newToOld.size());
+  parallelFor(result.newToOld.size(), nThreads,
+              [&](size_t iThread, size_t iV) { vertexPosition(result.newToOld[iV], &mesh.vertexPositions[3 * iV]); });
+
+  // == Pass over the faces again, writing fan-triangulated output
+  mesh.triangles.resize(3 * blockTriangleStart[nBlocks]);
+  parallelForBlocks(nFaces, nThreads, faceBlockSize, [&](size_t iThread, size_t iStart, size_t iEnd) {
+    uint32_t* out = mesh.triangles.data() + 3 * blockTriangleStart[iStart / faceBlockSize];
+    for (size_t iF = iStart; iF < iEnd; iF++) {
+      if (classifyFace(iF) != 0) continue;
+      uint32_t root = static_cast<uint32_t>(result.oldToNew[faceVertex(iF, 0)]);
+      size_t degree = faceDegree(iF);
+      for (size_t j = 1; j + 1 < degree; j++) {
+        *out++ = root;
+        *out++ = static_cast<uint32_t>(result.oldToNew[faceVertex(iF, j)]);
+        *out++ = static_cast<uint32_t>(result.oldToNew[faceVertex(iF, j + 1)]);
+      }
+    }
+  });
+
+  return result;
+}
+
+void copyVector3(const Vector3& p, double* xyz) {
+  xyz[0] = p.x;
+  xyz[1] = p.y;
+  xyz[2] = p.z;
+}
+
+} // namespace
+
+
+SanitizedMesh sanitizePolygons(const std::vector<Vector3>& vertexPositions,
+                               const std::vector<std::vector<size_t>>& polygons, size_t nThreads) {
+  return sanitize(
+      vertexPositions.size(), polygons.size(), [&](size_t iF) { return polygons[iF].size(); },
+      [&](size_t iF, size_t j) { return static_cast<int64_t>(polygons[iF][j]); },
+      [&](size_t iV, double* xyz) { copyVector3(vertexPositions[iV], xyz); }, nThreads);
+}
+
+SanitizedMesh sanitizeTriangles(const std::vector<Vector3>& vertexPositions,
+                                const std::vector<std::array<size_t, 3>>& triangles, size_t nThreads) {
+  return sanitize(
+      vertexPositions.size(), triangles.size(), [](size_t iF) { return static_cast<size_t>(3); },
+      [&](size_t iF, size_t j) { return static_cast<int64_t>(triangles[iF][j]); },
+      [&](size_t iV, double* xyz) { copyVector3(vertexPositions[iV], xyz); }, nThreads);
+}
+
+template <typename IndexT>
+SanitizedMesh sanitizeFaces(const double* vertexPositions, size_t nVertices, const IndexT* faceIndices, size_t nFaces,
+                            size_t faceDegree, size_t nThreads) {
+  return sanitize(
+      nVertices, nFaces, [&](size_t iF) { return faceDegree; },
+      [&](size_t iF, size_t j) { return static_cast<int64_t>(faceIndices[iF * faceDegree + j]); },
+      [&](size_t iV, double* xyz) {
+        const double* p = vertexPositions + 3 * iV;
+        xyz[0] = p[0];
+        xyz[1] = p[1];
+        xyz[2] = p[2];
+      },
+      nThreads);
+}
+
+template SanitizedMesh sanitizeFaces(const double*, size_t, const int32_t*, size_t, size_t, size_t);
+template SanitizedMesh sanitizeFaces(const double*, size_t, const uint32_t*, size_t, size_t, size_t);
+template SanitizedMesh sanitizeFaces(const double*, size_t, const int64_t*, size_t, size_t, size_t);
+template SanitizedMesh sanitizeFaces(const double*, size_t, const uint64_t*, size_t, size_t, size_t);
+
+SimplePolygonMesh toSimplePolygonMesh(const FlatTriangleMesh& mesh) {
+  SimplePolygonMesh polygonMesh;
+  polygonMesh.vertexCoordinates.resize(mesh.nVertices());
+  for (size_t iV = 0; iV < mesh.nVertices(); iV++) {
+    const double* p = &mesh.vertexPositions[3 * iV];
+    polygonMesh.vertexCoordinates[iV] = Vector3{p[0], p[1], p[2]};
+  }
+  polygonMesh.polygons.resize(mesh.nTriangles());
+  for (size_t iT = 0; iT < mesh.nTriangles(); iT++) {
+    const uint32_t* t = &mesh.triangles[3 * iT];
+    polygonMesh.polygons[iT] = {t[0], t[1], t[2]};
+  }
+  return polygonMesh;
+}
@@ -0,0 +1,316 @@
+#include "operator_assembly.h"
+
+#include "instrumentation.h"
+#include "parallel_utilities.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// Split order[start, end) in to nParts parts: along the longest axis of its box, with the points put in each half in
+// proportion to its share of the parts
+void splitParts(const std::vector<Vector3>& points, std::vector<uint32_t>& order, size_t start, size_t end,
+                Vector3 boxMin, Vector3 boxMax, size_t nParts, std::vector<SpatialPart>& parts) {
+  if (nParts == 1) {
+    parts.push_back(SpatialPart{boxMin, boxMax, start, end});
+    return;
+  }
+
+  Vector3 extent = boxMax - boxMin;
+  int axis = 0;
+  for (int c = 1; c < 3; c++) {
+    if (extent[c] > extent[axis]) axis = c;
+  }
+  size_t nLowerParts = nParts / 2;
+  size_t mid = start + (end - start) * nLowerParts / nParts;
+  double split = boxMin[axis];
+  if (mid < end) {
+    std::nth_element(order.begin() + start, order.begin() + mid, order.begin() + end,
+                     [&](uint32_t iA, uint32_t iB) { return points[iA][axis] < points[iB][axis]; });
+    split = points[order[mid]][axis];
+  }
+
+  Vector3 lowerMax = boxMax;
+  lowerMax[axis] = split;
+  Vector3 upperMin = boxMin;
+  upperMin[axis] = split;
+  splitParts(points, order, start, mid, boxMin, lowerMax, nLowerParts, parts);
+  splitParts(points, order, mid, end, upperMin, boxMax, nParts - nLowerParts, parts);
+}
+
+const char blockMagic[8] = {'T', 'U', 'F', 'T', 'B', 'L', 'K', '\0'};
+
+struct BlockHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t nRows;
+  uint64_t nPieces;
+  uint64_t iPiece;
+  uint64_t nEntries;
+  uint64_t nMasses;
+};
+
+// Reads a block file's header, then its records in chunks
+class BlockReader {
+public:
+  explicit BlockReader(const std::string& filename_) : filename(filename_), file(std::fopen(filename.c_str(), "rb")) {
+    if (!file) throw std::runtime_error("failed to open operator block " + filename);
+    if (std::fread(&header, sizeof(header), 1, file) != 1 || std::memcmp(header.magic, blockMagic, 8) != 0 ||
+        header.version != 1) {
+      std::fclose(file);
+      throw std::runtime_error("not an operator block file: " + filename);
+    }
+  }
+  ~BlockReader() { std::fclose(file); }
+  BlockReader(const BlockReader&) = delete;
+  BlockReader& operator=(const BlockReader&) = delete;
+
+  const BlockHeader& getHeader() const { return header; }
+
+  // func(entries, nEntries) over the entries of L, then massFunc(masses, nMasses) over the masses
+  template <typename Func, typename MassFunc>
+  void forEachChunk(Func&& func, MassFunc&& massFunc) {
+    if (std::fseek(file, sizeof(BlockHeader), SEEK_SET) != 0) fail();
+    std::vector<OperatorEntry> chunk(1 << 16);
+    readRecords(header.nEntries, chunk, func);
+    readRecords(header.nMasses, chunk, massFunc);
+  }
+
+private:
+  template <typename Func>
+  void readRecords(uint64_t nRecords, std::vector<OperatorEntry>& chunk, Func&& func) {
+    while (nRecords > 0) {
+      size_t nWanted = static_cast<size_t>(std::min<uint64_t>(nRecords, chunk.size()));
+      if (std::fread(chunk.data(), sizeof(OperatorEntry), nWanted, file) != nWanted) fail();
+      for (size_t i = 0; i < nWanted; i++) {
+        if (chunk[i].row >= header.nRows || chunk[i].col >= header.nRows) fail();
+      }
+      func(chunk.data(), nWanted);
+      nRecords -= nWanted;
+    }
+  }
+
+  void fail() { throw std::runtime_error("failed to read operator block " + filename); }
+
+  std::string filename;
+  std::FILE* file;
+  BlockHeader header;
+};
+
+} // namespace
+
+
+SpatialSplit splitSpatially(const std::vector<Vector3>& points, size_t nParts) {
+  if (points.size() >= std::numeric_limits<uint32_t>::max()) {
+    throw std::runtime_error("too many points for a spatial split");
+  }
+  if (nParts == 0 || points.empty()) {
+    throw std::runtime_error("a spatial split needs at least one part and one point");
+  }
+
+  Vector3 boxMin = points.front(), boxMax = points.front();
+  for (const Vector3& p : points) {
+    for (int c = 0; c < 3; c++) {
+      boxMin[c] = std::min(boxMin[c], p[c]);
+      boxMax[c] = std::max(boxMax[c], p[c]);
+    }
+  }
+
+  SpatialSplit split;
+  split.order.resize(points.size());
+  for (size_t iPt = 0; iPt < points.size(); iPt++) split.order[iPt] = static_cast<uint32_t>(iPt);
+  splitParts(points, split.order, 0, points.size(), boxMin, boxMax, nParts, split.parts);
+
+  split.partOf.resize(points.size());
+  for (size_t iPart = 0; iPart < split.parts.size(); iPart++) {
+    for (size_t i = split.parts[iPart].start; i < split.parts[iPart].end; i++) {
+      split.partOf[split.order[i]] = static_cast<uint32_t>(iPart);
+    }
+  }
+  return split;
+}
+
+double pointBoxDistance2(const Vector3& p, const SpatialPart& part) {
+  double dist2 = 0.;
+  for (int c = 0; c < 3; c++) {
+    double d = std::max(std::max(part.boxMin[c] - p[c], p[c] - part.boxMax[c]), 0.);
+    dist2 += d * d;
+  }
+  return dist2;
+}
+
+double boxBoxDistance2(const SpatialPart& a, const SpatialPart& b) {
+  double dist2 = 0.;
+  for (int c = 0; c < 3; c++) {
+    double d = std::max(std::max(a.boxMin[c] - b.boxMax[c], b.boxMin[c] - a.boxMax[c]), 0.);
+    dist2 += d * d;
+  }
+  return dist2;
+}
+
+
+LaplacianAssembler::LaplacianAssembler(size_t nRows_) : nRows(nRows_), colCounts(nRows_, 0) {}
+
+void LaplacianAssembler::allocate() {
+  typedef SparseMatrix<double>::StorageIndex StorageIndex;
+
+  size_t nnz = 0;
+  for (size_t count : colCounts) nnz += count > 0 ? count + 1 : 0;
+  if (nnz > static_cast<size_t>(std::numeric_limits<StorageIndex>::max())) {
+    throw std::runtime_error("assembled Laplacian has too many entries for 32-bit indices");
+  }
+
+  L = SparseMatrix<double>(nRows, nRows);
+  L.resizeNonZeros(nnz);
+  StorageIndex* outer = L.outerIndexPtr();
+  outer[0] = 0;
+  for (size_t iCol = 0; iCol < nRows; iCol++) {
+    size_t count = colCounts[iCol];
+    outer[iCol + 1] = outer[iCol] + static_cast<StorageIndex>(count > 0 ? count + 1 : 0);
+  }
+
+  // The diagonal entry goes first, for now
+  nextEntry.assign(outer, outer + nRows);
+  for (size_t iCol = 0; iCol < nRows; iCol++) {
+    if (colCounts[iCol] == 0) continue;
+    L.innerIndexPtr()[nextEntry[iCol]] = static_cast<StorageIndex>(iCol);
+    L.valuePtr()[nextEntry[iCol]] = 0.;
+    nextEntry[iCol]++;
+  }
+  colCounts = std::vector<size_t>();
+}
+
+SparseMatrix<double> LaplacianAssembler::finish(size_t nThreads) {
+  TUFTED_TRACE_SCOPE("assemble");
+  typedef SparseMatrix<double>::StorageIndex StorageIndex;
+  nextEntry = std::vector<size_t>();
+
+  const StorageIndex* outer = L.outerIndexPtr();
+  StorageIndex* inner = L.innerIndexPtr();
+  double* values = L.valuePtr();
+  parallelForBlocks(nRows, nThreads, 1024, [&](size_t iThread, size_t iStart, size_t iEnd) {
+    std::vector<std::pair<StorageIndex, double>> column;
+    for (size_t iCol = iStart; iCol < iEnd; iCol++) {
+      column.clear();
+      double offDiagonalSum = 0.;
+      for (StorageIndex iEntry = outer[iCol]; iEntry < outer[iCol + 1]; iEntry++) {
+        column.emplace_back(inner[iEntry], values[iEntry]);
+        if (static_cast<size_t>(inner[iEntry]) != iCol) offDiagonalSum += values[iEntry];
+      }
+      std::sort(column.begin(), column.end());
+      for (size_t j = 0; j < column.size(); j++) {
+        StorageIndex iEntry = outer[iCol] + static_cast<StorageIndex>(j);
+        inner[iEntry] = column[j].first;
+        values[iEntry] = static_cast<size_t>(column[j].first) == iCol ? -offDiagonalSum : column[j].second;
+      }
+    }
+  });
+
+  SparseMatrix<double> finished = std::move(L);
+  L = SparseMatrix<double>();
+  return finished;
+}
+
+
+OperatorEntryFile::OperatorEntryFile() : file(std::tmpfile()) {
+  if (!file) throw std::runtime_error("failed to create a temporary file for operator entries");
+  buffer.reserve(bufferEntries);
+}
+
+OperatorEntryFile::~OperatorEntryFile() { std::fclose(file); }
+
+void OperatorEntryFile::flush() {
+  if (!buffer.empty() && std::fwrite(buffer.data(), sizeof(OperatorEntry), buffer.size(), file) != buffer.size()) {
+    throw std::runtime_error("failed to write a temporary file of operator entries");
+  }
+  buffer.clear();
+}
+
+void OperatorEntryFile::checkReadError() {
+  if (std::ferror(file)) {
+    throw std::runtime_error("failed to read a temporary file of operator entries");
+  }
+}
+
+const size_t OperatorEntryFile::bufferEntries;
+
+
+void saveOperatorBlock(const std::string& filename, size_t nRows, size_t nPieces, size_t iPiece,
+                       const std::vector<OperatorEntry>& entries, const std::vector<OperatorEntry>& masses) {
+  BlockHeader header;
+  std::memcpy(header.magic, blockMagic, sizeof(blockMagic));
+  header.version = 1;
+  header.reserved = 0;
+  header.nRows = nRows;
+  header.nPieces = nPieces;
+  header.iPiece = iPiece;
+  header.nEntries = entries.size();
+  header.nMasses = masses.size();
+
+  std::unique_ptr<std::FILE, int (*)(std::FILE*)> file(std::fopen(filename.c_str(), "wb"), &std::fclose);
+  if (!file) throw std::runtime_error("failed to open output file " + filename);
+  bool ok = std::fwrite(&header, sizeof(header), 1, file.get()) == 1;
+  ok = ok && std::fwrite(entries.data(), sizeof(OperatorEntry), entries.size(), file.get()) == entries.size();
+  ok = ok && std::fwrite(masses.data(), sizeof(OperatorEntry), masses.size(), file.get()) == masses.size();
+  ok = (std::fclose(file.release()) == 0) && ok;
+  if (!ok) throw std::runtime_error("failed to write output file " + filename);
+}
+
+void mergeOperatorBlocks(const std::vector<std::string>& filenames, SparseMatrix<double>& L, SparseMatrix<double>& M,
+                         size_t nThreads) {
+  TUFTED_TRACE_SCOPE("merge blocks");
+  if (filenames.empty()) throw std::runtime_error("no operator blocks to merge");
+
+  // Check that the blocks are exactly the pieces of one build
+  size_t nRows = 0, nPieces = 0;
+  std::vector<char> havePiece;
+  for (const std::string& filename : filenames) {
+    BlockReader reader(filename);
+    const BlockHeader& header = reader.getHeader();
+    if (havePiece.empty()) {
+      nRows = header.nRows;
+      nPieces = header.nPieces;
+      havePiece.assign(nPieces, false);
+    }
+    if (header.nRows != nRows || header.nPieces != nPieces || header.iPiece >= nPieces) {
+      throw std::runtime_error("operator block " + filename + " is from a different build");
+    }
+    if (havePiece[header.iPiece]) {
+      throw std::runtime_error("operator block " + filename + " repeats piece " + std::to_string(header.iPiece));
+    }
+    havePiece[header.iPiece] = true;
+  }
+  for (size_t iPiece = 0; iPiece < nPieces; iPiece++) {
+    if (!havePiece[iPiece]) throw std::runtime_error("missing operator block for piece " + std::to_string(iPiece));
+  }
+
+  LaplacianAssembler assembler(nRows);
+  std::vector<Eigen::Triplet<double>> massTriplets;
+  for (const std::string& filename : filenames) {
+    BlockReader(filename).forEachChunk(
+        [&](const OperatorEntry* entries, size_t n) {
+          for (size_t i = 0; i < n; i++) assembler.count(entries[i]);
+        },
+        [&](const OperatorEntry* masses, size_t n) {
+          for (size_t i = 0; i < n; i++) massTriplets.emplace_back(masses[i].row, masses[i].row, masses[i].value);
+        });
+  }
+  assembler.allocate();
+  for (const std::string& filename : filenames) {
+    BlockReader(filename).forEachChunk(
+        [&](const OperatorEntry* entries, size_t n) {
+          for (size_t i = 0; i < n; i++) assembler.place(entries[i]);
+        },
+        [&](const OperatorEntry* masses, size_t n) {});
+  }
+  L = assembler.finish(nThreads);
+
+  M = SparseMatrix<double>(nRows, nRows);
+  M.setFromTriplets(massTriplets.begin(), massTriplets.end());
+}
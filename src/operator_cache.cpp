@@ -0,0 +1,162 @@
+#include "operator_cache.h"
+
+#include "matrix_io.h"
+#include "parallel_utilities.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#else
+#include <direct.h>
+#endif
+
+namespace {
+
+// Bump this whenever the operators change for the same input, to invalidate old entries
+const uint64_t cacheVersion = 2;
+
+const size_t hashBlockBytes = 1 << 20;
+const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+
+// Two independent 64-bit lanes
+struct Hash128 {
+  uint64_t a, b;
+};
+
+uint64_t rotateLeft(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+void hashWord(Hash128& h, uint64_t w) {
+  h.a = rotateLeft(h.a + w * prime2, 31) * prime1;
+  h.b = rotateLeft(h.b ^ (w * prime1), 27) * prime2 + w;
+}
+
+uint64_t finalMix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDULL;
+  h ^= h >> 33;
+  h *= 0xC4CEB9FE1A85EC53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+uint64_t doubleBits(double x) {
+  uint64_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+Hash128 hashBlock(const unsigned char* bytes, size_t nBytes) {
+  Hash128 h = {prime1, prime2};
+  size_t nWords = nBytes / sizeof(uint64_t);
+  for (size_t i = 0; i < nWords; i++) {
+    uint64_t w;
+    std::memcpy(&w, bytes + i * sizeof(uint64_t), sizeof(w));
+    hashWord(h, w);
+  }
+  size_t nTail = nBytes % sizeof(uint64_t);
+  if (nTail > 0) {
+    uint64_t w = 0;
+    std::memcpy(&w, bytes + nWords * sizeof(uint64_t), nTail);
+    hashWord(h, w);
+  }
+  return h;
+}
+
+// Fixed-size blocks are hashed in parallel, then combined in order
+void hashBuffer(Hash128& h, const void* data, size_t nBytes, size_t nThreads) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  size_t nBlocks = (nBytes + hashBlockBytes - 1) / hashBlockBytes;
+  std::vector<Hash128> blockHashes(nBlocks);
+  parallelFor(nBlocks, nThreads, [&](size_t iThread, size_t iBlock) {
+    size_t start = iBlock * hashBlockBytes;
+    blockHashes[iBlock] = hashBlock(bytes + start, std::min(hashBlockBytes, nBytes - start));
+  });
+  for (const Hash128& blockHash : blockHashes) {
+    hashWord(h, blockHash.a);
+    hashWord(h, blockHash.b);
+  }
+  hashWord(h, nBytes);
+}
+
+std::string entryFilename(const std::string& directory, const std::string& key) {
+  return directory + "/" + key + ".mmap";
+}
+
+// Create a directory, if it does not already exist
+void makeDirectory(const std::string& directory) {
+#ifndef _WIN32
+  int status = mkdir(directory.c_str(), 0755);
+#else
+  int status = _mkdir(directory.c_str());
+#endif
+  if (status != 0 && errno != EEXIST) {
+    throw std::runtime_error("failed to create cache directory " + directory);
+  }
+}
+
+} // namespace
+
+
+std::string operatorCacheKey(const FlatTriangleMesh& mesh, double mollifyFactor, double scale,
+                             const std::vector<double>& faceScales, size_t nThreads) {
+  Hash128 h = {prime1, prime2};
+  hashWord(h, cacheVersion);
+  hashWord(h, doubleBits(mollifyFactor));
+  hashWord(h, doubleBits(scale));
+  hashBuffer(h, mesh.vertexPositions.data(), mesh.vertexPositions.size() * sizeof(double), nThreads);
+  hashBuffer(h, mesh.triangles.data(), mesh.triangles.size() * sizeof(uint32_t), nThreads);
+  hashBuffer(h, faceScales.data(), faceScales.size() * sizeof(double), nThreads);
+
+  char hex[33];
+  std::snprintf(hex, sizeof(hex), "%016llx%016llx", static_cast<unsigned long long>(finalMix(h.a)),
+                static_cast<unsigned long long>(finalMix(h.b)));
+  return std::string(hex);
+}
+
+bool loadCachedOperators(const std::string& directory, const std::string& key, size_t nVertices,
+                         SparseMatrix<double>& L, SparseMatrix<double>& M) {
+  try {
+    MappedOperators operators(entryFilename(directory, key));
+    if (static_cast<size_t>(operators.laplacian().rows()) != nVertices) return false;
+
+    SparseMatrix<double> cachedL = operators.laplacian();
+    Eigen::Map<const Eigen::VectorXd> massDiagonal = operators.massDiagonal();
+    std::vector<Eigen::Triplet<double>> massTriplets;
+    massTriplets.reserve(nVertices);
+    for (size_t iV = 0; iV < nVertices; iV++) massTriplets.emplace_back(iV, iV, massDiagonal[iV]);
+
+    L = std::move(cachedL);
+    M = SparseMatrix<double>(nVertices, nVertices);
+    M.setFromTriplets(massTriplets.begin(), massTriplets.end());
+    return true;
+  } catch (const std::runtime_error&) {
+    // (missing or invalid, either way a miss)
+    return false;
+  }
+}
+
+void saveCachedOperators(const std::string& directory, const std::string& key, const SparseMatrix<double>& L,
+                         const SparseMatrix<double>& M) {
+  makeDirectory(directory);
+  std::string filename = entryFilename(directory, key);
+  std::string tempFilename = filename + ".tmp" + std::to_string(std::random_device()());
+
+  saveOperatorsMapped(tempFilename, L, M);
+  if (std::rename(tempFilename.c_str(), filename.c_str()) != 0) {
+    std::remove(tempFilename.c_str());
+    // (fine if another run wrote the same entry first)
+    if (!std::ifstream(filename)) {
+      throw std::runtime_error("failed to move cache entry in to place: " + filename);
+    }
+  }
+}
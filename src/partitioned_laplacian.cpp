@@ -0,0 +1,194 @@
+#include "partitioned_laplacian.h"
+
+#include "instrumentation.h"
+#include "mesh_sanitation.h"
+#include "operator_assembly.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+using namespace geometrycentral;
+using namespace geometrycentral::surface;
+
+namespace {
+
+void buildPartitionOfSanitizedMesh(SanitizedMesh& sanitized, size_t nInputVertices, size_t nPartitions,
+                                   size_t iPartition, size_t ghostRings, const std::string& blockFilename,
+                                   const TuftedLaplacianOptions& options) {
+  TUFTED_TRACE_SCOPE("partition");
+
+  std::ostream nullLog(nullptr);
+  std::ostream& log = options.log ? *options.log : nullLog;
+
+  const FlatTriangleMesh& mesh = sanitized.mesh;
+  size_t nVertices = mesh.nVertices();
+  size_t nFaces = mesh.nTriangles();
+  if (iPartition >= nPartitions) {
+    throw std::runtime_error("partition " + std::to_string(iPartition) + " is out of range for " +
+                             std::to_string(nPartitions) + " partitions");
+  }
+  if (nPartitions > nVertices) {
+    throw std::runtime_error("cannot split " + std::to_string(nVertices) + " vertices in to " +
+                             std::to_string(nPartitions) + " partitions");
+  }
+  if (std::max(nInputVertices, nFaces) >= std::numeric_limits<uint32_t>::max()) {
+    throw std::runtime_error("too many vertices or faces for a partitioned build");
+  }
+
+  // == Split the vertices (exactly as every other partition does)
+  std::vector<Vector3> positions(nVertices);
+  for (size_t iV = 0; iV < nVertices; iV++) {
+    const double* p = &mesh.vertexPositions[3 * iV];
+    positions[iV] = Vector3{p[0], p[1], p[2]};
+  }
+  SpatialSplit split = splitSpatially(positions, nPartitions);
+  positions = std::vector<Vector3>();
+  const SpatialPart& part = split.parts[iPartition];
+
+  // == Gather the faces within ghostRings rings of the owned vertices
+
+  // The faces around each vertex
+  std::vector<size_t> vertexFaceStart(nVertices + 1, 0);
+  for (uint32_t iV : mesh.triangles) vertexFaceStart[iV + 1]++;
+  for (size_t iV = 0; iV < nVertices; iV++) vertexFaceStart[iV + 1] += vertexFaceStart[iV];
+  std::vector<uint32_t> vertexFaces(mesh.triangles.size());
+  {
+    std::vector<size_t> nextSlot(vertexFaceStart.begin(), vertexFaceStart.end() - 1);
+    for (size_t iF = 0; iF < nFaces; iF++) {
+      for (int j = 0; j < 3; j++) vertexFaces[nextSlot[mesh.triangles[3 * iF + j]]++] = static_cast<uint32_t>(iF);
+    }
+  }
+
+  std::vector<char> isLocalVertex(nVertices, false), isLocalFace(nFaces, false);
+  std::vector<uint32_t> frontier(split.order.begin() + part.start, split.order.begin() + part.end);
+  for (uint32_t iV : frontier) isLocalVertex[iV] = true;
+  std::vector<uint32_t> localFaces;
+  for (size_t iRing = 0; iRing <= ghostRings && !frontier.empty(); iRing++) {
+    std::vector<uint32_t> nextFrontier;
+    for (uint32_t iV : frontier) {
+      for (size_t iSlot = vertexFaceStart[iV]; iSlot < vertexFaceStart[iV + 1]; iSlot++) {
+        uint32_t iF = vertexFaces[iSlot];
+        if (isLocalFace[iF]) continue;
+        isLocalFace[iF] = true;
+        localFaces.push_back(iF);
+        for (int j = 0; j < 3; j++) {
+          uint32_t iW = mesh.triangles[3 * iF + j];
+          if (isLocalVertex[iW]) continue;
+          isLocalVertex[iW] = true;
+          nextFrontier.push_back(iW);
+        }
+      }
+    }
+    frontier.swap(nextFrontier);
+  }
+  vertexFaceStart = std::vector<size_t>();
+  vertexFaces = std::vector<uint32_t>();
+  isLocalFace = std::vector<char>();
+
+  // Keep the faces and vertices in their input order, so the partition sees the same mesh as a whole build would
+  std::sort(localFaces.begin(), localFaces.end());
+  std::vector<uint32_t> localToGlobal;
+  std::vector<uint32_t> globalToLocal(nVertices, std::numeric_limits<uint32_t>::max());
+  for (size_t iV = 0; iV < nVertices; iV++) {
+    if (!isLocalVertex[iV]) continue;
+    globalToLocal[iV] = static_cast<uint32_t>(localToGlobal.size());
+    localToGlobal.push_back(static_cast<uint32_t>(iV));
+  }
+  isLocalVertex = std::vector<char>();
+
+  std::vector<double> localPositions(3 * localToGlobal.size());
+  for (size_t iL = 0; iL < localToGlobal.size(); iL++) {
+    for (int c = 0; c < 3; c++) localPositions[3 * iL + c] = mesh.vertexPositions[3 * localToGlobal[iL] + c];
+  }
+  std::vector<uint32_t> localTriangles(3 * localFaces.size());
+  for (size_t iLF = 0; iLF < localFaces.size(); iLF++) {
+    for (int j = 0; j < 3; j++) localTriangles[3 * iLF + j] = globalToLocal[mesh.triangles[3 * localFaces[iLF] + j]];
+  }
+  globalToLocal = std::vector<uint32_t>();
+
+  size_t nOwned = part.end - part.start;
+  log << "partition " << iPartition << " / " << nPartitions << ": " << nOwned << " vertices, with "
+      << (localToGlobal.size() - nOwned) << " in the ghost layer, and " << localFaces.size() << " faces" << std::endl;
+  localFaces = std::vector<uint32_t>();
+
+  // == Build it, indexed by local vertex
+  TuftedLaplacianOptions partOptions = options;
+  partOptions.preserveVertexIndices = true;
+  partOptions.keepTuftedCover = false;
+  partOptions.cacheDirectory.clear();
+  partOptions.log = nullptr;
+  TuftedLaplacianResult partResult =
+      buildTuftedLaplacianFromMesh(localPositions.data(), localToGlobal.size(), localTriangles.data(),
+                                   localTriangles.size() / 3, 3, partOptions);
+  localPositions = std::vector<double>();
+  localTriangles = std::vector<uint32_t>();
+
+  // == Write out the entries and masses this partition owns
+  size_t nRows = options.preserveVertexIndices ? nInputVertices : nVertices;
+  auto rowOf = [&](uint32_t iV) {
+    return static_cast<uint32_t>(options.preserveVertexIndices ? sanitized.newToOld[iV] : iV);
+  };
+
+  std::vector<OperatorEntry> entries;
+  const SparseMatrix<double>& partL = partResult.L;
+  for (int iCol = 0; iCol < partL.outerSize(); iCol++) {
+    for (SparseMatrix<double>::InnerIterator it(partL, iCol); it; ++it) {
+      if (it.row() == it.col()) continue;
+      uint32_t iA = localToGlobal[it.row()], iB = localToGlobal[it.col()];
+      if (split.partOf[std::min(iA, iB)] != iPartition) continue;
+      entries.push_back(OperatorEntry{rowOf(iA), rowOf(iB), it.value()});
+    }
+  }
+  std::vector<OperatorEntry> masses;
+  Eigen::VectorXd partMass = partResult.M.diagonal();
+  for (size_t iL = 0; iL < localToGlobal.size(); iL++) {
+    uint32_t iV = localToGlobal[iL];
+    if (split.partOf[iV] != iPartition) continue;
+    masses.push_back(OperatorEntry{rowOf(iV), rowOf(iV), partMass[iL]});
+  }
+
+  saveOperatorBlock(blockFilename, nRows, nPartitions, iPartition, entries, masses);
+}
+
+} // namespace
+
+
+template <typename IndexT>
+void buildTuftedLaplacianPartition(const double* vertexPositions, size_t nVertices, const IndexT* faceIndices,
+                                   size_t nFaces, size_t faceDegree, size_t nPartitions, size_t iPartition,
+                                   size_t ghostRings, const std::string& blockFilename,
+                                   const TuftedLaplacianOptions& options) {
+  if (nFaces == 0) {
+    throw std::runtime_error("partitioned builds need a mesh (build large point clouds in tiles instead)");
+  }
+  if (faceDegree < 3) {
+    throw std::runtime_error("faces must have at least 3 vertices");
+  }
+  SanitizedMesh sanitized =
+      sanitizeFaces(vertexPositions, nVertices, faceIndices, nFaces, faceDegree, options.nThreads);
+  buildPartitionOfSanitizedMesh(sanitized, nVertices, nPartitions, iPartition, ghostRings, blockFilename, options);
+}
+
+template void buildTuftedLaplacianPartition(const double*, size_t, const int32_t*, size_t, size_t, size_t, size_t,
+                                            size_t, const std::string&, const TuftedLaplacianOptions&);
+template void buildTuftedLaplacianPartition(const double*, size_t, const uint32_t*, size_t, size_t, size_t, size_t,
+                                            size_t, const std::string&, const TuftedLaplacianOptions&);
+template void buildTuftedLaplacianPartition(const double*, size_t, const int64_t*, size_t, size_t, size_t, size_t,
+                                            size_t, const std::string&, const TuftedLaplacianOptions&);
+template void buildTuftedLaplacianPartition(const double*, size_t, const uint64_t*, size_t, size_t, size_t, size_t,
+                                            size_t, const std::string&, const TuftedLaplacianOptions&);
+
+void buildTuftedLaplacianPartition(const SimplePolygonMesh& inputMesh, size_t nPartitions, size_t iPartition,
+                                   size_t ghostRings, const std::string& blockFilename,
+                                   const TuftedLaplacianOptions& options) {
+  if (inputMesh.polygons.empty()) {
+    throw std::runtime_error("partitioned builds need a mesh (build large point clouds in tiles instead)");
+  }
+  SanitizedMesh sanitized = sanitizePolygons(inputMesh.vertexCoordinates, inputMesh.polygons, options.nThreads);
+  buildPartitionOfSanitizedMesh(sanitized, inputMesh.vertexCoordinates.size(), nPartitions, iPartition, ghostRings,
+                                blockFilename, options);
+}
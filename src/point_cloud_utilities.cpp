@@ -1,13 +1,19 @@
 #include "point_cloud_utilities.h"
 
-#include "geometrycentral/utilities/knn.h"
+#include "instrumentation.h"
+#include "parallel_utilities.h"
 
-#include "polyscope/point_cloud.h"
-#include "polyscope/polyscope.h"
+#include "geometrycentral/utilities/knn.h"
 
 #include "Eigen/Dense"
 
+#include <algorithm>
 #include <cfloat>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <ostream>
 
 // jcv Voronoi library
 #define JC_VORONOI_IMPLEMENTATION
@@ -18,245 +24,852 @@
 #define JCV_PI 3.141592653589793115997963468544185161590576171875
 #include "jc_voronoi/jc_voronoi.h"
 
-std::vector<std::vector<size_t>> generate_knn(const std::vector<Vector3>& points, size_t k) {
+namespace {
 
-  geometrycentral::NearestNeighborFinder finder(points);
+// === Per-neighborhood building blocks
+// These are shared by the materialized reference functions and the fused kernel, so that both produce identical
+// results. In all of them the neighborhood is a list of point indices, with the center point first.
+
+// Buffers for the SVD normal estimate, which can be reused from one point to the next (the decomposition only
+// reallocates when the neighborhood size changes)
+struct NormalScratch {
+  Eigen::MatrixXd localMat;
+  Eigen::JacobiSVD<Eigen::MatrixXd> svd;
+};
+
+// Estimate the normal at the center of a neighborhood (arbitrarily oriented), via the SVD of the offset vectors
+template <typename IndexT>
+Vector3 estimateNormalSVD(const std::vector<Vector3>& points, const IndexT* neigh, size_t nNeigh,
+                          NormalScratch& scratch) {
+
+  using namespace Eigen;
+
+  Vector3 center = points[neigh[0]];
+  MatrixXd& localMat = scratch.localMat;
+  localMat.resize(3, nNeigh - 1);
 
-  std::vector<std::vector<size_t>> result;
-  for (size_t i = 0; i < points.size(); i++) {
-    result.emplace_back(finder.kNearestNeighbors(i, k));
-    result.back().insert(result.back().begin(), i); // add the center point to the front
+  for (size_t iN = 1; iN < nNeigh; iN++) {
+    Vector3 neighPos = points[neigh[iN]] - center;
+    localMat(0, iN - 1) = neighPos.x;
+    localMat(1, iN - 1) = neighPos.y;
+    localMat(2, iN - 1) = neighPos.z;
   }
 
-  return result;
+  // Smallest singular vector is best normal
+  JacobiSVD<MatrixXd>& svd = scratch.svd;
+  svd.compute(localMat, ComputeThinU);
+  Vector3d bestNormal = svd.matrixU().col(2);
+
+  Vector3 N{bestNormal(0), bestNormal(1), bestNormal(2)};
+  N = unit(N);
+  return N;
 }
 
+// The smallest eigenvector of the 3x3 scatter matrix of the offset vectors is exactly the smallest left singular vector
+// found by the SVD above (up to sign), at a fraction of the cost. Here the matrix is given by its 6 unique entries.
+Vector3 smallestEigenvector(double xx, double xy, double xz, double yy, double yz, double zz) {
+  Eigen::Matrix3d scatter;
+  scatter << xx, xy, xz, //
+      xy, yy, yz,        //
+      xz, yz, zz;
+
+  // closed-form solve; eigenvalues are sorted in increasing order
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver;
+  solver.computeDirect(scatter, Eigen::ComputeEigenvectors);
+  Eigen::Vector3d bestNormal = solver.eigenvectors().col(0);
+
+  Vector3 N{bestNormal(0), bestNormal(1), bestNormal(2)};
+  N = unit(N);
+  return N;
+}
 
-std::vector<Vector3> generate_normals(const std::vector<Vector3>& points, const Neighbors_t& neigh) {
+template <typename IndexT>
+Vector3 estimateNormalCovariance(const std::vector<Vector3>& points, const IndexT* neigh, size_t nNeigh) {
+  Vector3 center = points[neigh[0]];
+  double xx = 0., xy = 0., xz = 0., yy = 0., yz = 0., zz = 0.;
+  for (size_t iN = 1; iN < nNeigh; iN++) {
+    Vector3 d = points[neigh[iN]] - center;
+    xx += d.x * d.x;
+    xy += d.x * d.y;
+    xz += d.x * d.z;
+    yy += d.y * d.y;
+    yz += d.y * d.z;
+    zz += d.z * d.z;
+  }
+  return smallestEigenvector(xx, xy, xz, yy, yz, zz);
+}
 
-  using namespace Eigen;
+template <typename IndexT>
+Vector3 estimateNormal(const std::vector<Vector3>& points, const IndexT* neigh, size_t nNeigh,
+                       NormalEstimator estimator, NormalScratch& scratch) {
+  switch (estimator) {
+  case NormalEstimator::SVD:
+    return estimateNormalSVD(points, neigh, nNeigh, scratch);
+  case NormalEstimator::Covariance:
+    return estimateNormalCovariance(points, neigh, nNeigh);
+  }
+  throw std::runtime_error("unknown normal estimator");
+}
 
-  std::vector<Vector3> normals(points.size());
+// Covariance normals for a batch of consecutive points of a neighbor table. The scatter matrices of the whole batch
+// are accumulated together in structure-of-arrays form, so that the inner loops vectorize across points.
+const size_t normalBatchSize = 8;
+void estimateNormalsCovarianceBatch(const std::vector<Vector3>& points, const NeighborTable& neigh, size_t iStart,
+                                    size_t nBatch, Vector3* normalsOut) {
+  const size_t B = normalBatchSize;
+
+  alignas(64) double cx[B], cy[B], cz[B];
+  alignas(64) double xx[B], xy[B], xz[B], yy[B], yz[B], zz[B];
+  for (size_t b = 0; b < B; b++) {
+    // (unused lanes of a partial batch just repeat the last point)
+    Vector3 c = points[neigh[iStart + std::min(b, nBatch - 1)][0]];
+    cx[b] = c.x;
+    cy[b] = c.y;
+    cz[b] = c.z;
+    xx[b] = xy[b] = xz[b] = yy[b] = yz[b] = zz[b] = 0.;
+  }
 
-  for (size_t iPt = 0; iPt < points.size(); iPt++) {
-    size_t nNeigh = neigh[iPt].size();
-    Vector3 center = points[iPt];
-    MatrixXd localMat(3, neigh[iPt].size() - 1);
-
-    for (size_t iN = 1; iN < nNeigh; iN++) {
-      Vector3 neighPos = points[neigh[iPt][iN]] - center;
-      localMat(0, iN - 1) = neighPos.x;
-      localMat(1, iN - 1) = neighPos.y;
-      localMat(2, iN - 1) = neighPos.z;
-    }
+  for (size_t iN = 1; iN < neigh.stride; iN++) {
 
-    // Smallest singular vector is best normal
-    JacobiSVD<MatrixXd> svd(localMat, ComputeThinU);
-    Vector3d bestNormal = svd.matrixU().col(2);
+    // gather (the only part that can't vectorize)
+    alignas(64) double dx[B], dy[B], dz[B];
+    for (size_t b = 0; b < B; b++) {
+      Vector3 p = points[neigh[iStart + std::min(b, nBatch - 1)][iN]];
+      dx[b] = p.x;
+      dy[b] = p.y;
+      dz[b] = p.z;
+    }
 
-    Vector3 N{bestNormal(0), bestNormal(1), bestNormal(2)};
-    N = unit(N);
-    normals[iPt] = N;
+    for (size_t b = 0; b < B; b++) {
+      double x = dx[b] - cx[b];
+      double y = dy[b] - cy[b];
+      double z = dz[b] - cz[b];
+      xx[b] += x * x;
+      xy[b] += x * y;
+      xz[b] += x * z;
+      yy[b] += y * y;
+      yz[b] += y * z;
+      zz[b] += z * z;
+    }
   }
 
-  return normals;
+  for (size_t b = 0; b < nBatch; b++) {
+    normalsOut[b] = smallestEigenvector(xx[b], xy[b], xz[b], yy[b], yz[b], zz[b]);
+  }
 }
 
+// Project a neighborhood to the tangent plane of its center, writing nNeigh coordinates to coordsOut
+template <typename IndexT>
+void projectNeighborhood(const std::vector<Vector3>& points, Vector3 normal, const IndexT* neigh, size_t nNeigh,
+                         Vector2* coordsOut) {
+  Vector3 center = points[neigh[0]];
 
-std::vector<std::vector<Vector2>> generate_coords_projection(const std::vector<Vector3>& points,
-                                                             const std::vector<Vector3> normals,
-                                                             const Neighbors_t& neigh) {
-  std::vector<std::vector<Vector2>> coords(points.size());
+  // build an arbitrary tangent basis
+  Vector3 basisX, basisY;
+  auto r = normal.buildTangentBasis();
+  basisX = r[0];
+  basisY = r[1];
 
-  for (size_t iPt = 0; iPt < points.size(); iPt++) {
-    size_t nNeigh = neigh[iPt].size();
-    coords[iPt].resize(nNeigh);
-    Vector3 center = points[iPt];
-    Vector3 normal = normals[iPt];
+  for (size_t iN = 0; iN < nNeigh; iN++) {
+    Vector3 vec = points[neigh[iN]] - center;
+    vec = vec.removeComponent(normal);
 
-    // build an arbitrary tangent basis
-    Vector3 basisX, basisY;
-    auto r = normal.buildTangentBasis();
-    basisX = r[0];
-    basisY = r[1];
+    Vector2 coord{dot(basisX, vec), dot(basisY, vec)};
+    coordsOut[iN] = coord;
+  }
+}
 
-    for (size_t iN = 0; iN < nNeigh; iN++) {
-      Vector3 vec = points[neigh[iPt][iN]] - center;
-      vec = vec.removeComponent(normal);
+// A bump allocator for jcv, which only ever grows and releases all of its memory at once in reset(). After the first
+// few points it settles to a single block, so generating a diagram does not touch the global allocator at all.
+class BumpArena {
+public:
+  void* alloc(size_t size) {
+    size = (size + alignment - 1) & ~(alignment - 1);
+    if (blocks.empty() || used + size > blockCapacity) {
+      blockCapacity = std::max(std::max(2 * blockCapacity, size), minBlockSize);
+      blocks.emplace_back(new unsigned char[blockCapacity]);
+      totalCapacity += blockCapacity;
+      used = 0;
+    }
+    void* p = blocks.back().get() + used;
+    used += size;
+    return p;
+  }
 
-      Vector2 coord{dot(basisX, vec), dot(basisY, vec)};
-      coords[iPt][iN] = coord;
+  // Invalidates everything allocated so far
+  void reset() {
+    if (blocks.size() > 1) {
+      // replace with a single block which is big enough for everything last time
+      blocks.clear();
+      blockCapacity = totalCapacity;
+      blocks.emplace_back(new unsigned char[blockCapacity]);
     }
+    used = 0;
   }
 
-  return coords;
+  // Callbacks for jcv_diagram_generate_useralloc()
+  static void* jcvAlloc(void* arena, size_t size) { return static_cast<BumpArena*>(arena)->alloc(size); }
+  static void jcvFree(void* arena, void* p) {} // (everything is freed by reset())
+
+private:
+  static const size_t alignment = 16; // also what operator new[] guarantees for the block starts
+  static const size_t minBlockSize = 64 * 1024;
+
+  std::vector<std::unique_ptr<unsigned char[]>> blocks;
+  size_t blockCapacity = 0;
+  size_t totalCapacity = 0;
+  size_t used = 0; // in the last block
+};
+const size_t BumpArena::alignment;
+const size_t BumpArena::minBlockSize; // (odr-used by std::max)
+
+// Buffers used while triangulating a neighborhood, which can be reused from one point to the next
+struct TriangulationScratch {
+  std::vector<jcv_point> rawCoords;
+  std::vector<char> neighConnected;
+  std::vector<std::vector<size_t>> localEdges;
+  BumpArena arena;
+};
+
+// The coordinates of a neighbor, as given to the planar triangulation. If there is a point other than the center point
+// right on top of the origin, perturb it slightly. jcv doesn't do great with duplicate points, and we can't recover if
+// something happens near the origin.
+Vector2 nudgedCoord(const Vector2* coords, size_t iN, double lenScale) {
+  Vector2 p = coords[iN];
+  if (iN != 0 && norm(p) < 1e-6 * lenScale) {
+    p.x += 1e-6 * lenScale;
+    TUFTED_TRACE_COUNT("degenerate perturbations", 1);
+  }
+  return p;
 }
 
+// Build the planar Delaunay triangulation of a projected neighborhood, by computing the full Voronoi diagram with jcv.
+// Returns the area of the center point's Voronoi cell, and appends the triangles touching the center to
+// `pointTriangles` (and, if non-null, all triangles to `allTriangles`). Triangle indices are in to the neighborhood.
+double triangulateNeighborhoodVoronoi(const Vector2* coords, size_t nNeigh, TriangulationScratch& scratch,
+                                      std::vector<std::array<size_t, 3>>& pointTriangles,
+                                      std::vector<std::array<size_t, 3>>* allTriangles) {
 
-LocalTriangulationResult build_delaunay_triangulations(const std::vector<std::vector<Vector2>>& coords,
-                                                       const Neighbors_t& neigh, bool generateAllTris) {
-  size_t nPts = coords.size();
-  LocalTriangulationResult result;
-  result.voronoiAreas.resize(nPts);
-  result.pointTriangles.resize(nPts);
+  //std::cout << "\nPoint has " << nNeigh << " neighbors" << std::endl;
 
+  // Copy neighbor coords to a raw buffer
+  std::vector<jcv_point>& rawCoords = scratch.rawCoords;
+  rawCoords.clear();
+  double lenScale = norm(coords[nNeigh - 1]);
+  for (size_t iN = 0; iN < nNeigh; iN++) {
+    Vector2 p = nudgedCoord(coords, iN, lenScale);
+    rawCoords.push_back({p.x, p.y});
 
-  for (size_t iPt = 0; iPt < nPts; iPt++) {
-    size_t nNeigh = neigh[iPt].size();
-    //std::cout << "\nPoint has " << nNeigh << " neighbors" << std::endl;
-
-    // Copy neighbor coords to a raw buffer
-    std::vector<jcv_point> rawCoords;
-    double lenScale = norm(coords[iPt].back());
-    for (size_t iN = 0; iN < nNeigh; iN++) {
-      Vector2 p = coords[iPt][iN];
-
-      // If there is a point other than the center point right on top of the origin, perturb it slightly. jcv doesn't do
-      // great with duplicate points, and we can't recover if something happens near the origin.
-      if (iN != 0 && norm(p) < 1e-6 * lenScale) {
-        p.x += 1e-6 * lenScale;
+    //std::cout << "  p = " << p << std::endl;
+  }
+
+  // run the Voronoi algorithm
+  // (all of its memory comes from the arena, which is reset rather than calling jcv_diagram_free())
+  scratch.arena.reset();
+  jcv_diagram diagram;
+  memset(&diagram, 0, sizeof(jcv_diagram));
+  jcv_diagram_generate_useralloc(nNeigh, &rawCoords[0], 0, 0, &scratch.arena, BumpArena::jcvAlloc, BumpArena::jcvFree,
+                                 &diagram);
+  TUFTED_TRACE_COUNT("jcv diagrams", 1);
+
+  // find the site at the center vertex (is this predictable?)
+  const jcv_site* centerSite = nullptr;
+  {
+    const jcv_site* sites = jcv_diagram_get_sites(&diagram);
+    for (int i = 0; i < diagram.numsites; i++) {
+      const jcv_site* site = &sites[i];
+      if (static_cast<size_t>(site->index) == 0) {
+        centerSite = site;
+        break;
       }
+    }
+    if (centerSite == nullptr) throw std::runtime_error("could not find site for center vertex");
+  }
+
+  // == Get the area of the center cell
+  double voronoiArea = 0;
+  {
+    const jcv_graphedge* e = centerSite->edges;
+    while (e) {
+      Vector2 p0{centerSite->p.x, centerSite->p.y};
+      Vector2 p1{e->pos[0].x, e->pos[0].y};
+      Vector2 p2{e->pos[1].x, e->pos[1].y};
 
-      rawCoords.push_back({p.x, p.y});
+      // (here triangle is not a Delaunay triangle, but part of an implicit fan triangulation from the center)
+      double triArea = 0.5 * std::abs(cross(p1 - p0, p2 - p0));
+      voronoiArea += triArea;
 
-      //std::cout << "  p = " << p << std::endl;
+      e = e->next;
     }
+  }
+
+  // == Find all triangles
+  if (allTriangles != nullptr) {
+
+    // Build a list of all edges
+    const jcv_edge* edge = jcv_diagram_get_edges(&diagram);
+    std::vector<std::vector<size_t>>& localEdges = scratch.localEdges;
+    if (localEdges.size() < nNeigh) localEdges.resize(nNeigh);
+    for (size_t iN = 0; iN < nNeigh; iN++) localEdges[iN].clear();
+    while (edge) {
+      if (edge->sites[0] && edge->sites[1]) {
+        size_t indA = edge->sites[0]->index;
+        size_t indB = edge->sites[1]->index;
+
+        localEdges[indA].push_back(indB);
+        localEdges[indB].push_back(indA);
+      }
+      edge = jcv_diagram_get_next_edge(edge);
+    }
+
+    // Find triplets in the edge list
+    // (this has an O(d) factor that could be removed with a hashset, but since degree will be small this is probably
+    // faster)
+
+    for (size_t iA = 0; iA < nNeigh; iA++) {
+      for (size_t iB : localEdges[iA]) {
+        if (!(iA < iB)) continue; // only consider if iA < iB < iC
 
-    // run the Voronoi algorithm
-    jcv_diagram diagram;
-    memset(&diagram, 0, sizeof(jcv_diagram));
-    jcv_diagram_generate(nNeigh, &rawCoords[0], 0, 0, &diagram);
-
-    // find the site at the center vertex (is this predictable?)
-    const jcv_site* centerSite = nullptr;
-    {
-      const jcv_site* sites = jcv_diagram_get_sites(&diagram);
-      for (int i = 0; i < diagram.numsites; i++) {
-        const jcv_site* site = &sites[i];
-        if (static_cast<size_t>(site->index) == 0) {
-          centerSite = site;
-          break;
+        for (size_t iC : localEdges[iA]) {
+          if (!(iB < iC)) continue; // only consider if iA < iB < iC
+
+          // Check if iB is connected to iC
+          std::vector<size_t>& bNeigh = localEdges[iB];
+          if (std::find(bNeigh.begin(), bNeigh.end(), iC) == bNeigh.end()) continue;
+          // This is a good triangle!
+
+          size_t triA = iA;
+          size_t triB = iB;
+          size_t triC = iC;
+
+          // Swap to orient if needed
+          Vector2 pA = coords[triA];
+          Vector2 pB = coords[triB];
+          Vector2 pC = coords[triC];
+          if (cross(pB - pA, pC - pA) < 0.) std::swap(triB, triC);
+
+          std::array<size_t, 3> triInds = {triA, triB, triC};
+          allTriangles->push_back(triInds);
         }
       }
-      if (centerSite == nullptr) throw std::runtime_error("could not find site for center vertex");
     }
+  }
 
-    // == Get the area of the center cell
-    double voronoiArea = 0;
-    {
-      const jcv_graphedge* e = centerSite->edges;
-      while (e) {
-        Vector2 p0{centerSite->p.x, centerSite->p.y};
-        Vector2 p1{e->pos[0].x, e->pos[0].y};
-        Vector2 p2{e->pos[1].x, e->pos[1].y};
+  // == Find triangles connected to the source
+  {
+
+    // First pass, mark all neighbors with an edge to the source
+    std::vector<char>& neighConnected = scratch.neighConnected;
+    neighConnected.assign(nNeigh, false);
+    const jcv_graphedge* e = centerSite->edges;
+    while (e) {
+      if (e->neighbor) {
+        size_t neighInd = e->neighbor->index;
+        neighConnected[neighInd] = true;
+      }
+      e = e->next;
+    }
+
+    // Second pass, any edge between two connected points completes a triangle
+    const jcv_edge* edge = jcv_diagram_get_edges(&diagram);
+    while (edge) {
+      if (edge->sites[0] && edge->sites[1]) {
+        size_t indA = edge->sites[0]->index;
+        size_t indB = edge->sites[1]->index;
+
+        if (neighConnected[indA] && neighConnected[indB]) {
+          // found a triangle!
 
-        // (here triangle is not a Delaunay triangle, but part of an implicit fan triangulation from the center)
-        double triArea = 0.5 * std::abs(cross(p1 - p0, p2 - p0));
-        voronoiArea += triArea;
+          // check orientation to make sure we emit a CCW triangle
+          Vector2 pA = coords[indA];
+          Vector2 pB = coords[indB];
+          if (cross(pA, pB) < 0.) std::swap(indA, indB);
 
-        e = e->next;
+          std::array<size_t, 3> triInds = {0, indA, indB};
+          pointTriangles.push_back(triInds);
+        }
       }
+      edge = jcv_diagram_get_next_edge(edge);
     }
-    result.voronoiAreas[iPt] = voronoiArea;
-
-    // == Find all triangles
-    if (generateAllTris) {
-      result.allTriangles.resize(nPts);
-
-      // Build a list of all edges
-      const jcv_edge* edge = jcv_diagram_get_edges(&diagram);
-      std::vector<std::vector<size_t>> localEdges(nNeigh);
-      while (edge) {
-        if (edge->sites[0] && edge->sites[1]) {
-          size_t indA = edge->sites[0]->index;
-          size_t indB = edge->sites[1]->index;
-
-          localEdges[indA].push_back(indB);
-          localEdges[indB].push_back(indA);
+  }
+
+  return voronoiArea;
+}
+
+// Like triangulateNeighborhoodVoronoi(), but only computes the star of the center point, for neighborhoods of at most
+// MaxNeigh points (including the center).
+//
+// The center's Voronoi cell is cut out of the same bounding box that jcv uses, one bisector half-plane at a time. Each
+// edge of the cell remembers the neighbor whose bisector created it, and any two consecutive edges created by
+// neighbors A and B meet at the circumcenter of a Delaunay triangle (center, A, B).
+template <size_t MaxNeigh>
+double triangulateNeighborhoodStar(const Vector2* coords, size_t nNeigh,
+                                   std::vector<std::array<size_t, 3>>& pointTriangles) {
+
+  const size_t MaxVerts = MaxNeigh + 4; // each half-plane adds at most one vertex to the initial box
+  const int boxTag = -1;
+
+  // Gather the (nudged) coordinates, and bound them exactly like jcv would
+  std::array<Vector2, MaxNeigh> pts;
+  double lenScale = norm(coords[nNeigh - 1]);
+  Vector2 bbMin{0., 0.};
+  Vector2 bbMax{0., 0.};
+  for (size_t iN = 0; iN < nNeigh; iN++) {
+    pts[iN] = nudgedCoord(coords, iN, lenScale);
+    bbMin = Vector2{std::fmin(bbMin.x, pts[iN].x), std::fmin(bbMin.y, pts[iN].y)};
+    bbMax = Vector2{std::fmax(bbMax.x, pts[iN].x), std::fmax(bbMax.y, pts[iN].y)};
+  }
+  bbMin = Vector2{std::floor(bbMin.x) - 10., std::floor(bbMin.y) - 10.};
+  bbMax = Vector2{std::ceil(bbMax.x) + 10., std::ceil(bbMax.y) + 10.};
+
+  // The cell polygon, CCW. tag[i] is the generator of the edge from vertex i to vertex i+1.
+  std::array<Vector2, MaxVerts> polyBufA, polyBufB;
+  std::array<int, MaxVerts> tagBufA, tagBufB;
+  Vector2* poly = polyBufA.data();
+  int* tag = tagBufA.data();
+  Vector2* nextPoly = polyBufB.data();
+  int* nextTag = tagBufB.data();
+
+  size_t nPoly = 4;
+  poly[0] = Vector2{bbMin.x, bbMin.y};
+  poly[1] = Vector2{bbMax.x, bbMin.y};
+  poly[2] = Vector2{bbMax.x, bbMax.y};
+  poly[3] = Vector2{bbMin.x, bbMax.y};
+  for (size_t i = 0; i < nPoly; i++) tag[i] = boxTag;
+  double maxRad2 = 0.;
+  for (size_t i = 0; i < nPoly; i++) maxRad2 = std::fmax(maxRad2, norm2(poly[i]));
+
+  // Clip by the bisector between the center (at the origin) and each neighbor, which is { x : dot(x, p) <= |p|^2 / 2 }
+  for (size_t iN = 1; iN < nNeigh; iN++) {
+    Vector2 p = pts[iN];
+    double pNorm2 = norm2(p);
+    if (!(pNorm2 < 4. * maxRad2)) continue; // the bisector lies entirely outside the cell
+    double h = 0.5 * pNorm2;
+
+    size_t nNext = 0;
+    for (size_t i = 0; i < nPoly; i++) {
+      Vector2 vS = poly[i];
+      Vector2 vE = poly[(i + 1) % nPoly];
+      double dS = dot(vS, p) - h;
+      double dE = dot(vE, p) - h;
+
+      if (dS <= 0.) {
+        nextPoly[nNext] = vS;
+        nextTag[nNext] = tag[i];
+        nNext++;
+        if (dE > 0.) { // leaving
+          nextPoly[nNext] = vS + (vE - vS) * (dS / (dS - dE));
+          nextTag[nNext] = static_cast<int>(iN);
+          nNext++;
         }
-        edge = jcv_diagram_get_next_edge(edge);
+      } else if (dE <= 0.) { // entering
+        nextPoly[nNext] = vS + (vE - vS) * (dS / (dS - dE));
+        nextTag[nNext] = tag[i];
+        nNext++;
       }
+    }
 
-      // Find triplets in the edge list
-      // (this has an O(d) factor that could be removed with a hashset, but since degree will be small this is probably
-      // faster)
+    std::swap(poly, nextPoly);
+    std::swap(tag, nextTag);
+    nPoly = nNext;
 
-      for (size_t iA = 0; iA < nNeigh; iA++) {
-        for (size_t iB : localEdges[iA]) {
-          if (!(iA < iB)) continue; // only consider if iA < iB < iC
+    maxRad2 = 0.;
+    for (size_t i = 0; i < nPoly; i++) maxRad2 = std::fmax(maxRad2, norm2(poly[i]));
+  }
 
-          for (size_t iC : localEdges[iA]) {
-            if (!(iB < iC)) continue; // only consider if iA < iB < iC
+  // Drop any zero-length edges (from cocircular points), which jcv would not report either
+  size_t nKept = 0;
+  for (size_t i = 0; i < nPoly; i++) {
+    if (poly[i] == poly[(i + 1) % nPoly]) continue;
+    poly[nKept] = poly[i];
+    tag[nKept] = tag[i];
+    nKept++;
+  }
+  nPoly = nKept;
+
+  double voronoiArea = 0.;
+  for (size_t i = 0; i < nPoly; i++) {
+    Vector2 pA = poly[i];
+    Vector2 pB = poly[(i + 1) % nPoly];
+    voronoiArea += 0.5 * std::abs(cross(pA, pB));
+
+    int tagA = tag[i];
+    int tagB = tag[(i + 1) % nPoly];
+    if (tagA == boxTag || tagB == boxTag || tagA == tagB) continue;
+
+    // found a triangle! (checking orientation, as above)
+    size_t indA = tagA;
+    size_t indB = tagB;
+    if (cross(pts[indA], pts[indB]) < 0.) std::swap(indA, indB);
+    std::array<size_t, 3> triInds = {0, indA, indB};
+    pointTriangles.push_back(triInds);
+  }
 
-            // Check if iB is connected to iC
-            std::vector<size_t>& bNeigh = localEdges[iB];
-            if (std::find(bNeigh.begin(), bNeigh.end(), iC) == bNeigh.end()) continue;
-            // This is a good triangle!
+  return voronoiArea;
+}
 
-            size_t triA = iA;
-            size_t triB = iB;
-            size_t triC = iC;
+// Triangulate with the requested method. Only the full Voronoi diagram can produce allTriangles, and very large
+// neighborhoods also fall back on it.
+double triangulateNeighborhood(const Vector2* coords, size_t nNeigh, TriangulationScratch& scratch,
+                               std::vector<std::array<size_t, 3>>& pointTriangles,
+                               std::vector<std::array<size_t, 3>>* allTriangles, LocalTriangulator method) {
+  size_t nTrianglesBefore = pointTriangles.size();
+  bool useStar = method == LocalTriangulator::Star && allTriangles == nullptr;
+  double voronoiArea;
+  if (useStar && nNeigh <= 16) {
+    voronoiArea = triangulateNeighborhoodStar<16>(coords, nNeigh, pointTriangles);
+  } else if (useStar && nNeigh <= 32) {
+    voronoiArea = triangulateNeighborhoodStar<32>(coords, nNeigh, pointTriangles);
+  } else if (useStar && nNeigh <= 64) {
+    voronoiArea = triangulateNeighborhoodStar<64>(coords, nNeigh, pointTriangles);
+  } else {
+    voronoiArea = triangulateNeighborhoodVoronoi(coords, nNeigh, scratch, pointTriangles, allTriangles);
+  }
+  TUFTED_TRACE_COUNT("neighborhoods", 1);
+  TUFTED_TRACE_COUNT("neighborhood triangles", pointTriangles.size() - nTrianglesBefore);
+  return voronoiArea;
+}
 
-            // Swap to orient if needed
-            Vector2 pA = coords[iPt][triA];
-            Vector2 pB = coords[iPt][triB];
-            Vector2 pC = coords[iPt][triC];
-            if (cross(pB - pA, pC - pA) < 0.) std::swap(triB, triC);
+void printTotalVoronoiArea(const std::vector<double>& voronoiAreas, std::ostream* log) {
+  if (!log) return;
+  double totA = 0.;
+  for (double a : voronoiAreas) totA += a;
+  *log << "total voronoi area = " << totA << std::endl;
+}
 
-            std::array<size_t, 3> triInds = {triA, triB, triC};
-            result.allTriangles[iPt].push_back(triInds);
-          }
-        }
-      }
+} // namespace
+
+std::vector<std::vector<size_t>> generate_knn(const std::vector<Vector3>& points, size_t k, size_t nThreads) {
+  TUFTED_TRACE_SCOPE("neighbors");
+
+  geometrycentral::NearestNeighborFinder finder(points);
+
+  // (queries only read the tree, so they can safely run concurrently)
+  std::vector<std::vector<size_t>> result(points.size());
+  parallelFor(points.size(), nThreads, [&](size_t iThread, size_t i) {
+    result[i] = finder.kNearestNeighbors(i, k);
+    result[i].insert(result[i].begin(), i); // add the center point to the front
+  });
+
+  return result;
+}
+
+
+NeighborTable generate_knn_table(const std::vector<Vector3>& points, size_t k, size_t nThreads) {
+  TUFTED_TRACE_SCOPE("neighbors");
+
+  if (points.size() > std::numeric_limits<uint32_t>::max()) {
+    throw std::runtime_error("too many points for 32-bit neighbor indices");
+  }
+
+  NeighborTable result;
+  if (points.empty()) return result;
+
+  // (with very few points, every point is a neighbor of every other)
+  k = std::min(k, points.size() - 1);
+  result.stride = k + 1;
+  result.indices.resize(points.size() * result.stride);
+
+  geometrycentral::NearestNeighborFinder finder(points);
+
+  parallelFor(points.size(), nThreads, [&](size_t iThread, size_t i) {
+    std::vector<size_t> neigh = finder.kNearestNeighbors(i, k);
+    if (neigh.size() != k) throw std::runtime_error("nearest neighbor search returned too few points");
+
+    uint32_t* row = &result.indices[i * result.stride];
+    row[0] = static_cast<uint32_t>(i); // the center point goes first
+    for (size_t j = 0; j < k; j++) {
+      row[j + 1] = static_cast<uint32_t>(neigh[j]);
     }
+  });
+
+  return result;
+}
 
-    // == Find triangles connected to the source
-    {
 
-      // First pass, mark all neighbors with an edge to the source
-      std::vector<char> neighConnected(nNeigh, false);
-      const jcv_graphedge* e = centerSite->edges;
-      while (e) {
-        if (e->neighbor) {
-          size_t neighInd = e->neighbor->index;
-          neighConnected[neighInd] = true;
-        }
-        e = e->next;
+std::vector<Vector3> generate_normals(const std::vector<Vector3>& points, const Neighbors_t& neigh,
+                                      size_t nThreads, NormalEstimator estimator) {
+  TUFTED_TRACE_SCOPE("normals");
+
+  std::vector<Vector3> normals(points.size());
+  std::vector<NormalScratch> scratch(resolveThreadCount(nThreads));
+
+  parallelFor(points.size(), nThreads, [&](size_t iThread, size_t iPt) {
+    normals[iPt] = estimateNormal(points, &neigh[iPt][0], neigh[iPt].size(), estimator, scratch[iThread]);
+  });
+
+  return normals;
+}
+
+std::vector<Vector3> generate_normals(const std::vector<Vector3>& points, const NeighborTable& neigh,
+                                      size_t nThreads, NormalEstimator estimator) {
+  TUFTED_TRACE_SCOPE("normals");
+
+  std::vector<Vector3> normals(points.size());
+
+  if (estimator == NormalEstimator::Covariance) {
+    size_t blockSize = 32 * normalBatchSize;
+    parallelForBlocks(points.size(), nThreads, blockSize, [&](size_t iThread, size_t iStart, size_t iEnd) {
+      for (size_t iBatch = iStart; iBatch < iEnd; iBatch += normalBatchSize) {
+        size_t nBatch = std::min(normalBatchSize, iEnd - iBatch);
+        estimateNormalsCovarianceBatch(points, neigh, iBatch, nBatch, &normals[iBatch]);
       }
+    });
+    return normals;
+  }
 
-      // Second pass, any edge between two connected points completes a triangle
-      const jcv_edge* edge = jcv_diagram_get_edges(&diagram);
-      while (edge) {
-        if (edge->sites[0] && edge->sites[1]) {
-          size_t indA = edge->sites[0]->index;
-          size_t indB = edge->sites[1]->index;
+  std::vector<NormalScratch> scratch(resolveThreadCount(nThreads));
+  parallelFor(points.size(), nThreads, [&](size_t iThread, size_t iPt) {
+    normals[iPt] = estimateNormal(points, neigh[iPt], neigh.stride, estimator, scratch[iThread]);
+  });
 
-          if (neighConnected[indA] && neighConnected[indB]) {
-            // found a triangle!
+  return normals;
+}
 
-            // check orientation to make sure we emit a CCW triangle
-            Vector2 pA = coords[iPt][indA];
-            Vector2 pB = coords[iPt][indB];
-            if (cross(pA, pB) < 0.) std::swap(indA, indB);
 
-            std::array<size_t, 3> triInds = {0, indA, indB};
-            result.pointTriangles[iPt].push_back(triInds);
-          }
-        }
-        edge = jcv_diagram_get_next_edge(edge);
+std::vector<std::vector<Vector2>> generate_coords_projection(const std::vector<Vector3>& points,
+                                                             const std::vector<Vector3>& normals,
+                                                             const Neighbors_t& neigh, size_t nThreads) {
+  TUFTED_TRACE_SCOPE("projection");
+  std::vector<std::vector<Vector2>> coords(points.size());
+
+  parallelFor(points.size(), nThreads, [&](size_t iThread, size_t iPt) {
+    size_t nNeigh = neigh[iPt].size();
+    coords[iPt].resize(nNeigh);
+    projectNeighborhood(points, normals[iPt], &neigh[iPt][0], nNeigh, &coords[iPt][0]);
+  });
+
+  return coords;
+}
+
+std::vector<Vector2> generate_coords_projection(const std::vector<Vector3>& points,
+                                                const std::vector<Vector3>& normals, const NeighborTable& neigh,
+                                                size_t nThreads) {
+  TUFTED_TRACE_SCOPE("projection");
+  std::vector<Vector2> coords(neigh.indices.size());
+
+  parallelFor(points.size(), nThreads, [&](size_t iThread, size_t iPt) {
+    projectNeighborhood(points, normals[iPt], neigh[iPt], neigh.stride, &coords[iPt * neigh.stride]);
+  });
+
+  return coords;
+}
+
+
+LocalTriangulationResult build_delaunay_triangulations(const std::vector<std::vector<Vector2>>& coords,
+                                                       const Neighbors_t& neigh, bool generateAllTris,
+                                                       size_t nThreads, LocalTriangulator method, std::ostream* log) {
+  TUFTED_TRACE_SCOPE("local delaunay");
+  size_t nPts = coords.size();
+  LocalTriangulationResult result;
+  result.voronoiAreas.resize(nPts);
+  result.pointTriangles.resize(nPts);
+  if (generateAllTris) {
+    result.allTriangles.resize(nPts);
+  }
+
+  // Scratch buffers, reused by each thread across all of the points it processes
+  std::vector<TriangulationScratch> scratch(resolveThreadCount(nThreads));
+
+  parallelFor(nPts, nThreads, [&](size_t iThread, size_t iPt) {
+    std::vector<std::array<size_t, 3>>* allTris = generateAllTris ? &result.allTriangles[iPt] : nullptr;
+    result.voronoiAreas[iPt] = triangulateNeighborhood(&coords[iPt][0], neigh[iPt].size(), scratch[iThread],
+                                                       result.pointTriangles[iPt], allTris, method);
+  });
+
+  printTotalVoronoiArea(result.voronoiAreas, log);
+
+  return result;
+}
+
+LocalTriangulationResult build_delaunay_triangulations(const std::vector<Vector2>& coords, const NeighborTable& neigh,
+                                                       bool generateAllTris, size_t nThreads,
+                                                       LocalTriangulator method, std::ostream* log) {
+  TUFTED_TRACE_SCOPE("local delaunay");
+  size_t nPts = neigh.size();
+  LocalTriangulationResult result;
+  result.voronoiAreas.resize(nPts);
+  result.pointTriangles.resize(nPts);
+  if (generateAllTris) {
+    result.allTriangles.resize(nPts);
+  }
+
+  // Scratch buffers, reused by each thread across all of the points it processes
+  std::vector<TriangulationScratch> scratch(resolveThreadCount(nThreads));
+
+  parallelFor(nPts, nThreads, [&](size_t iThread, size_t iPt) {
+    std::vector<std::array<size_t, 3>>* allTris = generateAllTris ? &result.allTriangles[iPt] : nullptr;
+    result.voronoiAreas[iPt] = triangulateNeighborhood(&coords[iPt * neigh.stride], neigh.stride, scratch[iThread],
+                                                       result.pointTriangles[iPt], allTris, method);
+  });
+
+  printTotalVoronoiArea(result.voronoiAreas, log);
+
+  return result;
+}
+
+
+PointCloudTriangulation build_point_cloud_triangulation(const std::vector<Vector3>& points, size_t k,
+                                                        size_t nThreads, NormalEstimator estimator,
+                                                        LocalTriangulator method, std::ostream* log) {
+  TUFTED_TRACE_SCOPE("point cloud triangulation");
+
+  size_t nPts = points.size();
+  PointCloudTriangulation result;
+  result.voronoiAreas.resize(nPts);
+
+  geometrycentral::NearestNeighborFinder finder(points);
+
+  // Everything for a single point lives in these per-thread buffers, which stay small enough to remain in cache
+  struct Scratch {
+    std::vector<size_t> neigh;
+    NormalScratch normal;
+    std::vector<Vector2> coords;
+    std::vector<std::array<size_t, 3>> localTris;
+    TriangulationScratch tri;
+  };
+  std::vector<Scratch> scratch(resolveThreadCount(nThreads));
+
+  // Each block of points writes to its own triangle list, which are concatenated in order afterwards. This gives the
+  // same triangle order as the reference path, regardless of the number of threads.
+  const size_t blockSize = 1024;
+  std::vector<std::vector<std::array<size_t, 3>>> blockTriangles((nPts + blockSize - 1) / blockSize);
+
+  parallelForBlocks(nPts, nThreads, blockSize, [&](size_t iThread, size_t iStart, size_t iEnd) {
+    TUFTED_TRACE_SCOPE("triangulate block");
+    Scratch& s = scratch[iThread];
+    std::vector<std::array<size_t, 3>>& outTris = blockTriangles[iStart / blockSize];
+
+    for (size_t iPt = iStart; iPt < iEnd; iPt++) {
+
+      // Neighbors, with the center point first (copied in to the per-thread buffer, since the finder returns a new
+      // vector for each query)
+      const std::vector<size_t> found = finder.kNearestNeighbors(iPt, k);
+      size_t nNeigh = found.size() + 1;
+      s.neigh.resize(nNeigh);
+      s.neigh[0] = iPt;
+      std::copy(found.begin(), found.end(), s.neigh.begin() + 1);
+
+      // Normal and tangent plane projection
+      Vector3 normal = estimateNormal(points, &s.neigh[0], nNeigh, estimator, s.normal);
+      s.coords.resize(nNeigh);
+      projectNeighborhood(points, normal, &s.neigh[0], nNeigh, &s.coords[0]);
+
+      // Local Delaunay triangulation
+      s.localTris.clear();
+      result.voronoiAreas[iPt] = triangulateNeighborhood(&s.coords[0], nNeigh, s.tri, s.localTris, nullptr, method);
+
+      // Emit the triangles, in global indices
+      for (const std::array<size_t, 3>& tri : s.localTris) {
+        outTris.push_back({s.neigh[tri[0]], s.neigh[tri[1]], s.neigh[tri[2]]});
       }
     }
+  });
+
+  size_t nTris = 0;
+  for (const auto& tris : blockTriangles) nTris += tris.size();
+  result.triangles.reserve(nTris);
+  for (auto& tris : blockTriangles) {
+    result.triangles.insert(result.triangles.end(), tris.begin(), tris.end());
+    std::vector<std::array<size_t, 3>>().swap(tris);
+  }
+
+  printTotalVoronoiArea(result.voronoiAreas, log);
+
+  return result;
+}
 
 
-    jcv_diagram_free(&diagram);
+LocalTriangulationComparison compare_local_triangulations(const LocalTriangulationResult& reference,
+                                                          const LocalTriangulationResult& candidate) {
+  if (reference.pointTriangles.size() != candidate.pointTriangles.size()) {
+    throw std::runtime_error("local triangulations have different numbers of points");
   }
 
-  double totA = 0.;
-  for (double a : result.voronoiAreas) totA += a;
-  std::cout << "total voronoi area = " << totA << std::endl;
+  LocalTriangulationComparison comp;
+  std::vector<std::array<size_t, 3>> sortedRef, sortedCand, diff;
+  for (size_t iPt = 0; iPt < reference.pointTriangles.size(); iPt++) {
+    sortedRef = reference.pointTriangles[iPt];
+    sortedCand = candidate.pointTriangles[iPt];
+    std::sort(sortedRef.begin(), sortedRef.end());
+    std::sort(sortedCand.begin(), sortedCand.end());
+
+    diff.clear();
+    std::set_difference(sortedRef.begin(), sortedRef.end(), sortedCand.begin(), sortedCand.end(),
+                        std::back_inserter(diff));
+    comp.nMissingTriangles += diff.size();
+    size_t nMissing = diff.size();
+
+    diff.clear();
+    std::set_difference(sortedCand.begin(), sortedCand.end(), sortedRef.begin(), sortedRef.end(),
+                        std::back_inserter(diff));
+    comp.nExtraTriangles += diff.size();
+
+    if (nMissing > 0 || !diff.empty()) comp.nPointsDiffering++;
+
+    double areaScale = std::fmax(std::abs(reference.voronoiAreas[iPt]), std::numeric_limits<double>::min());
+    double areaDiff = std::abs(reference.voronoiAreas[iPt] - candidate.voronoiAreas[iPt]) / areaScale;
+    comp.maxRelativeAreaDiff = std::fmax(comp.maxRelativeAreaDiff, areaDiff);
+  }
+  return comp;
+}
 
-  return result;
+namespace {
+
+std::array<size_t, 3> sortedTriangle(const std::array<size_t, 3>& tri) {
+  std::array<size_t, 3> key = tri;
+  if (key[0] > key[1]) std::swap(key[0], key[1]);
+  if (key[1] > key[2]) std::swap(key[1], key[2]);
+  if (key[0] > key[1]) std::swap(key[0], key[1]);
+  return key;
+}
+
+uint64_t hashTriangle(const std::array<size_t, 3>& key) {
+  // combine, then finish with the splitmix64 mixer
+  uint64_t h = static_cast<uint64_t>(key[0]) * 0x9E3779B97F4A7C15ull;
+  h ^= static_cast<uint64_t>(key[1]) + 0x632BE59BD9B4E019ull + (h << 6) + (h >> 2);
+  h ^= static_cast<uint64_t>(key[2]) + 0x85157AF5D1E7A5C3ull + (h << 6) + (h >> 2);
+  h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+  h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+  return h ^ (h >> 31);
 }
 
+} // namespace
+
+DeduplicatedTriangles deduplicate_triangles(const std::vector<std::array<size_t, 3>>& triangles) {
+  TUFTED_TRACE_SCOPE("dedup triangles");
+
+  // Table of indices in to result.triangles, at most half full
+  const size_t emptySlot = std::numeric_limits<size_t>::max();
+  size_t tableSize = 16;
+  while (tableSize < 2 * triangles.size()) tableSize *= 2;
+  const size_t mask = tableSize - 1;
+  std::vector<size_t> table(tableSize, emptySlot);
 
+  DeduplicatedTriangles result;
+  std::vector<std::array<size_t, 3>> keys; // sorted copy of each entry in result.triangles
+  result.triangles.reserve(triangles.size() / 2);
+  result.multiplicity.reserve(triangles.size() / 2);
+  keys.reserve(triangles.size() / 2);
+
+  for (const std::array<size_t, 3>& tri : triangles) {
+    std::array<size_t, 3> key = sortedTriangle(tri);
+
+    size_t iSlot = hashTriangle(key) & mask;
+    while (table[iSlot] != emptySlot && keys[table[iSlot]] != key) {
+      iSlot = (iSlot + 1) & mask; // linear probing
+    }
 
+    if (table[iSlot] == emptySlot) {
+      table[iSlot] = result.triangles.size();
+      result.triangles.push_back(tri);
+      result.multiplicity.push_back(1);
+      keys.push_back(key);
+    } else {
+      uint8_t& count = result.multiplicity[table[iSlot]];
+      if (count < 255) count++;
+    }
+  }
+
+  return result;
+}
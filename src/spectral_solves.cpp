@@ -0,0 +1,138 @@
+#include "spectral_solves.h"
+
+#include "parallel_utilities.h"
+
+#include <Eigen/Eigenvalues>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+using namespace geometrycentral;
+
+namespace {
+
+// lScale L + massScale M, with a 1 on the diagonal of each row which is empty in both (which would be singular)
+SparseMatrix<double> combinedOperator(const SparseMatrix<double>& L, const Eigen::VectorXd& massDiagonal,
+                                      double lScale, double massScale) {
+  size_t n = L.rows();
+  std::vector<Eigen::Triplet<double>> diagonalTriplets;
+  diagonalTriplets.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    bool isEmpty = massDiagonal[i] == 0. && L.col(i).nonZeros() == 0;
+    diagonalTriplets.emplace_back(i, i, isEmpty ? 1. : massScale * massDiagonal[i]);
+  }
+  SparseMatrix<double> diagonal(n, n);
+  diagonal.setFromTriplets(diagonalTriplets.begin(), diagonalTriplets.end());
+  SparseMatrix<double> combined = lScale * L + diagonal;
+  return combined;
+}
+
+Eigen::VectorXd checkedMassDiagonal(const SparseMatrix<double>& L, const SparseMatrix<double>& M) {
+  if (L.rows() != L.cols() || M.rows() != L.rows() || M.cols() != L.cols()) {
+    throw std::runtime_error("L and M must be square, and the same size");
+  }
+  Eigen::VectorXd massDiagonal = M.diagonal();
+  if (massDiagonal.sum() <= 0.) {
+    throw std::runtime_error("mass matrix has no positive entries");
+  }
+  return massDiagonal;
+}
+
+} // namespace
+
+
+bool smallestEigenpairs(const SparseMatrix<double>& L, const SparseMatrix<double>& M, size_t K,
+                        Eigen::VectorXd& eigenvalues, Eigen::MatrixXd& eigenvectors, size_t nThreads,
+                        double tolerance, size_t maxIterations) {
+
+  Eigen::VectorXd massDiagonal = checkedMassDiagonal(L, M);
+  size_t n = L.rows();
+  if (K == 0 || K > n) {
+    throw std::runtime_error("can't compute " + std::to_string(K) + " eigenpairs of a " + std::to_string(n) + "x" +
+                             std::to_string(n) + " matrix");
+  }
+
+  // The typical ratio of L to M, which sets the scale of the spectrum. L itself is singular (constants are in its
+  // kernel), so factor it with a shift far below any eigenvalue that matters.
+  double spectrumScale = L.diagonal().sum() / massDiagonal.sum();
+  double shift = 1e-8 * spectrumScale;
+  Eigen::SimplicialLDLT<SparseMatrix<double>> solver(combinedOperator(L, massDiagonal, 1., shift));
+  if (solver.info() != Eigen::Success) {
+    throw std::runtime_error("failed to factor the shifted Laplacian");
+  }
+
+  // Iterate on a larger subspace than needed, so the wanted pairs converge quickly. Each iteration applies the shifted
+  // inverse to every vector (one column per thread), then picks the best approximations in their span.
+  size_t nVectors = std::min(n, std::max(2 * K, K + 8));
+  Eigen::MatrixXd X(n, nVectors), Y(n, nVectors), LY(n, nVectors);
+  std::mt19937 randomGen(0);
+  std::uniform_real_distribution<double> randomDist(-1., 1.);
+  for (size_t j = 0; j < nVectors; j++) {
+    for (size_t i = 0; i < n; i++) X(i, j) = randomDist(randomGen);
+  }
+
+  Eigen::VectorXd ritzValues;
+  bool converged = false;
+  for (size_t iIter = 0; iIter < maxIterations && !converged; iIter++) {
+    parallelFor(nVectors, nThreads, [&](size_t iThread, size_t j) {
+      Y.col(j) = solver.solve(massDiagonal.cwiseProduct(X.col(j)));
+      LY.col(j) = L * Y.col(j);
+    });
+
+    // Rayleigh-Ritz. The Ritz vectors come out orthonormal with respect to M.
+    Eigen::MatrixXd reducedL = Y.transpose() * LY;
+    reducedL = 0.5 * (reducedL + reducedL.transpose()).eval();
+    Eigen::MatrixXd reducedM = Y.transpose() * massDiagonal.asDiagonal() * Y;
+    Eigen::GeneralizedSelfAdjointEigenSolver<Eigen::MatrixXd> ritz(reducedL, reducedM);
+    if (ritz.info() != Eigen::Success) {
+      throw std::runtime_error("eigensolver failed on the reduced problem");
+    }
+    ritzValues = ritz.eigenvalues();
+    X = Y * ritz.eigenvectors();
+    Eigen::MatrixXd LX = LY * ritz.eigenvectors();
+
+    // Residuals of the wanted pairs, relative to the scale of the spectrum
+    converged = true;
+    for (size_t j = 0; j < K && converged; j++) {
+      Eigen::VectorXd MX = massDiagonal.cwiseProduct(X.col(j));
+      double residual = (LX.col(j) - ritzValues[j] * MX).norm();
+      converged = residual <= tolerance * spectrumScale * MX.norm();
+    }
+  }
+
+  eigenvalues = ritzValues.head(K);
+  eigenvectors = X.leftCols(K);
+  return converged;
+}
+
+
+HeatSolver::HeatSolver(const SparseMatrix<double>& L, const SparseMatrix<double>& M, double t)
+    : massDiagonal(checkedMassDiagonal(L, M)) {
+  if (!(t > 0.)) {
+    throw std::runtime_error("heat solve time step must be positive");
+  }
+  solver.compute(combinedOperator(L, massDiagonal, t, 1.));
+  if (solver.info() != Eigen::Success) {
+    throw std::runtime_error("failed to factor the heat operator");
+  }
+}
+
+Eigen::VectorXd HeatSolver::diffuse(const Eigen::VectorXd& u0) const {
+  if (static_cast<size_t>(u0.size()) != static_cast<size_t>(massDiagonal.size())) {
+    throw std::runtime_error("heat solve input has the wrong size");
+  }
+  return solver.solve(massDiagonal.cwiseProduct(u0));
+}
+
+
+double meanEdgeLength(const std::vector<Vector3>& vertexPositions, const std::vector<uint32_t>& triangles) {
+  double lengthSum = 0.;
+  for (size_t iC = 0; iC < triangles.size(); iC++) {
+    size_t iNext = iC % 3 == 2 ? iC - 2 : iC + 1;
+    lengthSum += norm(vertexPositions[triangles[iC]] - vertexPositions[triangles[iNext]]);
+  }
+  return triangles.empty() ? 0. : lengthSum / triangles.size();
+}
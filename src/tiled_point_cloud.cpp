@@ -0,0 +1,161 @@
+#include "tiled_point_cloud.h"
+
+#include "instrumentation.h"
+#include "operator_assembly.h"
+#include "parallel_utilities.h"
+
+#include "geometrycentral/utilities/utilities.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+using namespace geometrycentral;
+using namespace geometrycentral::surface;
+
+void buildTiledPointCloudLaplacian(const std::vector<Vector3>& points, const TuftedLaplacianOptions& options,
+                                   std::ostream& log, TuftedLaplacianResult& result) {
+
+  if (options.referencePointCloud || options.checkLocalTriangulator || options.keepTuftedCover) {
+    throw std::runtime_error("tiled point clouds do not support the reference pipeline, the local triangulator check "
+                             "or keeping the tufted cover (e.g. for the GUI)");
+  }
+  size_t nPoints = points.size();
+  if (nPoints >= std::numeric_limits<uint32_t>::max()) {
+    throw std::runtime_error("too many points for a tiled point cloud");
+  }
+  if (options.tilePoints <= options.nNeigh) {
+    throw std::runtime_error("tiles must have more points than the neighborhood size");
+  }
+  size_t nThreads = options.nThreads;
+  size_t k = options.nNeigh;
+
+  // == Split the cloud in to tiles
+  SpatialSplit split = splitSpatially(points, (nPoints + options.tilePoints - 1) / options.tilePoints);
+  const std::vector<SpatialPart>& tiles = split.parts;
+  log << "splitting " << nPoints << " points in to " << tiles.size() << " tiles" << std::endl;
+
+  // Each tile is built on its own, without tiling (or anything else that needs the whole cloud), and indexed by its
+  // local points
+  TuftedLaplacianOptions tileOptions = options;
+  tileOptions.tilePoints = 0;
+  tileOptions.preserveVertexIndices = true;
+  tileOptions.cacheDirectory.clear();
+  tileOptions.log = nullptr;
+
+  // == Build each tile, streaming the entries it owns to disk
+  OperatorEntryFile entries;
+  std::vector<double> massDiagonal(nPoints, 0.);
+  for (size_t iTile = 0; iTile < tiles.size(); iTile++) {
+    TUFTED_TRACE_SCOPE("tile");
+    const SpatialPart& tile = tiles[iTile];
+    size_t nOwned = tile.end - tile.start;
+
+    // The tile's own points come first
+    std::vector<uint32_t> localToGlobal(split.order.begin() + tile.start, split.order.begin() + tile.end);
+    std::vector<Vector3> localPoints(nOwned);
+    for (size_t i = 0; i < nOwned; i++) localPoints[i] = points[localToGlobal[i]];
+
+    // The largest kNN radius of the tile's points. Neighbors outside the tile are not considered, so this can only
+    // overestimate it, making the halo larger than needed rather than smaller.
+    double maxRadius = 0.;
+    {
+      NeighborTable ownNeigh = generate_knn_table(localPoints, k, nThreads);
+      std::vector<double> radii(nOwned, 0.);
+      parallelFor(nOwned, nThreads, [&](size_t iThread, size_t i) {
+        for (size_t j = 1; j < ownNeigh.stride; j++) {
+          radii[i] = std::max(radii[i], norm(localPoints[ownNeigh[i][j]] - localPoints[i]));
+        }
+      });
+      for (double r : radii) maxRadius = std::max(maxRadius, r);
+    }
+    double margin = options.tileHaloRadii * maxRadius;
+    double margin2 = margin * margin;
+
+    // Add the halo
+    for (size_t iOther = 0; iOther < tiles.size(); iOther++) {
+      const SpatialPart& other = tiles[iOther];
+      if (iOther == iTile || boxBoxDistance2(tile, other) > margin2) continue;
+      for (size_t i = other.start; i < other.end; i++) {
+        const Vector3& p = points[split.order[i]];
+        if (pointBoxDistance2(p, tile) <= margin2) {
+          localToGlobal.push_back(split.order[i]);
+          localPoints.push_back(p);
+        }
+      }
+    }
+    log << "  tile " << (iTile + 1) << " / " << tiles.size() << ": " << nOwned << " points, with "
+        << (localPoints.size() - nOwned) << " in the halo" << std::endl;
+
+    SimplePolygonMesh tileCloud;
+    tileCloud.vertexCoordinates = std::move(localPoints);
+    TuftedLaplacianResult tileResult = buildTuftedLaplacianFromPolygonMesh(std::move(tileCloud), tileOptions);
+
+    // Keep the off-diagonal entries whose smallest vertex the tile owns (so every pair is taken from exactly one
+    // tile, and L stays symmetric), and the masses of the tile's own points
+    const SparseMatrix<double>& tileL = tileResult.L;
+    for (int iCol = 0; iCol < tileL.outerSize(); iCol++) {
+      for (SparseMatrix<double>::InnerIterator it(tileL, iCol); it; ++it) {
+        if (it.row() == it.col()) continue;
+        uint32_t iRow = localToGlobal[it.row()], jCol = localToGlobal[it.col()];
+        if (split.partOf[std::min(iRow, jCol)] != iTile) continue;
+        entries.push(OperatorEntry{iRow, jCol, it.value()});
+      }
+    }
+    Eigen::VectorXd tileMass = tileResult.M.diagonal();
+    for (size_t i = 0; i < nOwned; i++) massDiagonal[localToGlobal[i]] = tileMass[i];
+  }
+  split = SpatialSplit();
+
+  // == Merge
+
+  // Points which are not in any triangle are removed, as when sanitizing, unless their indices are preserved
+  std::vector<char> isUsed(nPoints, false);
+  for (size_t iPt = 0; iPt < nPoints; iPt++) isUsed[iPt] = massDiagonal[iPt] > 0.;
+  entries.forEachChunk([&](const OperatorEntry* chunk, size_t n) {
+    for (size_t i = 0; i < n; i++) isUsed[chunk[i].row] = isUsed[chunk[i].col] = true;
+  });
+  std::vector<size_t>& newToOld = result.vertexIndices;
+  std::vector<size_t>& oldToNew = result.vertexRows;
+  newToOld.clear();
+  oldToNew.assign(nPoints, INVALID_IND);
+  for (size_t iPt = 0; iPt < nPoints; iPt++) {
+    if (isUsed[iPt]) {
+      oldToNew[iPt] = newToOld.size();
+      newToOld.push_back(iPt);
+    }
+  }
+  isUsed = std::vector<char>();
+  size_t nRows = options.preserveVertexIndices ? nPoints : newToOld.size();
+  auto rowOf = [&](size_t iPt) { return options.preserveVertexIndices ? iPt : oldToNew[iPt]; };
+  auto toRows = [&](const OperatorEntry& entry) {
+    return OperatorEntry{static_cast<uint32_t>(rowOf(entry.row)), static_cast<uint32_t>(rowOf(entry.col)),
+                         entry.value};
+  };
+
+  LaplacianAssembler assembler(nRows);
+  entries.forEachChunk([&](const OperatorEntry* chunk, size_t n) {
+    for (size_t i = 0; i < n; i++) assembler.count(toRows(chunk[i]));
+  });
+  assembler.allocate();
+  entries.forEachChunk([&](const OperatorEntry* chunk, size_t n) {
+    for (size_t i = 0; i < n; i++) assembler.place(toRows(chunk[i]));
+  });
+  result.L = assembler.finish(nThreads);
+
+  std::vector<Eigen::Triplet<double>> massTriplets;
+  massTriplets.reserve(newToOld.size());
+  for (size_t iPt : newToOld) massTriplets.emplace_back(rowOf(iPt), rowOf(iPt), massDiagonal[iPt]);
+  result.M = SparseMatrix<double>(nRows, nRows);
+  result.M.setFromTriplets(massTriplets.begin(), massTriplets.end());
+
+  // Only the vertices are kept; the triangles were never all in memory at once
+  result.isPointCloud = true;
+  result.triangleMesh = SimplePolygonMesh();
+  result.triangleMesh.vertexCoordinates.reserve(newToOld.size());
+  for (size_t iPt : newToOld) result.triangleMesh.vertexCoordinates.push_back(points[iPt]);
+}
@@ -0,0 +1,359 @@
+#include "tufted_cover.h"
+
+#include "instrumentation.h"
+#include "parallel_utilities.h"
+
+#include "geometrycentral/surface/simple_idt.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+using namespace geometrycentral;
+using namespace geometrycentral::surface;
+
+namespace {
+
+// Stably sort (key, value) pairs by the low `keyBits` bits of their keys, with an LSD radix sort. Every pass splits the
+// range in to one contiguous chunk per thread: each thread counts the digits in its chunk, and after a prefix sum over
+// (digit, chunk) scatters its chunk to its own slots of the output.
+void radixSortPairs(std::vector<uint64_t>& keys, std::vector<size_t>& values, int keyBits, size_t nThreads) {
+  const int digitBits = 11;
+  const size_t nBuckets = static_cast<size_t>(1) << digitBits;
+  const size_t minChunkSize = 1 << 16;
+
+  size_t n = keys.size();
+  if (n == 0) return;
+  size_t nChunks = std::max<size_t>(std::min(resolveThreadCount(nThreads), n / minChunkSize), 1);
+  size_t chunkSize = (n + nChunks - 1) / nChunks;
+  nChunks = (n + chunkSize - 1) / chunkSize;
+
+  std::vector<uint64_t> keysOut(n);
+  std::vector<size_t> valuesOut(n);
+  std::vector<size_t> slots(nChunks * nBuckets);
+  for (int shift = 0; shift < keyBits; shift += digitBits) {
+    std::fill(slots.begin(), slots.end(), 0);
+    parallelForBlocks(n, nChunks, chunkSize, [&](size_t iThread, size_t iStart, size_t iEnd) {
+      size_t* chunkCounts = &slots[(iStart / chunkSize) * nBuckets];
+      for (size_t i = iStart; i < iEnd; i++) chunkCounts[(keys[i] >> shift) & (nBuckets - 1)]++;
+    });
+
+    size_t offset = 0;
+    for (size_t iBucket = 0; iBucket < nBuckets; iBucket++) {
+      for (size_t iChunk = 0; iChunk < nChunks; iChunk++) {
+        size_t count = slots[iChunk * nBuckets + iBucket];
+        slots[iChunk * nBuckets + iBucket] = offset;
+        offset += count;
+      }
+    }
+
+    parallelForBlocks(n, nChunks, chunkSize, [&](size_t iThread, size_t iStart, size_t iEnd) {
+      size_t* chunkSlots = &slots[(iStart / chunkSize) * nBuckets];
+      for (size_t i = iStart; i < iEnd; i++) {
+        size_t iOut = chunkSlots[(keys[i] >> shift) & (nBuckets - 1)]++;
+        keysOut[iOut] = keys[i];
+        valuesOut[iOut] = values[i];
+      }
+    });
+    keys.swap(keysOut);
+    values.swap(valuesOut);
+  }
+}
+
+int bitWidth(uint64_t x) {
+  int nBits = 0;
+  while (x > 0) {
+    nBits++;
+    x >>= 1;
+  }
+  return nBits;
+}
+
+// Unit vectors x and y, such that (x, y, n) is an orthonormal frame
+void buildFrame(Vector3 n, Vector3& x, Vector3& y) {
+  Vector3 other = std::abs(n.x) < 0.9 ? Vector3{1., 0., 0.} : Vector3{0., 1., 0.};
+  x = unit(cross(n, other));
+  y = cross(n, x);
+}
+
+Vector3 vertexPosition(const FlatTriangleMesh& mesh, size_t iV) {
+  const double* p = &mesh.vertexPositions[3 * iV];
+  return Vector3{p[0], p[1], p[2]};
+}
+
+} // namespace
+
+
+EdgeIncidence buildEdgeIncidence(const FlatTriangleMesh& mesh, size_t nThreads) {
+  TUFTED_TRACE_SCOPE("edge incidence");
+
+  size_t nVertices = mesh.nVertices();
+  size_t nHalfedges = mesh.triangles.size();
+
+  // Key each halfedge by its endpoints, lower index in the high bits
+  int vertexBits = std::max(bitWidth(nVertices), 1);
+  std::vector<uint64_t> keys(nHalfedges);
+  std::vector<size_t> halfedges(nHalfedges);
+  parallelFor(nHalfedges, nThreads, [&](size_t iThread, size_t iHe) {
+    size_t iNext = iHe % 3 == 2 ? iHe - 2 : iHe + 1;
+    uint64_t iA = mesh.triangles[iHe], iB = mesh.triangles[iNext];
+    if (iA > iB) std::swap(iA, iB);
+    keys[iHe] = (iA << vertexBits) | iB;
+    halfedges[iHe] = iHe;
+  });
+  radixSortPairs(keys, halfedges, 2 * vertexBits, nThreads);
+
+  // Runs of equal keys are edges
+  EdgeIncidence result;
+  result.halfedgeEdge.resize(nHalfedges);
+  result.edgeStart.push_back(0);
+  const uint64_t lowMask = (static_cast<uint64_t>(1) << vertexBits) - 1;
+  for (size_t i = 0; i < nHalfedges; i++) {
+    if (i > 0 && keys[i] != keys[i - 1]) result.edgeStart.push_back(i);
+    if (i == 0 || keys[i] != keys[i - 1]) {
+      result.edgeVertices.push_back(static_cast<uint32_t>(keys[i] >> vertexBits));
+      result.edgeVertices.push_back(static_cast<uint32_t>(keys[i] & lowMask));
+    }
+    result.halfedgeEdge[halfedges[i]] = result.edgeStart.size() - 1;
+  }
+  result.edgeStart.push_back(nHalfedges);
+  result.edgeHalfedges = std::move(halfedges);
+  return result;
+}
+
+std::vector<double> buildEdgeLengths(const FlatTriangleMesh& mesh, const EdgeIncidence& edges, double mollifyFactor,
+                                     size_t nThreads) {
+  std::vector<double> lengths(edges.nEdges());
+  parallelFor(edges.nEdges(), nThreads, [&](size_t iThread, size_t iE) {
+    lengths[iE] = norm(vertexPosition(mesh, edges.edgeVertices[2 * iE + 1]) -
+                       vertexPosition(mesh, edges.edgeVertices[2 * iE]));
+  });
+  if (mollifyFactor <= 0 || lengths.empty()) return lengths;
+
+  double meanLength = 0.;
+  for (double l : lengths) meanLength += l;
+  meanLength /= lengths.size();
+  double delta = mollifyFactor * meanLength;
+
+  // The largest violation of the (delta-padded) triangle inequality, per thread
+  std::vector<double> threadEps(resolveThreadCount(nThreads), 0.);
+  parallelFor(mesh.nTriangles(), nThreads, [&](size_t iThread, size_t iF) {
+    double lA = lengths[edges.halfedgeEdge[3 * iF]];
+    double lB = lengths[edges.halfedgeEdge[3 * iF + 1]];
+    double lC = lengths[edges.halfedgeEdge[3 * iF + 2]];
+    double eps = std::max({delta - lA - lB + lC, delta - lA + lB - lC, delta + lA - lB - lC});
+    threadEps[iThread] = std::max(threadEps[iThread], eps);
+  });
+  double eps = *std::max_element(threadEps.begin(), threadEps.end());
+  for (double& l : lengths) l += eps;
+  return lengths;
+}
+
+FlatTuftedCover buildFlatTuftedCover(const FlatTriangleMesh& mesh, const EdgeIncidence& edges, size_t nThreads) {
+  TUFTED_TRACE_SCOPE("flat tufted cover");
+
+  size_t nTriangles = mesh.nTriangles();
+  if (2 * nTriangles > std::numeric_limits<uint32_t>::max()) {
+    throw std::runtime_error("too many triangles for a flat tufted cover");
+  }
+
+  FlatTuftedCover cover;
+  cover.triangles.resize(6 * nTriangles);
+  cover.twins.assign(6 * nTriangles, std::numeric_limits<size_t>::max());
+  parallelFor(nTriangles, nThreads, [&](size_t iThread, size_t iF) {
+    const uint32_t* tri = &mesh.triangles[3 * iF];
+    uint32_t* front = &cover.triangles[6 * iF];
+    uint32_t* back = front + 3;
+    front[0] = tri[0];
+    front[1] = tri[1];
+    front[2] = tri[2];
+    back[0] = tri[0];
+    back[1] = tri[2];
+    back[2] = tri[1];
+  });
+
+  // The copy of input halfedge iHe (of face iF, from corner j) which runs from the lower to the higher endpoint of its
+  // edge, and the copy which runs the other way
+  auto lowToHigh = [&](size_t iHe, bool isAligned) {
+    size_t iF = iHe / 3, j = iHe % 3;
+    return isAligned ? 3 * (2 * iF) + j : 3 * (2 * iF + 1) + (2 - j);
+  };
+  auto highToLow = [&](size_t iHe, bool isAligned) { return lowToHigh(iHe, !isAligned); };
+
+  // Sort the faces around each edge by angle, and glue each one to the next. Every cover halfedge is written by
+  // exactly one edge, so edges can be processed in parallel.
+  struct FanEntry {
+    double angle;
+    size_t iHe;
+    bool operator<(const FanEntry& other) const { return std::tie(angle, iHe) < std::tie(other.angle, other.iHe); }
+  };
+  std::vector<std::vector<FanEntry>> fans(resolveThreadCount(nThreads));
+  parallelFor(edges.nEdges(), nThreads, [&](size_t iThread, size_t iE) {
+    size_t iStart = edges.edgeStart[iE], iEnd = edges.edgeStart[iE + 1];
+    uint32_t iA = edges.edgeVertices[2 * iE];
+    std::vector<FanEntry>& fan = fans[iThread];
+    fan.clear();
+
+    Vector3 pA = vertexPosition(mesh, iA);
+    Vector3 edgeVec = vertexPosition(mesh, edges.edgeVertices[2 * iE + 1]) - pA;
+    if (iEnd - iStart > 2 && norm(edgeVec) > 0.) {
+      // Angles of the opposite vertices about the edge (only their cyclic order matters)
+      Vector3 edgeDir = unit(edgeVec);
+      Vector3 basisX, basisY;
+      buildFrame(edgeDir, basisX, basisY);
+      for (size_t i = iStart; i < iEnd; i++) {
+        size_t iHe = edges.edgeHalfedges[i];
+        size_t iOpposite = iHe % 3 == 0 ? iHe + 2 : iHe - 1;
+        Vector3 offset = vertexPosition(mesh, mesh.triangles[iOpposite]) - pA;
+        fan.push_back(FanEntry{std::atan2(dot(offset, basisY), dot(offset, basisX)), iHe});
+      }
+      std::sort(fan.begin(), fan.end());
+    } else {
+      for (size_t i = iStart; i < iEnd; i++) fan.push_back(FanEntry{0., edges.edgeHalfedges[i]});
+    }
+
+    for (size_t i = 0; i < fan.size(); i++) {
+      size_t iHeThis = fan[i].iHe;
+      size_t iHeNext = fan[(i + 1) % fan.size()].iHe;
+      bool thisAligned = mesh.triangles[iHeThis] == iA;
+      bool nextAligned = mesh.triangles[iHeNext] == iA;
+      size_t iCoverThis = lowToHigh(iHeThis, thisAligned);
+      size_t iCoverNext = highToLow(iHeNext, nextAligned);
+      cover.twins[iCoverThis] = iCoverNext;
+      cover.twins[iCoverNext] = iCoverThis;
+    }
+  });
+
+  return cover;
+}
+
+std::unique_ptr<SurfaceMesh> makeTuftedCoverMesh(const FlatTuftedCover& cover, const EdgeIncidence& edges,
+                                                 std::vector<size_t>& coverEdgeToInput, size_t nThreads) {
+  TUFTED_TRACE_SCOPE("tufted cover mesh");
+
+  size_t nCoverFaces = cover.triangles.size() / 3;
+  std::vector<std::vector<size_t>> polygons(nCoverFaces);
+  std::vector<std::vector<std::tuple<size_t, size_t>>> twins(nCoverFaces);
+  parallelFor(nCoverFaces, nThreads, [&](size_t iThread, size_t iC) {
+    polygons[iC].resize(3);
+    twins[iC].resize(3);
+    for (size_t k = 0; k < 3; k++) {
+      polygons[iC][k] = cover.triangles[3 * iC + k];
+      size_t iTwin = cover.twins[3 * iC + k];
+      twins[iC][k] = std::make_tuple(iTwin / 3, iTwin % 3);
+    }
+  });
+  std::unique_ptr<SurfaceMesh> coverMesh(new SurfaceMesh(polygons, twins));
+
+  // Faces keep the order of the polygons, so the halfedges of face iC are copies of those of cover triangle iC
+  coverEdgeToInput.resize(coverMesh->nEdges());
+  for (Face f : coverMesh->faces()) {
+    size_t iC = f.getIndex();
+    for (Halfedge he : f.adjacentHalfedges()) {
+      size_t iTail = he.tailVertex().getIndex();
+      size_t k = 0;
+      while (k < 3 && cover.triangles[3 * iC + k] != iTail) k++;
+      if (k == 3) throw std::runtime_error("tufted cover mesh does not match its triangles");
+      coverEdgeToInput[he.edge().getIndex()] = edges.halfedgeEdge[coverHalfedgeToInput(3 * iC + k)];
+    }
+  }
+  return coverMesh;
+}
+
+std::vector<double> coverFaceValues(SurfaceMesh& inputMesh, SurfaceMesh& coverMesh,
+                                    const std::vector<double>& inputFaceValues) {
+  typedef std::array<size_t, 3> VertexTriple;
+  auto sortedVertices = [](Face f) {
+    VertexTriple triple;
+    Halfedge he = f.halfedge();
+    for (size_t k = 0; k < 3; k++) {
+      triple[k] = he.tailVertex().getIndex();
+      he = he.next();
+    }
+    std::sort(triple.begin(), triple.end());
+    return triple;
+  };
+
+  std::vector<std::pair<VertexTriple, size_t>> inputFaces;
+  inputFaces.reserve(inputMesh.nFaces());
+  for (Face f : inputMesh.faces()) inputFaces.emplace_back(sortedVertices(f), f.getIndex());
+  std::sort(inputFaces.begin(), inputFaces.end());
+
+  std::vector<double> result(coverMesh.nFaces());
+  for (Face f : coverMesh.faces()) {
+    VertexTriple triple = sortedVertices(f);
+    auto it = std::lower_bound(inputFaces.begin(), inputFaces.end(), std::make_pair(triple, static_cast<size_t>(0)));
+    if (it == inputFaces.end() || it->first != triple) {
+      throw std::runtime_error("tufted cover has a face which is not in the input mesh");
+    }
+    result[f.getIndex()] = inputFaceValues[it->second];
+  }
+  return result;
+}
+
+size_t flipToDelaunayWithinScales(SurfaceMesh& mesh, EdgeData<double>& edgeLengths,
+                                  const std::vector<double>& faceScales, double delaunayEPS) {
+  if (faceScales.empty()) return flipToDelaunay(mesh, edgeLengths, FlipType::Euclidean, delaunayEPS);
+  TUFTED_TRACE_SCOPE("weighted delaunay flips");
+  if (faceScales.size() != mesh.nFaces()) {
+    throw std::runtime_error("weighted Delaunay flips need one face scale per face");
+  }
+
+  // The sides of the face of `he` from its tail to the opposite corner, and from its tip
+  auto oppositeSides = [&](Halfedge he, double& fromTail, double& fromTip) {
+    fromTip = edgeLengths[he.next().edge()];
+    fromTail = edgeLengths[he.next().next().edge()];
+  };
+  // Half the cotangent of the corner opposite `he`
+  auto halfCotan = [&](Halfedge he) {
+    double a = edgeLengths[he.edge()], b, c;
+    oppositeSides(he, b, c);
+    double area = 0.25 * std::sqrt(std::max((a + b + c) * (-a + b + c) * (a - b + c) * (a + b - c), 0.));
+    return (b * b + c * c - a * a) / (8. * area);
+  };
+  // The corner opposite an edge of length l laid out from (0, 0) to (l, 0), at these distances from its ends
+  auto layoutCorner = [](double l, double fromTail, double fromTip, double& x, double& y) {
+    x = (l * l + fromTail * fromTail - fromTip * fromTip) / (2. * l);
+    y = std::sqrt(std::max(fromTail * fromTail - x * x, 0.));
+  };
+
+  std::deque<Edge> edgesToCheck;
+  EdgeData<char> inQueue(mesh, true);
+  for (Edge e : mesh.edges()) edgesToCheck.push_back(e);
+  size_t nFlips = 0;
+  while (!edgesToCheck.empty()) {
+    Edge e = edgesToCheck.front();
+    edgesToCheck.pop_front();
+    inQueue[e] = false;
+    if (e.isBoundary() || !e.isManifold()) continue;
+
+    Halfedge heA = e.halfedge(), heB = heA.sibling();
+    if (faceScales[heA.face().getIndex()] != faceScales[heB.face().getIndex()]) continue;
+    if (halfCotan(heA) + halfCotan(heB) >= -delaunayEPS) continue; // (NaN weights count as not Delaunay)
+
+    // The new edge joins the two opposite corners, laid out on either side of e
+    double l = edgeLengths[e], aTail, aTip, bTail, bTip;
+    oppositeSides(heA, aTail, aTip);
+    oppositeSides(heB, bTail, bTip);
+    if (heB.orientation() != heA.orientation()) std::swap(bTail, bTip); // (heB runs from heA's tip to its tail)
+    double xA, yA, xB, yB;
+    layoutCorner(l, aTail, aTip, xA, yA);
+    layoutCorner(l, bTail, bTip, xB, yB);
+    Halfedge diamond[4] = {heA.next(), heA.next().next(), heB.next(), heB.next().next()};
+
+    if (!mesh.flip(e, false)) continue;
+    edgeLengths[e] = std::hypot(xA - xB, yA + yB);
+    nFlips++;
+    for (Halfedge he : diamond) {
+      if (inQueue[he.edge()]) continue;
+      inQueue[he.edge()] = true;
+      edgesToCheck.push_back(he.edge());
+    }
+  }
+  return nFlips;
+}
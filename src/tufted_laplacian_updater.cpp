@@ -0,0 +1,263 @@
+#include "tufted_laplacian_updater.h"
+
+#include "instrumentation.h"
+#include "parallel_utilities.h"
+
+#include "geometrycentral/surface/intrinsic_mollification.h"
+#include "geometrycentral/surface/simple_idt.h"
+#include "geometrycentral/surface/tufted_laplacian.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+using namespace geometrycentral;
+using namespace geometrycentral::surface;
+
+namespace {
+
+// Visit the terms of the cotan Laplacian and lumped mass matrix of an intrinsic triangulation, face by face:
+// faceTerms(iF, iV, w, a), with iV[k] the vertices of face iF in halfedge order, w[k] the cotan weight (half the
+// cotangent of the opposite corner) of the halfedge from iV[k] to iV[(k + 1) % 3], and a one third of the face area.
+// Areas and cotangents are computed from edge lengths alone, as in EdgeLengthGeometry, and multiplied by the face's
+// entry in `faceScales`, if it is not empty.
+template <typename FaceFunc>
+void forEachFaceTerm(SurfaceMesh& mesh, const EdgeData<double>& edgeLengths, const std::vector<double>& faceScales,
+                     FaceFunc&& faceTerms) {
+  for (Face f : mesh.faces()) {
+    double faceScale = faceScales.empty() ? 1. : faceScales[f.getIndex()];
+    Halfedge he = f.halfedge();
+    size_t iV[3];
+    double l[3];
+    for (int k = 0; k < 3; k++) {
+      iV[k] = he.tailVertex().getIndex();
+      l[k] = edgeLengths[he.edge()];
+      he = he.next();
+    }
+
+    // Heron's formula
+    double s = (l[0] + l[1] + l[2]) / 2.;
+    double area = std::sqrt(std::max(0., s * (s - l[0]) * (s - l[1]) * (s - l[2])));
+
+    double w[3];
+    for (int k = 0; k < 3; k++) {
+      double lOpp = l[k], lA = l[(k + 1) % 3], lB = l[(k + 2) % 3];
+      double cotan = (lA * lA + lB * lB - lOpp * lOpp) / (4. * area);
+      w[k] = faceScale * cotan / 2.;
+    }
+    faceTerms(f.getIndex(), iV, w, faceScale * area / 3.);
+  }
+}
+
+// Whether the faces of `mesh` have the vertices listed in `faceVertices` (3 per face, in halfedge order)
+bool sameFaceVertices(SurfaceMesh& mesh, const std::vector<size_t>& faceVertices) {
+  if (faceVertices.size() != 3 * mesh.nFaces()) return false;
+  for (Face f : mesh.faces()) {
+    Halfedge he = f.halfedge();
+    for (size_t k = 0; k < 3; k++) {
+      if (he.tailVertex().getIndex() != faceVertices[3 * f.getIndex() + k]) return false;
+      he = he.next();
+    }
+  }
+  return true;
+}
+
+// The stored entry (row, col) of a compressed column-major matrix, or nullptr if there is none
+double* findEntry(SparseMatrix<double>& mat, size_t row, size_t col) {
+  typedef SparseMatrix<double>::StorageIndex StorageIndex;
+  const StorageIndex* colStart = mat.innerIndexPtr() + mat.outerIndexPtr()[col];
+  const StorageIndex* colEnd = mat.innerIndexPtr() + mat.outerIndexPtr()[col + 1];
+  const StorageIndex* it = std::lower_bound(colStart, colEnd, static_cast<StorageIndex>(row));
+  if (it == colEnd || static_cast<size_t>(*it) != row) return nullptr;
+  return mat.valuePtr() + (it - mat.innerIndexPtr());
+}
+
+} // namespace
+
+
+TuftedLaplacianUpdater::TuftedLaplacianUpdater(const TuftedLaplacianResult& result,
+                                               const TuftedLaplacianOptions& options)
+    : mollifyFactor(options.mollifyFactor), nThreads(resolveThreadCount(options.nThreads)) {
+
+  // (the result does not keep its halfedge mesh on a cache hit or the manifold fast path, but it can be rebuilt)
+  if (result.mesh) {
+    inputMesh = result.mesh->copyToSurfaceMesh();
+  } else if (!result.triangles.empty()) {
+    std::vector<std::vector<size_t>> polygons(result.triangles.size() / 3);
+    for (size_t iF = 0; iF < polygons.size(); iF++) {
+      polygons[iF] = {result.triangles[3 * iF], result.triangles[3 * iF + 1], result.triangles[3 * iF + 2]};
+    }
+    inputMesh.reset(new SurfaceMesh(polygons));
+  } else {
+    throw std::runtime_error("TuftedLaplacianUpdater needs a result which still has its mesh");
+  }
+  inputMesh->compress();
+  size_t nVertices = inputMesh->nVertices();
+  positions = result.triangleMesh.vertexCoordinates;
+  vertexIndices = result.vertexIndices;
+  if (options.preserveVertexIndices) {
+    rowIndices = vertexIndices;
+    nRows = result.vertexRows.size();
+  } else {
+    rowIndices.resize(nVertices);
+    for (size_t iV = 0; iV < nVertices; iV++) rowIndices[iV] = iV;
+    nRows = nVertices;
+  }
+  scale = (result.isPointCloud && !options.dedupTriangles) ? 1. / 3. : 1.;
+
+  // Edges of the input mesh, keyed by their (sorted) endpoints. In a general SurfaceMesh, all faces incident on a pair
+  // of vertices share a single edge.
+  std::vector<std::pair<std::pair<size_t, size_t>, size_t>> edgesByEndpoints;
+  inputEdgeVertices.resize(2 * inputMesh->nEdges());
+  for (Edge e : inputMesh->edges()) {
+    size_t iA = e.halfedge().tailVertex().getIndex();
+    size_t iB = e.halfedge().tipVertex().getIndex();
+    inputEdgeVertices[2 * e.getIndex()] = iA;
+    inputEdgeVertices[2 * e.getIndex() + 1] = iB;
+    edgesByEndpoints.push_back({std::minmax(iA, iB), e.getIndex()});
+  }
+  std::sort(edgesByEndpoints.begin(), edgesByEndpoints.end());
+
+  // Build the combinatorial cover, once, exactly as buildTuftedLaplacian() does (which uses the initial positions to
+  // order the faces around nonmanifold edges)
+  coverMesh = inputMesh->copyToSurfaceMesh();
+  {
+    VertexData<Vector3> coverPositions(*coverMesh);
+    for (Vertex v : coverMesh->vertices()) coverPositions[v] = positions[v.getIndex()];
+    VertexPositionGeometry coverGeom(*coverMesh, coverPositions);
+    coverGeom.requireEdgeLengths();
+    EdgeData<double> coverEdgeLengths = coverGeom.edgeLengths;
+    buildIntrinsicTuftedCover(*coverMesh, coverEdgeLengths, &coverGeom);
+  }
+  coverMesh->compress();
+  if (!result.faceScales.empty()) coverFaceScales = coverFaceValues(*inputMesh, *coverMesh, result.faceScales);
+
+  // The cover only duplicates faces, so each of its edges joins the endpoints of an input edge
+  coverEdgeToInput.resize(coverMesh->nEdges());
+  for (Edge e : coverMesh->edges()) {
+    size_t iA = e.halfedge().tailVertex().getIndex();
+    size_t iB = e.halfedge().tipVertex().getIndex();
+    std::pair<size_t, size_t> key = std::minmax(iA, iB);
+    auto it = std::lower_bound(edgesByEndpoints.begin(), edgesByEndpoints.end(),
+                               std::make_pair(key, static_cast<size_t>(0)));
+    if (it == edgesByEndpoints.end() || it->first != key) {
+      throw std::runtime_error("tufted cover has an edge which is not in the input mesh");
+    }
+    coverEdgeToInput[e.getIndex()] = it->second;
+  }
+
+  recompute(false);
+}
+
+bool TuftedLaplacianUpdater::update(const double* inputVertexPositions) {
+  parallelFor(positions.size(), nThreads, [&](size_t iThread, size_t iV) {
+    const double* p = inputVertexPositions + 3 * vertexIndices[iV];
+    positions[iV] = Vector3{p[0], p[1], p[2]};
+  });
+
+  return recompute(true);
+}
+
+bool TuftedLaplacianUpdater::recompute(bool inPlace) {
+  TUFTED_TRACE_SCOPE("update operators");
+
+  // Mollify the lengths of the input mesh, as buildTuftedLaplacian() does before building the cover
+  EdgeData<double> inputEdgeLengths(*inputMesh);
+  parallelFor(inputMesh->nEdges(), nThreads, [&](size_t iThread, size_t iE) {
+    inputEdgeLengths[iE] = norm(positions[inputEdgeVertices[2 * iE]] - positions[inputEdgeVertices[2 * iE + 1]]);
+  });
+  if (mollifyFactor > 0) {
+    mollifyIntrinsic(*inputMesh, inputEdgeLengths, mollifyFactor);
+  }
+
+  // Flip the cover to Delaunay. A triangulation which needed no flips is still the unflipped cover, and is reused.
+  if (!flippedMesh || flippedMeshHasFlips) {
+    flippedMesh = coverMesh->copyToSurfaceMesh();
+    flippedEdgeLengths = EdgeData<double>(*flippedMesh);
+  }
+  parallelFor(coverEdgeToInput.size(), nThreads, [&](size_t iThread, size_t iE) {
+    flippedEdgeLengths[iE] = inputEdgeLengths[coverEdgeToInput[iE]];
+  });
+  size_t nFlips = flipToDelaunayWithinScales(*flippedMesh, flippedEdgeLengths, coverFaceScales);
+  flippedMeshHasFlips = nFlips > 0;
+  TUFTED_TRACE_COUNT("delaunay flips", nFlips);
+
+  // The cover counts every face twice, hence the extra factor of 1/2
+  double factor = 0.5 * scale;
+
+  // Write the values in to the existing pattern, through the slots of the last triangulation if it is unchanged (after
+  // flips, it often is), and otherwise through new ones, unless some term has no entry
+  if (inPlace && (sameFaceVertices(*flippedMesh, slotFaceVertices) || findSlots())) {
+    std::fill(laplacian.valuePtr(), laplacian.valuePtr() + laplacian.nonZeros(), 0.);
+    std::fill(mass.valuePtr(), mass.valuePtr() + mass.nonZeros(), 0.);
+    double* laplacianValues = laplacian.valuePtr();
+    double* massValues = mass.valuePtr();
+    forEachFaceTerm(*flippedMesh, flippedEdgeLengths, coverFaceScales,
+                    [&](size_t iF, const size_t* iV, const double* w, double a) {
+                      const StorageIndex* slots = &laplacianSlots[12 * iF];
+                      for (size_t k = 0; k < 3; k++) {
+                        laplacianValues[slots[4 * k]] += factor * w[k];
+                        laplacianValues[slots[4 * k + 1]] += factor * w[k];
+                        laplacianValues[slots[4 * k + 2]] -= factor * w[k];
+                        laplacianValues[slots[4 * k + 3]] -= factor * w[k];
+                        massValues[massSlots[3 * iF + k]] += factor * a;
+                      }
+                    });
+    return true;
+  }
+
+  // Otherwise, build them from scratch
+  std::vector<Eigen::Triplet<double>> laplacianTriplets, massTriplets;
+  laplacianTriplets.reserve(12 * flippedMesh->nFaces());
+  massTriplets.reserve(3 * flippedMesh->nFaces());
+  forEachFaceTerm(*flippedMesh, flippedEdgeLengths, coverFaceScales,
+                  [&](size_t iF, const size_t* iV, const double* w, double a) {
+                    for (size_t k = 0; k < 3; k++) {
+                      size_t rA = rowIndices[iV[k]], rB = rowIndices[iV[(k + 1) % 3]];
+                      laplacianTriplets.emplace_back(rA, rA, factor * w[k]);
+                      laplacianTriplets.emplace_back(rB, rB, factor * w[k]);
+                      laplacianTriplets.emplace_back(rA, rB, -factor * w[k]);
+                      laplacianTriplets.emplace_back(rB, rA, -factor * w[k]);
+                      massTriplets.emplace_back(rA, rA, factor * a);
+                    }
+                  });
+
+  laplacian = SparseMatrix<double>(nRows, nRows);
+  laplacian.setFromTriplets(laplacianTriplets.begin(), laplacianTriplets.end());
+  mass = SparseMatrix<double>(nRows, nRows);
+  mass.setFromTriplets(massTriplets.begin(), massTriplets.end());
+  findSlots();
+  return false;
+}
+
+bool TuftedLaplacianUpdater::findSlots() {
+  slotFaceVertices.resize(3 * flippedMesh->nFaces());
+  laplacianSlots.resize(12 * flippedMesh->nFaces());
+  massSlots.resize(3 * flippedMesh->nFaces());
+  bool allFound = true;
+  auto slot = [&](SparseMatrix<double>& mat, size_t row, size_t col) {
+    double* entry = findEntry(mat, row, col);
+    if (!entry) {
+      allFound = false;
+      return static_cast<StorageIndex>(0);
+    }
+    return static_cast<StorageIndex>(entry - mat.valuePtr());
+  };
+  for (Face f : flippedMesh->faces()) {
+    size_t iF = f.getIndex();
+    Halfedge he = f.halfedge();
+    for (size_t k = 0; k < 3; k++) {
+      size_t rA = rowIndices[he.tailVertex().getIndex()], rB = rowIndices[he.tipVertex().getIndex()];
+      slotFaceVertices[3 * iF + k] = he.tailVertex().getIndex();
+      laplacianSlots[12 * iF + 4 * k] = slot(laplacian, rA, rA);
+      laplacianSlots[12 * iF + 4 * k + 1] = slot(laplacian, rB, rB);
+      laplacianSlots[12 * iF + 4 * k + 2] = slot(laplacian, rA, rB);
+      laplacianSlots[12 * iF + 4 * k + 3] = slot(laplacian, rB, rA);
+      massSlots[3 * iF + k] = slot(mass, rA, rA);
+      he = he.next();
+    }
+  }
+  if (!allFound) slotFaceVertices.clear(); // (so the slots are not used)
+  return allFound;
+}
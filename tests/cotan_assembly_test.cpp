@@ -0,0 +1,107 @@
+// Checks that the fused cotan assembly (buildCotanOperators()) gives the same L and M as geometry-central's
+// EdgeLengthGeometry, scaled by 1/2 as in buildTuftedLaplacian(), on the flipped tufted cover of a small nonmanifold
+// mesh: three faces on one edge, and an obtuse triangle hanging off a single vertex. Flipping the two copies of the
+// obtuse triangle in the cover joins its obtuse corner to itself, so the cover then has sides which start and end at the
+// same vertex, and faces which use a vertex twice, the cases the fused kernel handles specially.
+
+#include "cotan_assembly.h"
+
+#include "geometrycentral/surface/edge_length_geometry.h"
+#include "geometrycentral/surface/simple_idt.h"
+#include "geometrycentral/surface/tufted_laplacian.h"
+#include "geometrycentral/surface/vertex_position_geometry.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace geometrycentral;
+using namespace geometrycentral::surface;
+
+namespace {
+
+const double tolerance = 1e-12; // relative to the largest entry
+
+// The largest difference between two matrices of the same size, relative to the largest entry of `reference`
+double relativeDifference(const SparseMatrix<double>& mat, const SparseMatrix<double>& reference) {
+  SparseMatrix<double> diff = mat - reference;
+  double maxDiff = 0., maxEntry = 0.;
+  for (int k = 0; k < diff.outerSize(); k++) {
+    for (SparseMatrix<double>::InnerIterator it(diff, k); it; ++it) maxDiff = std::max(maxDiff, std::abs(it.value()));
+  }
+  for (int k = 0; k < reference.outerSize(); k++) {
+    for (SparseMatrix<double>::InnerIterator it(reference, k); it; ++it) {
+      maxEntry = std::max(maxEntry, std::abs(it.value()));
+    }
+  }
+  return maxDiff / maxEntry;
+}
+
+// Returns the number of mismatches (0 or 1), reporting them
+size_t compare(const std::string& name, const SparseMatrix<double>& mat, const SparseMatrix<double>& reference) {
+  if (mat.rows() != reference.rows() || mat.cols() != reference.cols()) {
+    std::cout << name << ": sizes differ" << std::endl;
+    return 1;
+  }
+  double difference = relativeDifference(mat, reference);
+  std::cout << name << ": max relative difference " << difference << std::endl;
+  return difference < tolerance ? 0 : 1; // (also catches NaN)
+}
+
+} // namespace
+
+int main() {
+  // Three faces on the edge 0-1, and the triangle 1-5-6, with an angle of about 170 degrees at 6
+  std::vector<Vector3> positions = {{0., 0., 0.},      {1., 0., 0.}, {0.5, 1., 0.}, {0.5, -0.5, 0.8},
+                                    {0.5, -0.5, -0.8}, {3., 0., 0.}, {2., 0.1, 0.}};
+  std::vector<std::vector<size_t>> polygons = {{0, 1, 2}, {1, 0, 3}, {0, 1, 4}, {1, 5, 6}};
+
+  // The flipped tufted cover, as in buildTuftedLaplacian()
+  SurfaceMesh mesh(polygons);
+  VertexData<Vector3> vertexPositions(mesh);
+  for (size_t iV = 0; iV < positions.size(); iV++) vertexPositions[iV] = positions[iV];
+  VertexPositionGeometry geometry(mesh, vertexPositions);
+  geometry.requireEdgeLengths();
+  EdgeData<double> edgeLengths = geometry.edgeLengths;
+  buildIntrinsicTuftedCover(mesh, edgeLengths, &geometry);
+  size_t nFlips = flipToDelaunay(mesh, edgeLengths);
+  mesh.compress();
+
+  size_t nLoopSides = 0, nRepeatingFaces = 0;
+  for (Face f : mesh.faces()) {
+    Halfedge he = f.halfedge();
+    size_t iV[3];
+    for (size_t k = 0; k < 3; k++) {
+      iV[k] = he.tailVertex().getIndex();
+      if (he.tailVertex().getIndex() == he.tipVertex().getIndex()) nLoopSides++;
+      he = he.next();
+    }
+    if (iV[0] == iV[1] || iV[1] == iV[2] || iV[0] == iV[2]) nRepeatingFaces++;
+  }
+  std::cout << mesh.nFaces() << " cover faces after " << nFlips << " flips, " << nRepeatingFaces
+            << " of them using a vertex twice, with " << nLoopSides << " sides from a vertex to itself" << std::endl;
+  size_t nFailed = 0;
+  if (nLoopSides == 0 || nRepeatingFaces == 0) {
+    std::cout << "the flipped cover should have faces which use a vertex twice" << std::endl;
+    nFailed++;
+  }
+
+  EdgeLengthGeometry intrinsicGeometry(mesh, edgeLengths);
+  intrinsicGeometry.requireCotanLaplacian();
+  intrinsicGeometry.requireVertexLumpedMassMatrix();
+  SparseMatrix<double> referenceL = 0.5 * intrinsicGeometry.cotanLaplacian;
+  SparseMatrix<double> referenceM = 0.5 * intrinsicGeometry.vertexLumpedMassMatrix;
+
+  for (size_t nThreads : {1, 3}) {
+    SparseMatrix<double> L, M;
+    buildCotanOperators(intrinsicTrianglesFromMesh(mesh, edgeLengths, nThreads), 0.5, L, M, nThreads);
+    std::string suffix = " (" + std::to_string(nThreads) + " threads)";
+    nFailed += compare("L" + suffix, L, referenceL);
+    nFailed += compare("M" + suffix, M, referenceM);
+  }
+
+  return nFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,72 @@
+// Checks that merging the copies of point cloud triangles (TuftedLaplacianOptions::dedupTriangles) keeps the total mass
+// of keeping every copy and dividing by 3, on a seeded noisy sphere where the local triangulations disagree, so that
+// the merged triangles have different weights. Also checks that the rows of L still sum to zero.
+
+#include "laplacian_builder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <set>
+#include <vector>
+
+namespace {
+
+const double tolerance = 1e-10; // relative, on the total mass
+
+std::vector<double> makeCloud() {
+  std::mt19937 rng(4321);
+  std::normal_distribution<double> gaussian;
+  std::uniform_real_distribution<double> noise(-0.02, 0.02);
+
+  const size_t nPoints = 800;
+  std::vector<double> positions;
+  for (size_t i = 0; i < nPoints; i++) {
+    Vector3 p = unit(Vector3{gaussian(rng), gaussian(rng), gaussian(rng)});
+    p *= 1. + noise(rng);
+    positions.insert(positions.end(), {p.x, p.y, p.z});
+  }
+  return positions;
+}
+
+double maxAbsRowSum(const SparseMatrix<double>& L) {
+  Eigen::VectorXd rowSums = L * Eigen::VectorXd::Ones(L.cols());
+  return rowSums.cwiseAbs().maxCoeff();
+}
+
+} // namespace
+
+int main() {
+  std::vector<double> positions = makeCloud();
+  size_t nPoints = positions.size() / 3;
+  size_t nFailed = 0;
+
+  TuftedLaplacianOptions options;
+  TuftedLaplacianResult kept = buildTuftedLaplacianFromPoints(positions.data(), nPoints, options);
+  options.dedupTriangles = true;
+  TuftedLaplacianResult merged = buildTuftedLaplacianFromPoints(positions.data(), nPoints, options);
+
+  std::set<double> weights(merged.faceScales.begin(), merged.faceScales.end());
+  std::cout << kept.triangles.size() / 3 << " triangles kept, " << merged.triangles.size() / 3 << " merged, with "
+            << weights.size() << " distinct weights" << std::endl;
+  if (weights.size() < 2) {
+    std::cout << "the merged triangles should not all have the same weight" << std::endl;
+    nFailed++;
+  }
+
+  double keptMass = kept.M.sum(), mergedMass = merged.M.sum();
+  double massError = std::abs(mergedMass - keptMass) / keptMass;
+  std::cout << "total mass: " << keptMass << " kept, " << mergedMass << " merged (relative difference " << massError
+            << ")" << std::endl;
+  if (!(massError < tolerance)) nFailed++;
+
+  for (const SparseMatrix<double>* L : {&kept.L, &merged.L}) {
+    double rowSum = maxAbsRowSum(*L);
+    std::cout << "max |row sum of L|: " << rowSum << std::endl;
+    if (!(rowSum < tolerance * std::max(1., L->cwiseAbs().sum()))) nFailed++;
+  }
+
+  return nFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,97 @@
+// Checks that TuftedLaplacianUpdater::update() gives the same L and M as building from scratch, frame by frame, on a
+// deforming nonmanifold mesh: a rhombus of two triangles, with two fins on one of its sides. First the rhombus is only
+// stretched a little, so that no edge is flipped and every update works in place; then it is stretched along its
+// diagonal 0-2 until the cover flips it to 1-3, which grows the sparsity pattern once, and back.
+
+#include "tufted_laplacian_updater.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const double tolerance = 1e-12; // relative to the largest entry
+
+// The rhombus 0-1-2-3 with half-diagonals `a` along x and 1 along y, and fins 0-1-4 (above) and 1-0-5 (below) its side
+// 0-1. The diagonal 0-2 is Delaunay while a < 1.
+std::vector<double> rhombusPositions(double a) {
+  return {-a, 0., 0., 0., -1., 0., a, 0., 0., 0., 1., 0., -a / 2., -0.5, 1., -a / 2., -0.5, -1.};
+}
+const std::vector<uint32_t> triangles = {0, 1, 2, 0, 2, 3, 0, 1, 4, 1, 0, 5};
+
+struct Frame {
+  double a;
+  bool expectInPlace; // the expected return value of update()
+};
+
+// The largest difference between two matrices of the same size, relative to the largest entry of `reference`
+double relativeDifference(const SparseMatrix<double>& mat, const SparseMatrix<double>& reference) {
+  SparseMatrix<double> diff = mat - reference;
+  double maxDiff = 0., maxEntry = 0.;
+  for (int k = 0; k < diff.outerSize(); k++) {
+    for (SparseMatrix<double>::InnerIterator it(diff, k); it; ++it) maxDiff = std::max(maxDiff, std::abs(it.value()));
+  }
+  for (int k = 0; k < reference.outerSize(); k++) {
+    for (SparseMatrix<double>::InnerIterator it(reference, k); it; ++it) {
+      maxEntry = std::max(maxEntry, std::abs(it.value()));
+    }
+  }
+  return maxDiff / maxEntry;
+}
+
+// Returns the number of mismatches (0 or 1), reporting them
+size_t compare(const std::string& name, const SparseMatrix<double>& mat, const SparseMatrix<double>& reference) {
+  if (mat.rows() != reference.rows() || mat.cols() != reference.cols()) {
+    std::cout << name << ": sizes differ" << std::endl;
+    return 1;
+  }
+  double difference = relativeDifference(mat, reference);
+  std::cout << name << ": max relative difference " << difference << std::endl;
+  return difference < tolerance ? 0 : 1; // (also catches NaN)
+}
+
+TuftedLaplacianResult buildRhombus(double a) {
+  std::vector<double> positions = rhombusPositions(a);
+  return buildTuftedLaplacianFromMesh(positions.data(), positions.size() / 3, triangles.data(), triangles.size() / 3);
+}
+
+// Starts an updater at `a0`, then updates it through `frames`
+size_t checkFrames(const std::string& name, double a0, const std::vector<Frame>& frames) {
+  size_t nFailed = 0;
+  TuftedLaplacianResult initial = buildRhombus(a0);
+  TuftedLaplacianUpdater updater(initial);
+  nFailed += compare(name + ", initial L", updater.L(), initial.L);
+  nFailed += compare(name + ", initial M", updater.M(), initial.M);
+
+  for (size_t iFrame = 0; iFrame < frames.size(); iFrame++) {
+    const Frame& frame = frames[iFrame];
+    std::string frameName = name + ", frame " + std::to_string(iFrame + 1) + " (a = " + std::to_string(frame.a) + ")";
+    std::vector<double> positions = rhombusPositions(frame.a);
+    bool inPlace = updater.update(positions.data());
+    std::cout << frameName << ": " << (inPlace ? "updated in place" : "reallocated") << std::endl;
+    if (inPlace != frame.expectInPlace) {
+      std::cout << frameName << ": expected the update " << (frame.expectInPlace ? "in place" : "to reallocate")
+                << std::endl;
+      nFailed++;
+    }
+
+    TuftedLaplacianResult fresh = buildRhombus(frame.a);
+    nFailed += compare(frameName + ", L", updater.L(), fresh.L);
+    nFailed += compare(frameName + ", M", updater.M(), fresh.M);
+  }
+  return nFailed;
+}
+
+} // namespace
+
+int main() {
+  size_t nFailed = 0;
+  nFailed += checkFrames("no flips", 0.8, {{0.85, true}, {0.9, true}, {0.75, true}});
+  nFailed += checkFrames("flips", 0.8, {{0.9, true}, {1.25, false}, {1.3, true}, {0.8, true}});
+  return nFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
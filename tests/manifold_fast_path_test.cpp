@@ -0,0 +1,133 @@
+// Checks that the manifold fast path (TuftedLaplacianOptions::manifoldFastPath) gives the same L and M as building
+// the tufted cover, and that it is taken exactly when the pre-check says the cover is trivial: on a closed mesh, on a
+// flat disk with boundary, and on two closed meshes sharing a vertex (edge-manifold but not vertex-manifold), but not
+// once a triangle with an obtuse angle opposite a boundary edge is added to the disk.
+
+#include "laplacian_builder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const double tolerance = 1e-12; // relative to the largest entry
+
+struct TestMesh {
+  std::string name;
+  std::vector<double> positions;
+  std::vector<uint32_t> triangles;
+  bool expectFastPath;
+};
+
+// The regular octahedron, with every edge opposite two 60 degree angles
+TestMesh octahedron() {
+  TestMesh mesh;
+  mesh.name = "octahedron";
+  mesh.positions = {1., 0., 0., -1., 0., 0., 0., 1., 0., 0., -1., 0., 0., 0., 1., 0., 0., -1.};
+  mesh.triangles = {0, 2, 4, 2, 1, 4, 1, 3, 4, 3, 0, 4, 2, 0, 5, 1, 2, 5, 3, 1, 5, 0, 3, 5};
+  mesh.expectFastPath = true;
+  return mesh;
+}
+
+// A flat regular hexagon, fanned from its center (vertex 0), so its boundary edges are opposite 60 degree angles
+TestMesh hexagon() {
+  TestMesh mesh;
+  mesh.name = "hexagon";
+  const double h = std::sqrt(3.) / 2.;
+  mesh.positions = {0., 0., 0., 1., 0., 0., 0.5, h, 0., -0.5, h, 0., -1., 0., 0., -0.5, -h, 0., 0.5, -h, 0.};
+  for (uint32_t k = 0; k < 6; k++) mesh.triangles.insert(mesh.triangles.end(), {0, 1 + k, 1 + (k + 1) % 6});
+  mesh.expectFastPath = true;
+  return mesh;
+}
+
+// The hexagon with a triangle 1-7-2 outside its edge 1-2, with an angle of about 135 degrees at 1 opposite the new
+// boundary edge 2-7. The edge 1-2 itself stays Delaunay, so this is the only edge the cover would flip.
+TestMesh hexagonWithObtuseBoundary() {
+  TestMesh mesh = hexagon();
+  mesh.name = "hexagon with an obtuse boundary angle";
+  mesh.positions.insert(mesh.positions.end(), {1.41, -0.11, 0.});
+  mesh.triangles.insert(mesh.triangles.end(), {1, 7, 2});
+  mesh.expectFastPath = false;
+  return mesh;
+}
+
+// Two octahedra touching at one vertex (vertex 0 of the first is vertex 1 of the second)
+TestMesh touchingOctahedra() {
+  TestMesh mesh = octahedron();
+  TestMesh other = octahedron();
+  mesh.name = "two octahedra sharing a vertex";
+  std::vector<uint32_t> otherToMesh = {6, 0, 7, 8, 9, 10};
+  for (uint32_t iV : {0, 2, 3, 4, 5}) {
+    mesh.positions.insert(mesh.positions.end(), {other.positions[3 * iV] + 2., other.positions[3 * iV + 1],
+                                                 other.positions[3 * iV + 2]});
+  }
+  for (uint32_t iV : other.triangles) mesh.triangles.push_back(otherToMesh[iV]);
+  mesh.expectFastPath = true;
+  return mesh;
+}
+
+// The largest difference between two matrices of the same size, relative to the largest entry of `reference`
+double relativeDifference(const SparseMatrix<double>& mat, const SparseMatrix<double>& reference) {
+  SparseMatrix<double> diff = mat - reference;
+  double maxDiff = 0., maxEntry = 0.;
+  for (int k = 0; k < diff.outerSize(); k++) {
+    for (SparseMatrix<double>::InnerIterator it(diff, k); it; ++it) maxDiff = std::max(maxDiff, std::abs(it.value()));
+  }
+  for (int k = 0; k < reference.outerSize(); k++) {
+    for (SparseMatrix<double>::InnerIterator it(reference, k); it; ++it) {
+      maxEntry = std::max(maxEntry, std::abs(it.value()));
+    }
+  }
+  return maxDiff / maxEntry;
+}
+
+// Returns the number of mismatches (0 or 1), reporting them
+size_t compare(const std::string& name, const SparseMatrix<double>& mat, const SparseMatrix<double>& reference) {
+  if (mat.rows() != reference.rows() || mat.cols() != reference.cols()) {
+    std::cout << name << ": sizes differ" << std::endl;
+    return 1;
+  }
+  double difference = relativeDifference(mat, reference);
+  std::cout << name << ": max relative difference " << difference << std::endl;
+  return difference < tolerance ? 0 : 1; // (also catches NaN)
+}
+
+size_t checkMesh(const TestMesh& mesh) {
+  size_t nFailed = 0;
+  TuftedLaplacianResult results[2];
+  for (bool fastPath : {false, true}) {
+    TuftedLaplacianOptions options;
+    options.manifoldFastPath = fastPath;
+    TuftedLaplacianResult& result = results[fastPath];
+    result = buildTuftedLaplacianFromMesh(mesh.positions.data(), mesh.positions.size() / 3, mesh.triangles.data(),
+                                          mesh.triangles.size() / 3, 3, options);
+
+    bool expected = fastPath && mesh.expectFastPath;
+    std::cout << mesh.name << (fastPath ? " (fast path allowed)" : " (fast path off)") << ": "
+              << (result.tookManifoldFastPath ? "took" : "did not take") << " the fast path" << std::endl;
+    if (result.tookManifoldFastPath != expected) {
+      std::cout << mesh.name << ": expected the fast path " << (expected ? "to be taken" : "not to be taken")
+                << std::endl;
+      nFailed++;
+    }
+  }
+
+  nFailed += compare(mesh.name + ", L", results[true].L, results[false].L);
+  nFailed += compare(mesh.name + ", M", results[true].M, results[false].M);
+  return nFailed;
+}
+
+} // namespace
+
+int main() {
+  size_t nFailed = 0;
+  for (const TestMesh& mesh : {octahedron(), hexagon(), hexagonWithObtuseBoundary(), touchingOctahedra()}) {
+    nFailed += checkMesh(mesh);
+  }
+  return nFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,168 @@
+// Checks that the fast loaders (loadFlatMesh()) give the same vertices and triangles as geometry-central's
+// SimplePolygonMesh loader, after its stripFacesWithDuplicateVertices() and triangulate(), on small OBJ and binary PLY
+// files with polygons, a face which repeats a vertex and an unused vertex. Both are also checked against the expected
+// data written out by hand, as is a round trip through the raw format.
+
+#include "mesh_io.h"
+
+#include "geometrycentral/surface/simple_polygon_mesh.h"
+#include "geometrycentral/utilities/vector3.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using geometrycentral::Vector3;
+using geometrycentral::surface::SimplePolygonMesh;
+
+namespace {
+
+// (all exactly representable in single precision, so that the float formats round trip exactly)
+// clang-format off
+const std::vector<double> vertexPositions = {
+    0., 0., 0.,   1., 0., 0.,   1., 1., 0.,   0., 1., 0.,
+    2., 0., 0.5,  2., 1., 0.5,
+    3., 3.25, -3., // (not used by any face)
+};
+// clang-format on
+
+const std::vector<std::vector<uint32_t>> polygons = {
+    {0, 1, 2},
+    {0, 2, 3},
+    {1, 4, 5, 2},    // a quad
+    {0, 1, 4, 5, 3}, // a pentagon
+    {1, 4, 1},       // repeats a vertex, so it is dropped
+};
+
+// Fan-triangulated, without the dropped face
+const std::vector<uint32_t> expectedTriangles = {
+    0, 1, 2, 0, 2, 3, 1, 4, 5, 1, 5, 2, 0, 1, 4, 0, 4, 5, 0, 5, 3,
+};
+
+void writeOBJ(const std::string& filename) {
+  std::ofstream out(filename);
+  out << "# mesh loader test\n";
+  for (size_t iV = 0; iV < vertexPositions.size() / 3; iV++) {
+    out << "v " << vertexPositions[3 * iV] << " " << vertexPositions[3 * iV + 1] << " " << vertexPositions[3 * iV + 2]
+        << "\n";
+  }
+  out << "vt 0 0\nvn 0 0 1\n";
+  for (size_t iF = 0; iF < polygons.size(); iF++) {
+    out << "f";
+    for (uint32_t iV : polygons[iF]) {
+      out << " " << iV + 1;
+      if (iF == 0) out << "/1/1"; // (texture and normal indices are ignored)
+      if (iF == 1) out << "//1";
+    }
+    out << "\n";
+  }
+  if (!out) throw std::runtime_error("failed to write " + filename);
+}
+
+template <typename T>
+void writeBinary(std::ofstream& out, T value) {
+  char bytes[sizeof(T)];
+  std::memcpy(bytes, &value, sizeof(T));
+  out.write(bytes, sizeof(T));
+}
+
+// Binary little-endian PLY, with an extra vertex property the loaders should skip
+void writePLY(const std::string& filename) {
+  std::ofstream out(filename, std::ios::binary);
+  out << "ply\nformat binary_little_endian 1.0\ncomment mesh loader test\n";
+  out << "element vertex " << vertexPositions.size() / 3 << "\n";
+  out << "property float x\nproperty float y\nproperty float z\nproperty uchar quality\n";
+  out << "element face " << polygons.size() << "\n";
+  out << "property list uchar int vertex_indices\nend_header\n";
+  for (size_t iV = 0; iV < vertexPositions.size() / 3; iV++) {
+    for (size_t j = 0; j < 3; j++) writeBinary(out, static_cast<float>(vertexPositions[3 * iV + j]));
+    writeBinary(out, static_cast<uint8_t>(iV));
+  }
+  for (const std::vector<uint32_t>& polygon : polygons) {
+    writeBinary(out, static_cast<uint8_t>(polygon.size()));
+    for (uint32_t iV : polygon) writeBinary(out, static_cast<int32_t>(iV));
+  }
+  if (!out) throw std::runtime_error("failed to write " + filename);
+}
+
+// Returns the number of mismatches (0 or 1), reporting them
+size_t compareMesh(const std::string& name, const std::vector<double>& positions,
+                   const std::vector<uint32_t>& triangles) {
+  bool ok = true;
+  if (positions != vertexPositions) {
+    std::cout << name << ": vertex positions differ" << std::endl;
+    ok = false;
+  }
+  if (triangles != expectedTriangles) {
+    std::cout << name << ": triangles differ" << std::endl;
+    ok = false;
+  }
+  if (ok) std::cout << name << ": ok" << std::endl;
+  return ok ? 0 : 1;
+}
+
+size_t checkFlatLoader(const std::string& filename, size_t nThreads) {
+  FlatTriangleMesh mesh;
+  std::string name = "loadFlatMesh(" + filename + ", " + std::to_string(nThreads) + " threads)";
+  if (!loadFlatMesh(filename, mesh, nThreads)) {
+    std::cout << name << ": not handled by the fast loader" << std::endl;
+    return 1;
+  }
+  return compareMesh(name, mesh.vertexPositions, mesh.triangles);
+}
+
+size_t checkGeometryCentralLoader(const std::string& filename) {
+  SimplePolygonMesh mesh(filename);
+  mesh.stripFacesWithDuplicateVertices();
+  mesh.triangulate();
+
+  std::vector<double> positions;
+  for (const Vector3& p : mesh.vertexCoordinates) positions.insert(positions.end(), {p.x, p.y, p.z});
+  std::vector<uint32_t> triangles;
+  for (const std::vector<size_t>& polygon : mesh.polygons) {
+    if (polygon.size() != 3) {
+      std::cout << "SimplePolygonMesh(" << filename << "): not a triangle mesh" << std::endl;
+      return 1;
+    }
+    for (size_t iV : polygon) triangles.push_back(static_cast<uint32_t>(iV));
+  }
+  return compareMesh("SimplePolygonMesh(" + filename + ")", positions, triangles);
+}
+
+} // namespace
+
+int main() {
+  const std::string objFilename = "mesh_loaders_test.obj";
+  const std::string plyFilename = "mesh_loaders_test.ply";
+  const std::string rawFilename = "mesh_loaders_test.tmesh";
+  size_t nFailed = 0;
+
+  try {
+    writeOBJ(objFilename);
+    writePLY(plyFilename);
+    for (const std::string& filename : {objFilename, plyFilename}) {
+      nFailed += checkGeometryCentralLoader(filename);
+      nFailed += checkFlatLoader(filename, 1);
+      nFailed += checkFlatLoader(filename, 4);
+    }
+
+    FlatTriangleMesh expected;
+    expected.vertexPositions = vertexPositions;
+    expected.triangles = expectedTriangles;
+    saveFlatMeshRaw(rawFilename, expected);
+    nFailed += checkFlatLoader(rawFilename, 1);
+    nFailed += checkFlatLoader(rawFilename, 4);
+  } catch (const std::runtime_error& e) {
+    std::cout << "error: " << e.what() << std::endl;
+    nFailed++;
+  }
+
+  for (const std::string& filename : {objFilename, plyFilename, rawFilename}) std::remove(filename.c_str());
+  return nFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,75 @@
+// Checks that the SVD and covariance normal estimators agree (up to sign) at every point of a seeded synthetic cloud, a
+// plane and a sphere, through generate_normals() with both neighbor layouts.
+
+#include "point_cloud_utilities.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+const size_t nNeigh = 30;
+const double tolerance = 1e-8; // on 1 - |dot(nSVD, nCov)|
+
+// A jittered grid on the plane z = 0, and random points on a unit sphere far enough above it that no neighborhood has
+// points of both
+std::vector<Vector3> makeCloud() {
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<double> jitter(-0.25, 0.25);
+  std::normal_distribution<double> gaussian;
+
+  std::vector<Vector3> points;
+  const size_t gridSize = 40;
+  const double spacing = 0.1;
+  for (size_t i = 0; i < gridSize; i++) {
+    for (size_t j = 0; j < gridSize; j++) {
+      points.push_back(Vector3{(i + jitter(rng)) * spacing, (j + jitter(rng)) * spacing, 0.});
+    }
+  }
+
+  const size_t nSpherePoints = 1600;
+  const Vector3 sphereCenter{2., 2., 5.};
+  for (size_t i = 0; i < nSpherePoints; i++) {
+    Vector3 dir{gaussian(rng), gaussian(rng), gaussian(rng)};
+    points.push_back(sphereCenter + unit(dir));
+  }
+  return points;
+}
+
+// Returns the number of points where the two sets of normals disagree, reporting the worst
+size_t compareNormals(const std::string& name, const std::vector<Vector3>& svdNormals,
+                      const std::vector<Vector3>& covNormals) {
+  size_t nFailed = 0;
+  double worst = 0.;
+  for (size_t iPt = 0; iPt < svdNormals.size(); iPt++) {
+    double deviation = 1. - std::abs(dot(svdNormals[iPt], covNormals[iPt]));
+    if (!(deviation < tolerance)) nFailed++; // (also catches NaN)
+    worst = std::max(worst, deviation);
+  }
+  std::cout << name << ": max 1 - |dot(nSVD, nCov)| = " << worst << ", " << nFailed << " / " << svdNormals.size()
+            << " points over " << tolerance << std::endl;
+  return nFailed;
+}
+
+} // namespace
+
+int main() {
+  std::vector<Vector3> points = makeCloud();
+  size_t nFailed = 0;
+
+  Neighbors_t neigh = generate_knn(points, nNeigh);
+  nFailed += compareNormals("neighbor lists", generate_normals(points, neigh, 1, NormalEstimator::SVD),
+                            generate_normals(points, neigh, 1, NormalEstimator::Covariance));
+
+  // (the covariance estimator runs in batches on a neighbor table)
+  NeighborTable table = generate_knn_table(points, nNeigh);
+  nFailed += compareNormals("neighbor table", generate_normals(points, table, 1, NormalEstimator::SVD),
+                            generate_normals(points, table, 1, NormalEstimator::Covariance));
+
+  return nFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}